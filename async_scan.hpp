@@ -0,0 +1,150 @@
+#ifndef ASYNC_SCAN_HPP
+#define ASYNC_SCAN_HPP
+
+#include <numeric>
+#include "file_vector.hpp"
+#include "io_ring.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A read path for scanning cold columns. Scanning a mapped file_vector
+// faults its pages in synchronously, one readahead window at a time, so a
+// fast device is never kept busy. async_scan instead reads the column's file
+// in large chunks through an io_ring, keeping 'depth' reads in flight into a
+// pool of aligned buffers, and hands each chunk to the caller as soon as it
+// (and every chunk before it) has arrived, while the later reads continue.
+//
+// With 'direct' set the file is opened with O_DIRECT, bypassing the page
+// cache, where the file-system supports it. Without io_uring the chunks are
+// read with pread, with the following chunks hinted with
+// POSIX_FADV_WILLNEED so the kernel reads ahead of the caller.
+
+struct scan_options {
+    size_t chunk_bytes = 1 << 20;
+    unsigned depth = 8;
+    bool direct = false;
+};
+
+// Call 'f(T const* values, size_t n, size_t first_row)' for successive
+// chunks of 'col', in order, returning the number of rows scanned. The
+// values are only valid during the call.
+template <typename T, typename R, typename F>
+size_t async_scan(file_vector<T, R> const& col, F f, scan_options const& options = scan_options()) {
+    size_t const rows = col.size();
+    if (rows == 0) {
+        return 0;
+    }
+
+    int fd = -1;
+    if (options.direct) {
+        fd = open(col.file_name().c_str(), O_RDONLY | O_DIRECT);
+    }
+    if (fd == -1) {
+        fd = open(col.file_name().c_str(), O_RDONLY);
+    }
+    if (fd == -1) {
+        throw runtime_error("Unable to open file for async_scan.");
+    }
+
+    // Chunks are whole pages, for O_DIRECT, and whole values. Each read
+    // starts on the page holding the chunk's first byte, so the values start
+    // 'skew' bytes into the buffer.
+    size_t const page_size = getpagesize();
+    size_t const unit = lcm(page_size, sizeof(T));
+    size_t const chunk = max(options.chunk_bytes / unit, size_t(1)) * unit;
+    size_t const first = col.file_offset();
+    size_t const last = first + rows * sizeof(T);
+    size_t const skew = first % page_size;
+    size_t const chunks = (last - first + chunk - 1) / chunk;
+    unsigned const depth = max(min(options.depth, static_cast<unsigned>(chunks)), 1u);
+    size_t const buffer_size = chunk + page_size;
+
+    aligned_buffer pool(depth * buffer_size, page_size);
+    vector<int> result(depth, 0);
+    vector<size_t> arrived(depth, chunks);
+    unsigned in_flight = 0;
+    io_ring ring(depth);
+
+    auto const begin = [first, chunk, skew](size_t const c) {
+        return first + c * chunk - skew;
+    };
+    auto const end = [first, last, chunk, page_size](size_t const c) {
+        size_t const e = min(first + (c + 1) * chunk, last);
+        return (e + page_size - 1) / page_size * page_size;
+    };
+    auto const issue = [&](size_t const c) {
+        unsigned const slot = c % depth;
+        if (ring.available()) {
+            ring.read(fd, pool.data() + slot * buffer_size, end(c) - begin(c), begin(c), c);
+            ++in_flight;
+        } else {
+            posix_fadvise(fd, begin(c), end(c) - begin(c), POSIX_FADV_WILLNEED);
+        }
+    };
+
+    // Read any bytes of chunk 'c' that a short read left out.
+    auto const complete = [&](size_t const c, size_t done) {
+        char* const buffer = pool.data() + (c % depth) * buffer_size;
+        size_t const needed = min(first + (c + 1) * chunk, last) - begin(c);
+        while (done < needed) {
+            ssize_t const n = pread(fd, buffer + done, end(c) - begin(c) - done, begin(c) + done);
+            if (n <= 0) {
+                throw runtime_error("Unable to read file for async_scan.");
+            }
+            done += n;
+        }
+    };
+
+    try {
+        for (size_t c = 0; c < depth; ++c) {
+            issue(c);
+        }
+        if (ring.available()) {
+            ring.submit();
+        }
+
+        for (size_t c = 0; c < chunks; ++c) {
+            unsigned const slot = c % depth;
+            if (ring.available()) {
+                while (arrived[slot] != c) {
+                    pair<uint64_t, int> const done = ring.wait();
+                    --in_flight;
+                    if (done.second < 0) {
+                        throw runtime_error("Unable to read file for async_scan.");
+                    }
+                    arrived[done.first % depth] = done.first;
+                    result[done.first % depth] = done.second;
+                }
+                complete(c, result[slot]);
+            } else {
+                complete(c, 0);
+            }
+
+            size_t const row = c * (chunk / sizeof(T));
+            f(reinterpret_cast<T const*>(pool.data() + slot * buffer_size + skew)
+                , min(chunk / sizeof(T), rows - row), row
+            );
+
+            if (c + depth < chunks) {
+                issue(c + depth);
+                if (ring.available()) {
+                    ring.submit();
+                }
+            }
+        }
+    } catch (...) {
+        // The kernel may still be reading into the pool.
+        while (in_flight > 0) {
+            ring.wait();
+            --in_flight;
+        }
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+    return rows;
+}
+
+#endif
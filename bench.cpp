@@ -0,0 +1,1913 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <ctime>
+#include <unordered_map>
+#include "file_vector.hpp"
+#include "sorted_file_vector.hpp"
+#include "compressed_file_vector.hpp"
+#include "dictionary_file_vector.hpp"
+#include "string_file_vector.hpp"
+#include "filter.hpp"
+#include "zone_map.hpp"
+#include "file_bitset.hpp"
+#include "async_scan.hpp"
+#include "ingest_file_vector.hpp"
+#include "coroutine_scan.hpp"
+#include "checksummed_file_vector.hpp"
+#include "persistent_arena.hpp"
+#include "persistent_hash_index.hpp"
+#include "external_sort.hpp"
+#include "join.hpp"
+#include "group_by.hpp"
+#include "rollup.hpp"
+#include "prefix_sum.hpp"
+
+using namespace std;
+using fv_int = file_vector<int>;
+
+// Write back and evict a file from the page-cache, so the next scan of it
+// reads from the device.
+void drop_cache(string const& name) {
+    int const fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+//----------------------------------------------------------------------------
+// Expiry: drop the oldest 'n' elements from columns of increasing length.
+// drop_front should stay flat, erase grows with the length of the column.
+
+template <typename F> double time_ms(F f) {
+    auto const start = chrono::steady_clock::now();
+    f();
+    auto const stop = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+void bench_expiry() {
+    size_t const n = 1 << 16;
+
+    cout << "expiry of " << n << " elements" << endl;
+    for (size_t size = 1 << 20; size <= 1 << 25; size <<= 1) {
+        fv_int col("bench_expiry", fv_int::create_file);
+        col.clear();
+        col.resize(size, 1);
+
+        double const drop_ms = time_ms([&col, n] {
+            col.drop_front(n);
+        });
+        double const erase_ms = time_ms([&col, n] {
+            col.erase(col.cbegin(), col.cbegin() + n);
+        });
+
+        cout << "  size " << size
+            << "  drop_front " << drop_ms << " ms"
+            << "  erase " << erase_ms << " ms" << endl;
+
+        col.clear();
+        col.close();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Backfill: insert late values at random positions in a sorted column, with
+// file_vector::insert against the lazily merged delta of sorted_file_vector.
+
+void bench_backfill() {
+    size_t const size = 1 << 22;
+    size_t const late = 1 << 12;
+
+    mt19937 gen(42);
+    uniform_int_distribution<int> dist(0, 2 * size);
+    vector<int> values(late);
+    for (int& v : values) {
+        v = dist(gen) | 1;
+    }
+
+    fv_int col("bench_backfill", fv_int::create_file);
+    col.clear();
+    for (size_t i = 0; i < size; ++i) {
+        col.push_back(2 * i);
+    }
+    double const insert_ms = time_ms([&col, &values] {
+        for (int const v : values) {
+            col.insert(
+                col.cbegin() + (lower_bound(col.cbegin(), col.cend(), v) - col.cbegin()), v
+            );
+        }
+    });
+    col.clear();
+    col.close();
+
+    sorted_file_vector<int> sorted("bench_backfill_sorted", fv_int::create_file);
+    sorted.clear();
+    for (size_t i = 0; i < size; ++i) {
+        sorted.insert(2 * i);
+    }
+    double const sorted_ms = time_ms([&sorted, &values] {
+        for (int const v : values) {
+            sorted.insert(v);
+        }
+    });
+    sorted.clear();
+    sorted.close();
+
+    cout << "backfill of " << late << " values into " << size << endl
+        << "  file_vector::insert " << late / insert_ms * 1000.0 << " values/s" << endl
+        << "  sorted_file_vector::insert " << late / sorted_ms * 1000.0 << " values/s" << endl;
+}
+
+//----------------------------------------------------------------------------
+// Bulk backfill: batches of out of order values, inserted one at a time with
+// file_vector::insert, against sorted runs with background compaction.
+
+void bench_bulk_backfill() {
+    size_t const size = 1 << 22;
+    size_t const batch = 1 << 12;
+    size_t const batches = 64;
+
+    mt19937 gen(42);
+    uniform_int_distribution<int> dist(0, 2 * size);
+    vector<int> values(batch);
+
+    fv_int col("bench_bulk", fv_int::create_file);
+    col.clear();
+    for (size_t i = 0; i < size; ++i) {
+        col.push_back(2 * i);
+    }
+    for (int& v : values) {
+        v = dist(gen) | 1;
+    }
+    double const insert_ms = time_ms([&col, &values] {
+        for (int const v : values) {
+            col.insert(
+                col.cbegin() + (lower_bound(col.cbegin(), col.cend(), v) - col.cbegin()), v
+            );
+        }
+    });
+    col.clear();
+    col.close();
+
+    sorted_file_vector<int> sorted("bench_bulk_sorted", fv_int::create_file);
+    sorted.clear();
+    for (size_t i = 0; i < size; ++i) {
+        sorted.insert(2 * i);
+    }
+    double const sorted_ms = time_ms([&sorted, &values, &gen, &dist, batches] {
+        for (size_t b = 0; b < batches; ++b) {
+            for (int& v : values) {
+                v = dist(gen) | 1;
+            }
+            sorted.insert(values.begin(), values.end());
+        }
+        sorted.wait();
+    });
+    sorted.clear();
+    sorted.close();
+
+    cout << "bulk backfill into " << size << endl
+        << "  file_vector::insert per value " << batch / insert_ms * 1000.0 << " values/s" << endl
+        << "  sorted_file_vector::insert batch " << batch * batches / sorted_ms * 1000.0 << " values/s" << endl;
+}
+
+//----------------------------------------------------------------------------
+// Cold cache scan of a timestamp column, raw mapping against compressed.
+
+void bench_compressed_scan() {
+    size_t const size = 1 << 24;
+
+    file_vector<int64_t> raw("bench_scan_raw", fv_int::create_file);
+    compressed_file_vector<int64_t> packed("bench_scan_packed", fv_int::create_file);
+    raw.clear();
+    packed.clear();
+    for (size_t i = 0; i < size; ++i) {
+        int64_t const t = 1500000000000 + 250 * i + (i % 3);
+        raw.push_back(t);
+        packed.push_back(t);
+    }
+    size_t const packed_bytes = packed.compressed_bytes();
+    raw.close();
+    packed.close();
+
+    for (string const name : {"bench_scan_raw", "bench_scan_packed",
+        "bench_scan_packed.index", "bench_scan_packed.tail"}
+    ) {
+        drop_cache(name);
+    }
+
+    int64_t raw_sum = 0;
+    double const raw_ms = time_ms([&raw_sum] {
+        file_vector<int64_t> col("bench_scan_raw");
+        for (auto i = col.cbegin(); i != col.cend(); ++i) {
+            raw_sum += *i;
+        }
+    });
+
+    int64_t packed_sum = 0;
+    double const packed_ms = time_ms([&packed_sum] {
+        compressed_file_vector<int64_t> col("bench_scan_packed");
+        col.scan([&packed_sum](int64_t const* values, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                packed_sum += values[i];
+            }
+        });
+    });
+
+    double const gb = size * sizeof(int64_t) / 1e9;
+    cout << "cold scan of " << size << " timestamps, "
+        << size * sizeof(int64_t) / packed_bytes << "x compression" << endl
+        << "  raw mapping " << gb / raw_ms * 1000.0 << " GB/s" << endl
+        << "  compressed " << gb / packed_ms * 1000.0 << " GB/s"
+        << ((raw_sum == packed_sum) ? "" : " (MISMATCH)") << endl;
+
+    file_vector<int64_t>("bench_scan_raw").clear();
+    compressed_file_vector<int64_t> packed_clear("bench_scan_packed");
+    packed_clear.clear();
+    packed_clear.close();
+}
+
+//----------------------------------------------------------------------------
+// Dictionary encoded symbols against fixed width symbols: storage, and
+// counting the rows equal to one symbol.
+
+struct symbol {
+    char name[16];
+
+    bool operator== (symbol const& that) const {
+        return memcmp(name, that.name, sizeof(name)) == 0;
+    }
+};
+
+struct symbol_hash {
+    size_t operator() (symbol const& s) const {
+        size_t h = 0;
+        for (char const c : s.name) {
+            h = h * 31 + c;
+        }
+        return h;
+    }
+};
+
+void bench_dictionary() {
+    size_t const size = 1 << 24;
+
+    vector<symbol> symbols(40);
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        memset(symbols[i].name, 0, sizeof(symbols[i].name));
+        snprintf(symbols[i].name, sizeof(symbols[i].name), "SYM%zu.L", i);
+    }
+
+    file_vector<symbol> raw("bench_symbols_raw", fv_int::create_file);
+    dictionary_file_vector<symbol, symbol_hash> dict("bench_symbols", fv_int::create_file);
+    raw.clear();
+    dict.clear();
+    for (size_t i = 0; i < size; ++i) {
+        symbol const& s = symbols[(i * 7) % symbols.size()];
+        raw.push_back(s);
+        dict.push_back(s);
+    }
+
+    symbol const& wanted = symbols[3];
+    size_t raw_count = 0;
+    double const raw_ms = time_ms([&raw, &raw_count, &wanted] {
+        for (auto i = raw.cbegin(); i != raw.cend(); ++i) {
+            raw_count += (*i == wanted);
+        }
+    });
+
+    size_t dict_count = 0;
+    double const dict_ms = time_ms([&dict, &dict_count, &wanted] {
+        dict_count = dict.equal(wanted).count();
+    });
+
+    cout << "equality on " << size << " symbols" << endl
+        << "  fixed width " << size * sizeof(symbol) / 1048576 << " MiB "
+        << raw_ms << " ms" << endl
+        << "  dictionary " << size * dict.code_width() / 1048576 << " MiB "
+        << dict_ms << " ms" << ((raw_count == dict_count) ? "" : " (MISMATCH)") << endl;
+
+    raw.clear();
+    raw.close();
+    dict.clear();
+    dict.close();
+}
+
+//----------------------------------------------------------------------------
+// Variable length strings against fixed width padded char arrays: storage,
+// appending, and a scan summing the string lengths.
+
+void bench_strings() {
+    size_t const size = 1 << 22;
+
+    struct padded {
+        char text[64];
+    };
+
+    mt19937 gen(42);
+    uniform_int_distribution<size_t> length(4, 40);
+    vector<string> values(1024);
+    for (string& v : values) {
+        v.assign(length(gen), 'x');
+    }
+
+    file_vector<padded> fixed("bench_strings_fixed", fv_int::create_file);
+    fixed.clear();
+    double const fixed_append_ms = time_ms([&fixed, &values, size] {
+        padded p;
+        for (size_t i = 0; i < size; ++i) {
+            string const& v = values[i % values.size()];
+            memset(p.text, 0, sizeof(p.text));
+            memcpy(p.text, v.data(), v.size());
+            fixed.push_back(p);
+        }
+    });
+
+    string_file_vector heap("bench_strings", fv_int::create_file);
+    heap.clear();
+    double const heap_append_ms = time_ms([&heap, &values, size] {
+        for (size_t i = 0; i < size; ++i) {
+            heap.push_back(values[i % values.size()]);
+        }
+    });
+
+    size_t fixed_total = 0;
+    double const fixed_scan_ms = time_ms([&fixed, &fixed_total] {
+        for (auto i = fixed.cbegin(); i != fixed.cend(); ++i) {
+            fixed_total += strnlen(i->text, sizeof(i->text));
+        }
+    });
+
+    size_t heap_total = 0;
+    double const heap_scan_ms = time_ms([&heap, &heap_total] {
+        for (string_view const v : heap) {
+            heap_total += v.size();
+        }
+    });
+
+    cout << "strings, " << size << " values" << endl
+        << "  padded char[64] " << size * sizeof(padded) / 1048576 << " MiB, append "
+        << fixed_append_ms << " ms, scan " << fixed_scan_ms << " ms" << endl
+        << "  string_file_vector " << (heap.bytes() + size * sizeof(uint64_t)) / 1048576
+        << " MiB, append " << heap_append_ms << " ms, scan " << heap_scan_ms << " ms"
+        << ((fixed_total == heap_total) ? "" : " (MISMATCH)") << endl;
+
+    fixed.clear();
+    fixed.close();
+    heap.clear();
+    heap.close();
+}
+
+//----------------------------------------------------------------------------
+// Filter a column by range and gather another, at varying selectivity,
+// against a hand written loop over operator[].
+
+void bench_filter() {
+    size_t const size = 1 << 24;
+
+    mt19937 gen(42);
+    uniform_int_distribution<int> dist(0, 999999);
+
+    fv_int key("bench_filter_key", fv_int::create_file);
+    file_vector<double> value("bench_filter_value", fv_int::create_file);
+    key.clear();
+    value.clear();
+    for (size_t i = 0; i < size; ++i) {
+        key.push_back(dist(gen));
+        value.push_back(i * 0.5);
+    }
+
+    cout << "filter and gather on " << size << " rows" << endl;
+    for (int const per_mille : {1, 10, 100, 500, 900}) {
+        int const hi = per_mille * 1000 - 1;
+
+        vector<double> looped;
+        double const loop_ms = time_ms([&key, &value, &looped, hi, size] {
+            for (size_t i = 0; i < size; ++i) {
+                if (key[i] >= 0 && key[i] <= hi) {
+                    looped.push_back(value[i]);
+                }
+            }
+        });
+
+        vector<double> gathered;
+        double const filter_ms = time_ms([&key, &value, &gathered, hi] {
+            gather(value, select_between(key, 0, hi), gathered);
+        });
+
+        cout << "  selectivity " << per_mille / 10.0 << "%"
+            << "  loop " << size / loop_ms / 1000.0 << " Mrows/s"
+            << "  filter " << size / filter_ms / 1000.0 << " Mrows/s"
+            << ((looped == gathered) ? "" : " (MISMATCH)") << endl;
+    }
+
+    key.clear();
+    key.close();
+    value.clear();
+    value.close();
+}
+
+//----------------------------------------------------------------------------
+// Selective range queries on a random walk price column, cold cache, with
+// zone map skipping against a full scan.
+
+void bench_zone_map() {
+    size_t const size = 1 << 24;
+
+    mt19937 gen(42);
+    normal_distribution<double> step(0.0, 0.01);
+
+    {
+        zoned_file_vector<double> prices("bench_zoned", fv_int::create_file);
+        prices.clear();
+        double p = 100.0;
+        for (size_t i = 0; i < size; ++i) {
+            p += step(gen);
+            prices.push_back(p);
+        }
+        prices.close();
+    }
+
+    cout << "range query on " << size << " prices, cold cache" << endl;
+    for (double const width : {0.01, 0.1, 1.0}) {
+        drop_cache("bench_zoned");
+        drop_cache("bench_zoned.zones");
+        size_t full_count = 0;
+        double const full_ms = time_ms([&full_count, width] {
+            zoned_file_vector<double> prices("bench_zoned");
+            full_count = select_between(prices.column(), 100.0, 100.0 + width).count();
+        });
+
+        drop_cache("bench_zoned");
+        drop_cache("bench_zoned.zones");
+        size_t zoned_count = 0;
+        double const zoned_ms = time_ms([&zoned_count, width] {
+            zoned_file_vector<double> prices("bench_zoned");
+            zoned_count = prices.select_between(100.0, 100.0 + width).count();
+        });
+
+        cout << "  width " << width << ", " << full_count << " rows"
+            << "  full scan " << full_ms << " ms"
+            << "  zone map " << zoned_ms << " ms"
+            << ((full_count == zoned_count) ? "" : " (MISMATCH)") << endl;
+    }
+
+    zoned_file_vector<double> prices("bench_zoned");
+    prices.clear();
+    prices.close();
+}
+
+//----------------------------------------------------------------------------
+// Building and counting a sparse flag column as a file_bitset against a
+// file_vector<bool> of one byte per flag, cold cache, then the and of two
+// bitsets and select of the k-th set bit.
+
+void bench_bitset() {
+    size_t const size = 1 << 26;
+
+    mt19937 gen(42);
+    bernoulli_distribution flag(0.1);
+
+    double const bytes_ms = time_ms([size, &gen, &flag] {
+        file_vector<bool> flags("bench_flags", fv_int::create_file);
+        flags.clear();
+        for (size_t i = 0; i < size; ++i) {
+            flags.push_back(flag(gen));
+        }
+        flags.close();
+    });
+
+    gen.seed(42);
+    double const bits_ms = time_ms([size, &gen, &flag] {
+        file_bitset flags("bench_bits", fv_int::create_file);
+        file_bitset other("bench_bits_other", fv_int::create_file);
+        flags.clear();
+        other.clear();
+        for (size_t i = 0; i < size; ++i) {
+            flags.push_back(flag(gen));
+            other.push_back(i % 2 == 0);
+        }
+        flags.close();
+        other.close();
+    });
+
+    cout << "build " << size << " flags" << endl;
+    cout << "  file_vector<bool> " << bytes_ms << " ms, " << size << " bytes" << endl;
+    cout << "  file_bitset " << bits_ms << " ms, " << size / 8 << " bytes" << endl;
+
+    drop_cache("bench_flags");
+    size_t byte_count = 0;
+    double const byte_count_ms = time_ms([&byte_count] {
+        file_vector<bool> flags("bench_flags");
+        bool const* const b = flags.data();
+        for (size_t i = 0; i < flags.size(); ++i) {
+            byte_count += b[i];
+        }
+    });
+
+    drop_cache("bench_bits");
+    size_t bit_count = 0;
+    double const bit_count_ms = time_ms([&bit_count] {
+        file_bitset flags("bench_bits");
+        bit_count = flags.count();
+    });
+
+    cout << "count set flags, cold cache" << endl;
+    cout << "  file_vector<bool> " << byte_count_ms << " ms" << endl;
+    cout << "  file_bitset " << bit_count_ms << " ms"
+        << ((byte_count == bit_count) ? "" : " (MISMATCH)") << endl;
+
+    file_bitset flags("bench_bits");
+    file_bitset other("bench_bits_other");
+    double const and_ms = time_ms([&flags, &other] {
+        flags &= other;
+    });
+
+    size_t found = 0;
+    size_t const selects = 1 << 20;
+    double const select_ms = time_ms([&flags, &found, selects] {
+        size_t const n = flags.count();
+        for (size_t k = 0; k < selects; ++k) {
+            found += flags.select((k * 7919) % n) < flags.size();
+        }
+    });
+
+    cout << "and of two bitsets " << and_ms << " ms" << endl;
+    cout << selects << " selects " << select_ms << " ms"
+        << ((found == selects) ? "" : " (MISMATCH)") << endl;
+
+    flags.clear();
+    other.clear();
+    flags.close();
+    other.close();
+    file_vector<bool> bytes("bench_flags");
+    bytes.clear();
+    bytes.close();
+}
+
+//----------------------------------------------------------------------------
+// Cold scan: sum a column that is not in the page-cache, through the
+// mapping (page faults and readahead) and through async_scan.
+
+void bench_cold_scan() {
+    size_t const size = size_t(1) << 27;
+
+    {
+        file_vector<int64_t> col("bench_cold", fv_int::create_file);
+        col.clear();
+        col.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            col.push_back(i);
+        }
+        col.close();
+    }
+
+    double const gb = size * sizeof(int64_t) / 1e9;
+    int64_t const expected = int64_t(size) * int64_t(size - 1) / 2;
+    cout << "cold scan of " << gb << " GB" << endl;
+
+    auto const report = [gb, expected](string const& path, double const ms, int64_t const sum) {
+        cout << "  " << path << " " << ms << " ms, " << gb / (ms / 1000.0) << " GB/s"
+            << ((sum == expected) ? "" : " (MISMATCH)") << endl;
+    };
+
+    drop_cache("bench_cold");
+    int64_t mapped_sum = 0;
+    double const mapped_ms = time_ms([&mapped_sum] {
+        file_vector<int64_t> col("bench_cold");
+        int64_t const* const v = col.data();
+        for (size_t i = 0; i < col.size(); ++i) {
+            mapped_sum += v[i];
+        }
+    });
+    report("mmap", mapped_ms, mapped_sum);
+
+    for (bool const direct : {false, true}) {
+        for (unsigned const depth : {1u, 4u, 16u}) {
+            drop_cache("bench_cold");
+            int64_t sum = 0;
+            double const ms = time_ms([&sum, direct, depth] {
+                file_vector<int64_t> col("bench_cold");
+                scan_options options;
+                options.depth = depth;
+                options.direct = direct;
+                async_scan(col, [&sum](int64_t const* v, size_t n, size_t) {
+                    for (size_t i = 0; i < n; ++i) {
+                        sum += v[i];
+                    }
+                }, options);
+            });
+            report(string("async_scan ") + (direct ? "direct" : "buffered")
+                + " depth " + to_string(depth), ms, sum
+            );
+        }
+    }
+
+    file_vector<int64_t> col("bench_cold");
+    col.clear();
+    col.close();
+}
+
+//----------------------------------------------------------------------------
+// Ingest: sustained appends through the mapping, which leaves writeback to
+// the kernel, and through ingest_file_vector's write-behind thread. The
+// latency of every batch of appends is recorded to show the tail.
+
+void bench_ingest() {
+    size_t const size = size_t(1) << 27;
+    size_t const batch = 1024;
+
+    double const gb = size * sizeof(int64_t) / 1e9;
+    cout << "ingest of " << gb << " GB, latency per " << batch << " appends" << endl;
+
+    auto const report = [gb](string const& path, double const ms, vector<double>& latency) {
+        sort(latency.begin(), latency.end());
+        auto const at = [&latency](double const q) {
+            return latency[static_cast<size_t>(q * (latency.size() - 1))];
+        };
+        cout << "  " << path << " " << ms << " ms, " << gb / (ms / 1000.0) << " GB/s"
+            << "  p50 " << at(0.5) << " us  p99 " << at(0.99) << " us  p99.9 " << at(0.999)
+            << " us  max " << latency.back() << " us" << endl;
+    };
+
+    auto const timed_batches = [size, batch](vector<double>& latency, auto push) {
+        latency.reserve(size / batch);
+        for (size_t i = 0; i < size; i += batch) {
+            auto const start = chrono::steady_clock::now();
+            for (size_t j = i; j < i + batch; ++j) {
+                push(static_cast<int64_t>(j));
+            }
+            auto const stop = chrono::steady_clock::now();
+            latency.push_back(chrono::duration<double, micro>(stop - start).count());
+        }
+    };
+
+    {
+        file_vector<int64_t> col("bench_ingest", fv_int::create_file);
+        col.clear();
+        col.close();
+    }
+    vector<double> mapped_latency;
+    double const mapped_ms = time_ms([&mapped_latency, &timed_batches] {
+        file_vector<int64_t> col("bench_ingest");
+        timed_batches(mapped_latency, [&col](int64_t const x) {
+            col.push_back(x);
+        });
+        col.close();
+        drop_cache("bench_ingest");
+    });
+    report("mmap", mapped_ms, mapped_latency);
+
+    for (bool const direct : {false, true}) {
+        {
+            file_vector<int64_t> col("bench_ingest");
+            col.clear();
+            col.close();
+        }
+        vector<double> ingest_latency;
+        double const ingest_ms = time_ms([&ingest_latency, &timed_batches, direct] {
+            ingest_options options;
+            options.direct = direct;
+            ingest_file_vector<int64_t> col("bench_ingest", 0, options);
+            timed_batches(ingest_latency, [&col](int64_t const x) {
+                col.push_back(x);
+            });
+            col.close();
+            drop_cache("bench_ingest");
+        });
+        report(string("ingest ") + (direct ? "direct" : "buffered"), ingest_ms, ingest_latency);
+    }
+
+    file_vector<int64_t> col("bench_ingest");
+    bool const ok = col.size() == size && col.data()[size - 1] == int64_t(size - 1);
+    col.clear();
+    col.close();
+    if (!ok) {
+        cout << "  (MISMATCH)" << endl;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Coroutine scans: sum several cold columns on one thread, one after the
+// other through the mapping, and interleaved as page_scheduler tasks that
+// only touch resident chunks.
+
+task<void> sum_column(file_vector<int64_t> const& col, int64_t& total) {
+    int64_t sum = 0;
+    auto chunks = scan_chunks(col, 1 << 16, 32);
+    while (auto const c = co_await chunks.next()) {
+        for (size_t i = 0; i < c->size; ++i) {
+            sum += c->values[i];
+        }
+    }
+    total = sum;
+}
+
+void bench_coroutine_scan() {
+    size_t const size = size_t(1) << 24;
+    size_t const columns = 4;
+
+    for (size_t k = 0; k < columns; ++k) {
+        file_vector<int64_t> col("bench_coro_" + to_string(k), fv_int::create_file);
+        col.clear();
+        col.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            col.push_back(i);
+        }
+        col.close();
+    }
+
+    auto const drop_all = [columns] {
+        for (size_t k = 0; k < columns; ++k) {
+            drop_cache("bench_coro_" + to_string(k));
+        }
+    };
+    int64_t const expected = columns * (int64_t(size) * int64_t(size - 1) / 2);
+    cout << "scan " << columns << " cold columns of " << size << " on one thread" << endl;
+
+    drop_all();
+    int64_t mapped_sum = 0;
+    double const mapped_ms = time_ms([&mapped_sum, columns] {
+        for (size_t k = 0; k < columns; ++k) {
+            file_vector<int64_t> col("bench_coro_" + to_string(k));
+            int64_t const* const v = col.data();
+            for (size_t i = 0; i < col.size(); ++i) {
+                mapped_sum += v[i];
+            }
+        }
+    });
+    cout << "  mmap, one column at a time " << mapped_ms << " ms"
+        << ((mapped_sum == expected) ? "" : " (MISMATCH)") << endl;
+
+    drop_all();
+    int64_t coro_sum = 0;
+    size_t waited = 0;
+    double const coro_ms = time_ms([&coro_sum, &waited, columns] {
+        vector<unique_ptr<file_vector<int64_t>>> cols;
+        vector<int64_t> sums(columns, 0);
+        page_scheduler scheduler;
+        for (size_t k = 0; k < columns; ++k) {
+            cols.emplace_back(new file_vector<int64_t>("bench_coro_" + to_string(k)));
+            scheduler.spawn(sum_column(*cols.back(), sums[k]));
+        }
+        scheduler.run();
+        for (int64_t const s : sums) {
+            coro_sum += s;
+        }
+        waited = scheduler.waited();
+    });
+    cout << "  page_scheduler, interleaved " << coro_ms << " ms, " << waited << " waits"
+        << ((coro_sum == expected) ? "" : " (MISMATCH)") << endl;
+
+    for (size_t k = 0; k < columns; ++k) {
+        file_vector<int64_t> col("bench_coro_" + to_string(k));
+        col.clear();
+        col.close();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Warming: load a cold column into the page-cache with warm, with
+// different numbers of threads.
+
+void bench_warm() {
+    size_t const size = size_t(1) << 27;
+
+    {
+        file_vector<int64_t> col("bench_warm", fv_int::create_file);
+        col.clear();
+        col.resize(size, 1);
+        col.close();
+    }
+
+    double const gb = size * sizeof(int64_t) / 1e9;
+    cout << "warm " << gb << " GB cold column" << endl;
+    for (unsigned const threads : {1u, 4u, 16u}) {
+        drop_cache("bench_warm");
+        file_vector<int64_t> col("bench_warm");
+        double const before = col.resident_ratio();
+        size_t missing = 0;
+        double const ms = time_ms([&col, &missing, threads] {
+            missing = col.warm(threads);
+        });
+        cout << "  " << threads << " threads " << ms << " ms, " << gb / (ms / 1000.0) << " GB/s"
+            << ", resident " << before << " -> " << col.resident_ratio()
+            << ", " << missing << " pages" << endl;
+    }
+
+    file_vector<int64_t> col("bench_warm");
+    col.clear();
+    col.close();
+}
+
+//----------------------------------------------------------------------------
+// Snapshots: take a snapshot of a column, then overwrite the column while
+// summing the snapshot. Taking it is flat with a reflink, and grows with the
+// column when the file-system needs a copy.
+
+void bench_snapshot() {
+    for (size_t const size : {size_t(1) << 20, size_t(1) << 23, size_t(1) << 25}) {
+        file_vector<int64_t> col("bench_snapshot", fv_int::create_file);
+        col.clear();
+        col.resize(size, 1);
+
+        file_vector_snapshot<int64_t> snap;
+        double const take_ms = time_ms([&col, &snap] {
+            snap = col.snapshot();
+        });
+        int64_t sum = 0;
+        double const scan_ms = time_ms([&col, &snap, &sum] {
+            int64_t s = 0;
+            for (size_t i = 0; i < snap.size(); ++i) {
+                col[i] = 2;
+                s += snap[i];
+            }
+            sum = s;
+        });
+        if (sum != static_cast<int64_t>(size)) {
+            cout << "snapshot changed" << endl;
+        }
+        cout << "snapshot " << size * sizeof(int64_t) / 1e6 << " MB "
+            << (snap.cloned() ? "cloned " : "copied ") << take_ms << " ms"
+            << ", scan while overwriting " << scan_ms << " ms" << endl;
+        col.clear();
+        col.close();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Checksums: CRC32C throughput, and scrubbing a column with different
+// numbers of threads.
+
+void bench_checksums() {
+    size_t const size = size_t(1) << 25;
+    vector<int64_t> const rows(size, 1);
+    double const gb = size * sizeof(int64_t) / 1e9;
+
+    uint32_t crc = 0;
+    double const crc_ms = time_ms([&rows, &crc] {
+        crc = crc32c(0, rows.data(), rows.size() * sizeof(int64_t));
+    });
+    cout << "crc32c " << gb / (crc_ms / 1000.0) << " GB/s (" << crc << ")" << endl;
+
+    {
+        checksummed_file_vector<int64_t> col("bench_checksums", fv_int::create_file);
+        col.clear();
+        double const ms = time_ms([&col, &rows] {
+            col.append(rows.cbegin(), rows.cend());
+        });
+        cout << "checksummed append " << gb << " GB " << ms << " ms" << endl;
+    }
+    for (unsigned const threads : {1u, 4u, 16u}) {
+        checksummed_file_vector<int64_t> col("bench_checksums");
+        size_t bad = 0;
+        double const ms = time_ms([&col, &bad, threads] {
+            bad = col.scrub(threads).size();
+        });
+        cout << "  scrub " << threads << " threads " << ms << " ms, "
+            << gb / (ms / 1000.0) << " GB/s, " << bad << " bad blocks" << endl;
+    }
+
+    checksummed_file_vector<int64_t> col("bench_checksums");
+    col.clear();
+    col.close();
+}
+
+//----------------------------------------------------------------------------
+// Persistent arena: build and look up standard containers allocated from an
+// arena, against the same containers on the heap.
+
+template <typename Map, typename Alloc>
+void bench_map_build_lookup(string const& label, Alloc const& alloc, vector<int64_t> const& keys) {
+    Map map(0, hash<int64_t>(), equal_to<int64_t>(), alloc);
+    double const build_ms = time_ms([&map, &keys] {
+        for (int64_t const k : keys) {
+            map[k] = k;
+        }
+    });
+    int64_t found = 0;
+    double const lookup_ms = time_ms([&map, &keys, &found] {
+        int64_t f = 0;
+        for (int64_t const k : keys) {
+            f += map.find(k ^ 1)->second;
+        }
+        found = f;
+    });
+    cout << "  unordered_map " << label << " build " << build_ms << " ms, lookup " << lookup_ms
+        << " ms (" << found << ")" << endl;
+}
+
+void bench_arena() {
+    size_t const n = size_t(1) << 20;
+    cout << "arena " << n << " keys" << endl;
+
+    unlink("bench_arena");
+    persistent_arena arena("bench_arena", persistent_arena::create_file);
+
+    double const heap_vector_ms = time_ms([n] {
+        vector<int64_t> v;
+        for (size_t i = 0; i < 4 * n; ++i) {
+            v.push_back(i);
+        }
+    });
+    double const arena_vector_ms = time_ms([n, &arena] {
+        vector<int64_t, arena_allocator<int64_t>> v {arena_allocator<int64_t>(arena)};
+        for (size_t i = 0; i < 4 * n; ++i) {
+            v.push_back(i);
+        }
+    });
+    cout << "  vector push_back heap " << heap_vector_ms << " ms, arena " << arena_vector_ms << " ms" << endl;
+
+    vector<int64_t> keys(n);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(7));
+
+    using pair_type = pair<int64_t const, int64_t>;
+    bench_map_build_lookup<unordered_map<int64_t, int64_t>>("heap", allocator<pair_type>(), keys);
+    bench_map_build_lookup<unordered_map<int64_t, int64_t, hash<int64_t>, equal_to<int64_t>, arena_allocator<pair_type>>>(
+        "arena", arena_allocator<pair_type>(arena), keys
+    );
+    cout << "  arena file " << arena.capacity() / 1e6 << " MB" << endl;
+
+    arena.close();
+    unlink("bench_arena");
+}
+
+//----------------------------------------------------------------------------
+// Hash index: build and look up order ids in a persistent_hash_index and an
+// unordered_map, and compare opening the index against rebuilding the map.
+
+void bench_hash_index() {
+    size_t const n = size_t(1) << 22;
+    cout << "hash index " << n << " keys" << endl;
+
+    file_vector<int64_t> orders("bench_index_orders", fv_int::create_file);
+    orders.clear();
+    mt19937_64 gen(11);
+    for (size_t i = 0; i < n; ++i) {
+        orders.push_back(gen());
+    }
+    vector<int64_t> probes(orders.cbegin(), orders.cend());
+    shuffle(probes.begin(), probes.end(), mt19937(3));
+
+    unordered_map<int64_t, uint64_t> map;
+    double const map_build_ms = time_ms([&map, &orders] {
+        for (size_t i = 0; i < orders.size(); ++i) {
+            map[orders[i]] = i;
+        }
+    });
+    uint64_t map_sum = 0;
+    double const map_lookup_ms = time_ms([&map, &probes, &map_sum] {
+        uint64_t s = 0;
+        for (int64_t const k : probes) {
+            s += map.find(k)->second;
+        }
+        map_sum = s;
+    });
+
+    double index_build_ms = 0;
+    {
+        persistent_hash_index<int64_t> index("bench_index", persistent_hash_index<int64_t>::create_file);
+        index.clear();
+        index_build_ms = time_ms([&index, &orders] {
+            index.update(orders);
+        });
+        index.close();
+    }
+
+    unique_ptr<persistent_hash_index<int64_t>> index;
+    double const open_ms = time_ms([&index] {
+        index.reset(new persistent_hash_index<int64_t>("bench_index"));
+    });
+    uint64_t index_sum = 0;
+    double const index_lookup_ms = time_ms([&index, &probes, &index_sum] {
+        uint64_t s = 0;
+        for (int64_t const k : probes) {
+            s += *index->find(k);
+        }
+        index_sum = s;
+    });
+
+    cout << "  unordered_map build " << map_build_ms << " ms, lookup " << map_lookup_ms << " ms" << endl;
+    cout << "  persistent_hash_index build " << index_build_ms << " ms, open " << open_ms
+        << " ms, lookup " << index_lookup_ms << " ms" << (index_sum == map_sum ? "" : " (MISMATCH)") << endl;
+
+    index->clear();
+    index->close();
+    orders.clear();
+    orders.close();
+}
+
+//----------------------------------------------------------------------------
+// External sort: scaling with the size of the column and the number of
+// threads, for a fixed memory budget, against std::sort through the
+// mapping; and sorting large records directly, against sorting their keys.
+
+void bench_external_sort() {
+    sort_options options;
+    options.memory_bytes = size_t(64) << 20;
+
+    for (size_t const size : {size_t(1) << 22, size_t(1) << 24, size_t(1) << 26}) {
+        {
+            file_vector<int64_t> col("bench_sort", fv_int::create_file);
+            col.clear();
+            mt19937_64 gen(size);
+            for (size_t i = 0; i < size; ++i) {
+                col.push_back(gen());
+            }
+        }
+        double const mb = size * sizeof(int64_t) / 1e6;
+        cout << "external sort " << mb << " MB, " << options.memory_bytes / (1 << 20) << " MB budget" << endl;
+        for (unsigned const threads : {1u, 2u, 4u}) {
+            options.threads = threads;
+            drop_cache("bench_sort");
+            file_vector<int64_t> const col("bench_sort");
+            size_t runs = 0;
+            double const ms = time_ms([&col, &options, &runs] {
+                runs = external_sort(col, "bench_sort_out", less<int64_t>(), options);
+            });
+            cout << "  " << threads << " threads " << ms << " ms, " << mb / (ms / 1000) << " MB/s, "
+                << runs << " runs" << endl;
+        }
+
+        drop_cache("bench_sort");
+        file_vector<int64_t> col("bench_sort");
+        double const ms = time_ms([&col] {
+            sort(col.begin(), col.end());
+        });
+        cout << "  std::sort through the mapping " << ms << " ms" << endl;
+        col.clear();
+    }
+
+    struct record {
+        int64_t key;
+        char payload[120];
+    };
+    size_t const records = size_t(1) << 21;
+    {
+        file_vector<record> col("bench_sort", fv_int::create_file);
+        col.clear();
+        mt19937_64 gen(5);
+        for (size_t i = 0; i < records; ++i) {
+            col.push_back(record {static_cast<int64_t>(gen()), {}});
+        }
+    }
+    options.threads = 4;
+    file_vector<record> col("bench_sort");
+    double const full_ms = time_ms([&col, &options] {
+        external_sort(col, "bench_sort_out", [](record const& a, record const& b) {
+            return a.key < b.key;
+        }, options);
+    });
+    double const index_ms = time_ms([&col, &options] {
+        external_sort_index(col, [](record const& r) {
+            return r.key;
+        }, "bench_sort_out", options);
+    });
+    cout << "external sort " << records * sizeof(record) / 1e6 << " MB of 128 byte records: full "
+        << full_ms << " ms, index " << index_ms << " ms" << endl;
+    col.clear();
+    col.close();
+    unlink("bench_sort");
+    unlink("bench_sort_out");
+}
+
+//----------------------------------------------------------------------------
+// Joins at several sizes: a key to foreign key equi-join, with four
+// references to each key, as a radix hash join on 1 and 4 threads against
+// an unordered_multimap, and as a merge join of the sorted columns; and an
+// as-of join of sorted timestamps, four quotes to a trade.
+
+void bench_joins() {
+    for (size_t const n : {size_t(1) << 18, size_t(1) << 20, size_t(1) << 22}) {
+        mt19937_64 gen(n);
+        file_vector<int64_t> ids("bench_join_ids", fv_int::create_file);
+        file_vector<int64_t> refs("bench_join_refs", fv_int::create_file);
+        file_vector<uint64_t> left("bench_join_left", fv_int::create_file);
+        file_vector<uint64_t> right("bench_join_right", fv_int::create_file);
+        ids.clear();
+        refs.clear();
+        vector<int64_t> keys(n);
+        iota(keys.begin(), keys.end(), 0);
+        shuffle(keys.begin(), keys.end(), gen);
+        ids.assign(keys.cbegin(), keys.cend());
+        for (size_t i = 0; i < 4 * n; ++i) {
+            refs.push_back(keys[gen() % n]);
+        }
+        double const rows = (ids.size() + refs.size()) / 1e6;
+        cout << "joins " << n << " keys, " << 4 * n << " references" << endl;
+
+        size_t map_pairs = 0;
+        double const map_ms = time_ms([&ids, &refs, &left, &right, &map_pairs] {
+            left.clear();
+            right.clear();
+            unordered_multimap<int64_t, uint64_t> rows_of;
+            rows_of.reserve(ids.size());
+            for (size_t i = 0; i < ids.size(); ++i) {
+                rows_of.emplace(ids[i], i);
+            }
+            for (size_t j = 0; j < refs.size(); ++j) {
+                auto const range = rows_of.equal_range(refs[j]);
+                for (auto k = range.first; k != range.second; ++k) {
+                    left.push_back(k->second);
+                    right.push_back(j);
+                    ++map_pairs;
+                }
+            }
+        });
+        cout << "  unordered_multimap " << map_ms << " ms, " << rows / (map_ms / 1000) << " M rows/s" << endl;
+
+        join_options options;
+        for (unsigned const threads : {1u, 4u}) {
+            options.threads = threads;
+            size_t pairs = 0;
+            double const ms = time_ms([&ids, &refs, &left, &right, &options, &pairs] {
+                left.clear();
+                right.clear();
+                pairs = hash_join(ids, refs, left, right, options);
+            });
+            cout << "  hash_join " << threads << " threads " << ms << " ms, " << rows / (ms / 1000) << " M rows/s"
+                << (pairs == map_pairs ? "" : " (MISMATCH)") << endl;
+        }
+
+        sort(ids.begin(), ids.end());
+        sort(refs.begin(), refs.end());
+        size_t merged = 0;
+        double const merge_ms = time_ms([&ids, &refs, &left, &right, &merged] {
+            left.clear();
+            right.clear();
+            merged = merge_join(ids, refs, left, right);
+        });
+        cout << "  merge_join of sorted columns " << merge_ms << " ms, " << rows / (merge_ms / 1000) << " M rows/s"
+            << (merged == map_pairs ? "" : " (MISMATCH)") << endl;
+
+        // Trades and quotes a few microseconds apart.
+        file_vector<int64_t>& trades = ids;
+        file_vector<int64_t>& quotes = refs;
+        int64_t t = 0;
+        for (int64_t& q : quotes) {
+            q = t += 1 + gen() % 8;
+        }
+        t = 0;
+        for (int64_t& x : trades) {
+            x = t += 1 + gen() % 32;
+        }
+        double const asof_ms = time_ms([&trades, &quotes, &left, &right] {
+            left.clear();
+            right.clear();
+            asof_join(trades, quotes, left, right);
+        });
+        cout << "  asof_join " << asof_ms << " ms, " << rows / (asof_ms / 1000) << " M rows/s" << endl;
+
+        for (file_vector<int64_t>* col : {&ids, &refs}) {
+            col->clear();
+            col->close();
+        }
+        for (file_vector<uint64_t>* col : {&left, &right}) {
+            col->clear();
+            col->close();
+        }
+    }
+    for (char const* name : {"bench_join_ids", "bench_join_refs", "bench_join_left", "bench_join_right"}) {
+        unlink(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Group-by of 16M trades on 1, 2 and 4 threads, against an unordered_map:
+// by symbol and minute (hashed), by symbol (dense), by minute (sorted),
+// and by order id, with a group for every four rows (hashed).
+
+void bench_group_by() {
+    struct trade {
+        int32_t symbol;
+        int32_t order;
+        int64_t time;
+        double price;
+    };
+    size_t const n = size_t(1) << 24;
+    file_vector<trade> trades("bench_group", fv_int::create_file);
+    trades.clear();
+    mt19937_64 gen(48);
+    for (size_t i = 0; i < n; ++i) {
+        trades.push_back(trade {
+            static_cast<int32_t>(gen() % 1000), static_cast<int32_t>(gen() % (n / 4)),
+            static_cast<int64_t>(i) * 20, static_cast<double>(gen() % 10000)
+        });
+    }
+    double const mrows = n / 1e6;
+    cout << "group by " << n << " trades" << endl;
+
+    auto const price = [](trade const& t) {
+        return t.price;
+    };
+    auto const run = [&trades, mrows, &price](char const* name, auto key) {
+        using K = decltype(key(trades[0]));
+        unordered_map<K, group_aggregate<double>> map;
+        double const map_ms = time_ms([&trades, &map, &key] {
+            for (trade const& t : trades) {
+                auto const g = map.find(key(t));
+                if (g == map.end()) {
+                    map.emplace(key(t), group_aggregate<double>::of(t.price));
+                } else {
+                    g->second.add(t.price);
+                }
+            }
+        });
+        cout << "  " << name << ", " << map.size() << " groups: unordered_map " << map_ms << " ms, "
+            << mrows / (map_ms / 1000) << " M rows/s" << endl;
+
+        group_options options;
+        for (unsigned const threads : {1u, 2u, 4u}) {
+            options.threads = threads;
+            file_vector<K> keys("bench_group.keys", fv_int::create_file);
+            file_vector<group_aggregate<double>> groups("bench_group.aggregates", fv_int::create_file);
+            keys.clear();
+            groups.clear();
+            size_t count = 0;
+            double const ms = time_ms([&] {
+                count = group_by(trades, key, price, keys, groups, options);
+            });
+            cout << "    group_by " << threads << " threads " << ms << " ms, " << mrows / (ms / 1000) << " M rows/s"
+                << (count == map.size() ? "" : " (MISMATCH)") << endl;
+            keys.clear();
+            groups.clear();
+        }
+    };
+
+    run("symbol and minute", [](trade const& t) {
+        return (static_cast<uint64_t>(t.symbol) << 32) | static_cast<uint64_t>(t.time / 60000);
+    });
+    run("symbol", [](trade const& t) {
+        return t.symbol;
+    });
+    run("minute", [](trade const& t) {
+        return t.time / 60000;
+    });
+    run("order", [](trade const& t) {
+        return t.order;
+    });
+
+    trades.clear();
+    trades.close();
+    for (char const* name : {"bench_group", "bench_group.keys", "bench_group.aggregates"}) {
+        unlink(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Rollups of 16M ticks into 1 minute and 1 hour OHLC bars: the cost of
+// keeping them up to date on push_back and bulk append, against plain
+// columns; a rebuild on 1 and 4 threads; and reading the minute bars,
+// against computing them with a scan of the ticks.
+
+void bench_rollup() {
+    using ticks = rollup_file_vector<int64_t, double>;
+    size_t const n = size_t(1) << 24;
+    vector<int64_t> times(n);
+    vector<double> prices(n);
+    mt19937_64 gen(49);
+    int64_t t = 0;
+    for (size_t i = 0; i < n; ++i) {
+        times[i] = t += gen() % 20;
+        prices[i] = 100 + static_cast<double>(gen() % 1000) / 100;
+    }
+    cout << "rollup " << n << " ticks" << endl;
+    for (char const* name : {"bench_ticks.rollup.60000", "bench_ticks.rollup.3600000"}) {
+        unlink(name);
+    }
+
+    double const plain_ms = time_ms([&times, &prices, n] {
+        file_vector<int64_t> time_col("bench_plain", fv_int::create_file);
+        file_vector<double> price_col("bench_plain.values", fv_int::create_file);
+        time_col.clear();
+        price_col.clear();
+        for (size_t i = 0; i < n; ++i) {
+            time_col.push_back(times[i]);
+            price_col.push_back(prices[i]);
+        }
+        time_col.clear();
+        price_col.clear();
+    });
+    double const push_ms = time_ms([&times, &prices, n] {
+        ticks col("bench_ticks", {60000, 3600000}, ticks::create_file);
+        col.clear();
+        for (size_t i = 0; i < n; ++i) {
+            col.push_back(times[i], prices[i]);
+        }
+    });
+    cout << "  push_back: plain columns " << plain_ms << " ms, with rollups " << push_ms << " ms" << endl;
+
+    double const append_ms = time_ms([&times, &prices, n] {
+        ticks col("bench_ticks", {60000, 3600000}, ticks::create_file);
+        col.clear();
+        size_t const batch = size_t(1) << 20;
+        for (size_t i = 0; i < n; i += batch) {
+            col.append(times.cbegin() + i, times.cbegin() + i + batch, prices.cbegin() + i);
+        }
+    });
+    cout << "  append of 1M row batches with rollups " << append_ms << " ms" << endl;
+
+    ticks col("bench_ticks", {60000, 3600000});
+    for (unsigned const threads : {1u, 4u}) {
+        rollup<int64_t, double> minutes("bench_ticks.rebuilt", 60000, fv_int::create_file);
+        double const ms = time_ms([&minutes, &col, threads] {
+            minutes.rebuild(col.time_column(), col.value_column(), threads);
+        });
+        cout << "  rebuild of minute bars, " << threads << " threads " << ms << " ms" << endl;
+        minutes.clear();
+        minutes.close();
+    }
+
+    auto const& bars = col.bars(60000);
+    double high_sum = 0;
+    double const read_ms = time_ms([&bars, &high_sum] {
+        double h = 0;
+        for (auto const& bar : bars) {
+            h += bar.aggregate.high;
+        }
+        high_sum = h;
+    });
+    double scan_high_sum = 0;
+    double const scan_ms = time_ms([&col, &scan_high_sum] {
+        file_vector<int64_t> const& time_col = col.time_column();
+        file_vector<double> const& price_col = col.value_column();
+        double h = 0;
+        int64_t minute = time_col[0] / 60000;
+        double high = price_col[0];
+        for (size_t i = 1; i < time_col.size(); ++i) {
+            if (time_col[i] / 60000 != minute) {
+                h += high;
+                minute = time_col[i] / 60000;
+                high = price_col[i];
+            } else {
+                high = max(high, price_col[i]);
+            }
+        }
+        scan_high_sum = h + high;
+    });
+    cout << "  " << bars.size() << " minute bars: read " << read_ms << " ms, scan of ticks " << scan_ms << " ms"
+        << (high_sum == scan_high_sum ? "" : " (MISMATCH)") << endl;
+
+    col.clear();
+    col.close();
+    for (char const* name : {
+        "bench_plain", "bench_plain.values", "bench_ticks", "bench_ticks.values",
+        "bench_ticks.rollup.60000", "bench_ticks.rollup.3600000", "bench_ticks.rebuilt"
+    }) {
+        unlink(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Running sums of 32M doubles: a rebuild on 1 and 4 threads, against
+// std::partial_sum; and sums of random windows, and a VWAP over random
+// time windows, from the running sums against scans of the rows.
+
+void bench_prefix_sum() {
+    size_t const n = size_t(1) << 25;
+    file_vector<int64_t> times("bench_sums.times", fv_int::create_file);
+    file_vector<double> prices("bench_sums.prices", fv_int::create_file);
+    file_vector<double> sizes("bench_sums.sizes", fv_int::create_file);
+    file_vector<double> notionals("bench_sums.notionals", fv_int::create_file);
+    for (file_vector<double>* col : {&prices, &sizes, &notionals}) {
+        col->clear();
+    }
+    times.clear();
+    mt19937_64 gen(50);
+    int64_t t = 0;
+    for (size_t i = 0; i < n; ++i) {
+        times.push_back(t += gen() % 20);
+        prices.push_back(100 + static_cast<double>(gen() % 1000) / 100);
+        sizes.push_back(static_cast<double>(1 + gen() % 500));
+        notionals.push_back(prices.back() * sizes.back());
+    }
+    cout << "prefix sums of " << n << " doubles" << endl;
+
+    vector<double> partial(n);
+    double const partial_ms = time_ms([&prices, &partial] {
+        partial_sum(prices.cbegin(), prices.cend(), partial.begin());
+    });
+    cout << "  std::partial_sum " << partial_ms << " ms" << endl;
+    partial = vector<double>();
+    // The first rebuild also allocates the file.
+    for (unsigned const threads : {1u, 1u, 4u}) {
+        prefix_sum<double> sums("bench_sums.prices.sums", fv_int::create_file);
+        double const ms = time_ms([&sums, &prices, threads] {
+            sums.rebuild(prices, threads);
+        });
+        cout << "  rebuild, " << threads << " threads " << ms << " ms" << endl;
+    }
+
+    prefix_sum<double> price_sums("bench_sums.prices.sums", fv_int::create_file);
+    prefix_sum<double> size_sums("bench_sums.sizes.sums", fv_int::create_file);
+    prefix_sum<double> notional_sums("bench_sums.notionals.sums", fv_int::create_file);
+    price_sums.rebuild(prices);
+    size_sums.rebuild(sizes);
+    notional_sums.rebuild(notionals);
+
+    size_t const windows = 10000;
+    vector<pair<size_t, size_t>> rows(windows);
+    for (auto& w : rows) {
+        w.first = gen() % n;
+        w.second = min(n, w.first + gen() % (size_t(1) << 20));
+    }
+    double scan_total = 0;
+    double const scan_ms = time_ms([&prices, &rows, &scan_total] {
+        double total = 0;
+        for (auto const& w : rows) {
+            total += accumulate(prices.cbegin() + w.first, prices.cbegin() + w.second, 0.0);
+        }
+        scan_total = total;
+    });
+    double sums_total = 0;
+    double const sums_ms = time_ms([&price_sums, &rows, &sums_total] {
+        double total = 0;
+        for (auto const& w : rows) {
+            total += price_sums.sum(w.first, w.second);
+        }
+        sums_total = total;
+    });
+    cout << "  " << windows << " window sums of up to 1M rows: scan " << scan_ms << " ms, running sums "
+        << sums_ms << " ms, relative difference " << abs(sums_total - scan_total) / scan_total << endl;
+
+    vector<pair<int64_t, int64_t>> periods(windows);
+    for (auto& p : periods) {
+        p.first = static_cast<int64_t>(gen() % static_cast<uint64_t>(t));
+        p.second = p.first + static_cast<int64_t>(gen() % 10000000);
+    }
+    auto const rows_of = [&times](pair<int64_t, int64_t> const& p) {
+        return make_pair(
+            lower_bound(times.cbegin(), times.cend(), p.first) - times.cbegin(),
+            lower_bound(times.cbegin(), times.cend(), p.second) - times.cbegin()
+        );
+    };
+    double scan_vwap = 0;
+    double const scan_vwap_ms = time_ms([&periods, &rows_of, &prices, &sizes, &scan_vwap] {
+        double total = 0;
+        for (auto const& p : periods) {
+            auto const r = rows_of(p);
+            double notional = 0;
+            double volume = 0;
+            for (auto i = r.first; i < r.second; ++i) {
+                notional += prices[i] * sizes[i];
+                volume += sizes[i];
+            }
+            total += (volume > 0) ? notional / volume : 0;
+        }
+        scan_vwap = total;
+    });
+    double sums_vwap = 0;
+    double const sums_vwap_ms = time_ms([&periods, &rows_of, &notional_sums, &size_sums, &sums_vwap] {
+        double total = 0;
+        for (auto const& p : periods) {
+            auto const r = rows_of(p);
+            double const volume = size_sums.sum(r.first, r.second);
+            total += (volume > 0) ? notional_sums.sum(r.first, r.second) / volume : 0;
+        }
+        sums_vwap = total;
+    });
+    cout << "  " << windows << " VWAPs over time windows: scan " << scan_vwap_ms << " ms, running sums "
+        << sums_vwap_ms << " ms, relative difference " << abs(sums_vwap - scan_vwap) / scan_vwap << endl;
+
+    for (prefix_sum<double>* sums : {&price_sums, &size_sums, &notional_sums}) {
+        sums->clear();
+        sums->close();
+    }
+    for (file_vector<double>* col : {&prices, &sizes, &notionals}) {
+        col->clear();
+        col->close();
+    }
+    times.clear();
+    times.close();
+    for (char const* name : {
+        "bench_sums.times", "bench_sums.prices", "bench_sums.sizes", "bench_sums.notionals",
+        "bench_sums.prices.sums", "bench_sums.sizes.sums", "bench_sums.notionals.sums"
+    }) {
+        unlink(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Microbenchmarks, in the manner of google-benchmark. Each benchmark runs
+// its operation 'state.iterations()' times, with the count raised until a
+// run takes at least 'min_ms', and reports the time per operation (and
+// bytes per second, where set). Set up can be left out of the timing with
+// pause and resume.
+
+class micro_state {
+    size_t const n;
+    chrono::steady_clock::time_point start;
+    chrono::nanoseconds elapsed;
+    bool running;
+
+public:
+    size_t bytes;
+
+    explicit micro_state(size_t const n)
+    : n(n), start(chrono::steady_clock::now()), elapsed(0), running(true), bytes(0) {}
+
+    size_t iterations() const {
+        return n;
+    }
+
+    void pause() {
+        if (running) {
+            elapsed += chrono::steady_clock::now() - start;
+            running = false;
+        }
+    }
+
+    void resume() {
+        if (!running) {
+            start = chrono::steady_clock::now();
+            running = true;
+        }
+    }
+
+    double ns() {
+        pause();
+        return static_cast<double>(elapsed.count());
+    }
+};
+
+struct micro_result {
+    string name;
+    size_t iterations;
+    double ns_per_op;
+    double bytes_per_second;
+};
+
+class micro_suite {
+    string const filter;
+    double const min_ms;
+    size_t const max_iterations;
+    vector<micro_result> results;
+
+public:
+    micro_suite(string const& filter, double const min_ms = 200, size_t const max_iterations = size_t(1) << 26)
+    : filter(filter), min_ms(min_ms), max_iterations(max_iterations) {}
+
+    void run(string const& name, function<void(micro_state&)> const& f, size_t const limit = 0) {
+        if (name.find(filter) == string::npos) {
+            return;
+        }
+        size_t const most = (limit == 0) ? max_iterations : limit;
+        size_t n = 1;
+        for (;;) {
+            micro_state state(n);
+            f(state);
+            double const ns = state.ns();
+            if (ns >= min_ms * 1e6 || n >= most) {
+                micro_result const r {name, n, ns / n, (state.bytes == 0) ? 0.0 : state.bytes / (ns / 1e9)};
+                cout << "  " << name << " " << r.ns_per_op << " ns/op, " << n << " iterations";
+                if (r.bytes_per_second > 0) {
+                    cout << ", " << r.bytes_per_second / 1e9 << " GB/s";
+                }
+                cout << endl;
+                results.push_back(r);
+                return;
+            }
+            // Aim past the minimum, growing at most tenfold per run.
+            double const scale = (ns <= 0) ? 10.0 : min(10.0, 1.4 * min_ms * 1e6 / ns);
+            n = min(most, max(n + 1, static_cast<size_t>(n * scale)));
+        }
+    }
+
+    void write_json(string const& path) const {
+        ofstream out(path);
+        time_t const now = time(nullptr);
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+        out << "{\n  \"context\": {\"date\": \"" << date << "\", \"num_cpus\": "
+            << thread::hardware_concurrency() << "},\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            micro_result const& r = results[i];
+            out << ((i == 0) ? "\n" : ",\n") << "    {\"name\": \"" << r.name
+                << "\", \"iterations\": " << r.iterations
+                << ", \"real_time\": " << r.ns_per_op << ", \"time_unit\": \"ns\"";
+            if (r.bytes_per_second > 0) {
+                out << ", \"bytes_per_second\": " << r.bytes_per_second;
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+        if (!out) {
+            throw runtime_error("Unable to write benchmark results.");
+        }
+    }
+};
+
+// The operations of file_vector, with std::vector for comparison.
+void micro_benchmarks(micro_suite& suite) {
+    using fv = file_vector<int64_t>;
+    size_t const scan_size = size_t(1) << 22;
+    size_t const middle_size = size_t(1) << 16;
+    size_t const bulk = size_t(1) << 16;
+
+    cout << "microbenchmarks" << endl;
+
+    suite.run("push_back/file_vector", [](micro_state& state) {
+        state.pause();
+        fv col("bench_micro", fv::create_file);
+        col.clear();
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.push_back(i);
+        }
+        state.pause();
+        col.clear();
+    });
+
+    suite.run("push_back/std::vector", [](micro_state& state) {
+        vector<int64_t> col;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.push_back(i);
+        }
+    });
+
+    vector<int64_t> block(bulk);
+    iota(block.begin(), block.end(), 0);
+    suite.run("append_bulk/file_vector", [&block](micro_state& state) {
+        state.pause();
+        fv col("bench_micro", fv::create_file);
+        col.clear();
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.insert(col.cend(), block.cbegin(), block.cend());
+        }
+        state.pause();
+        state.bytes = state.iterations() * block.size() * sizeof(int64_t);
+        col.clear();
+    }, 4096);
+
+    suite.run("append_bulk/std::vector", [&block](micro_state& state) {
+        vector<int64_t> col;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.insert(col.cend(), block.cbegin(), block.cend());
+        }
+        state.bytes = state.iterations() * block.size() * sizeof(int64_t);
+    }, 4096);
+
+    suite.run("append_bulk/checksummed_file_vector", [&block](micro_state& state) {
+        state.pause();
+        checksummed_file_vector<int64_t> col("bench_micro_checked", fv::create_file);
+        col.clear();
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.append(block.cbegin(), block.cend());
+        }
+        state.pause();
+        state.bytes = state.iterations() * block.size() * sizeof(int64_t);
+        col.clear();
+    }, 4096);
+
+    {
+        fv col("bench_micro", fv::create_file);
+        col.clear();
+        col.resize(scan_size, 1);
+    }
+    vector<int64_t> const memory(scan_size, 1);
+    {
+        checksummed_file_vector<int64_t> col("bench_micro_checked", fv::create_file);
+        col.clear();
+        vector<int64_t> const ones(scan_size, 1);
+        col.append(ones.cbegin(), ones.cend());
+    }
+
+    suite.run("scan/file_vector", [scan_size](micro_state& state) {
+        state.pause();
+        fv const col("bench_micro");
+        int64_t sum = 0;
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            for (int64_t const x : col) {
+                sum += x;
+            }
+        }
+        state.pause();
+        state.bytes = state.iterations() * scan_size * sizeof(int64_t);
+        if (sum != int64_t(state.iterations() * scan_size)) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    });
+
+    // Opened for every pass, so each pass verifies every block.
+    suite.run("scan/checksummed_file_vector", [scan_size](micro_state& state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            checksummed_file_vector<int64_t> const col("bench_micro_checked");
+            col.scan([&sum](int64_t const* v, size_t const n, size_t) {
+                int64_t s = 0;
+                for (size_t j = 0; j < n; ++j) {
+                    s += v[j];
+                }
+                sum += s;
+            });
+        }
+        state.bytes = state.iterations() * scan_size * sizeof(int64_t);
+        if (sum != int64_t(state.iterations() * scan_size)) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    });
+
+    suite.run("scan/std::vector", [&memory, scan_size](micro_state& state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            for (int64_t const x : memory) {
+                sum += x;
+            }
+        }
+        state.bytes = state.iterations() * scan_size * sizeof(int64_t);
+        if (sum != int64_t(state.iterations() * scan_size)) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    });
+
+    vector<uint32_t> random_rows(size_t(1) << 20);
+    mt19937 gen(42);
+    uniform_int_distribution<uint32_t> pick(0, scan_size - 1);
+    for (uint32_t& r : random_rows) {
+        r = pick(gen);
+    }
+
+    suite.run("random_read/file_vector", [&random_rows](micro_state& state) {
+        state.pause();
+        fv const col("bench_micro");
+        int64_t const* const v = col.data();
+        int64_t sum = 0;
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            sum += v[random_rows[i % random_rows.size()]];
+        }
+        state.pause();
+        if (sum != int64_t(state.iterations())) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    });
+
+    suite.run("random_read/std::vector", [&memory, &random_rows](micro_state& state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            sum += memory[random_rows[i % random_rows.size()]];
+        }
+        if (sum != int64_t(state.iterations())) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    });
+
+    suite.run("cold_scan/file_vector", [scan_size](micro_state& state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            state.pause();
+            drop_cache("bench_micro");
+            state.resume();
+            fv const col("bench_micro");
+            for (int64_t const x : col) {
+                sum += x;
+            }
+        }
+        state.pause();
+        state.bytes = state.iterations() * scan_size * sizeof(int64_t);
+        if (sum != int64_t(state.iterations() * scan_size)) {
+            cout << "  (MISMATCH)" << endl;
+        }
+    }, 16);
+
+    suite.run("open_close/file_vector", [](micro_state& state) {
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            fv col("bench_micro");
+            col.close();
+        }
+    });
+
+    suite.run("growth_remap/file_vector", [](micro_state& state) {
+        state.pause();
+        fv col("bench_micro");
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.shrink_to_fit();
+            state.resume();
+            col.reserve(col.capacity() - col.size() + 1);
+            state.pause();
+        }
+        col.shrink_to_fit();
+    }, 4096);
+
+    {
+        fv col("bench_micro");
+        col.clear();
+        col.resize(middle_size, 1);
+    }
+    vector<int64_t> middle_memory(middle_size, 1);
+
+    suite.run("insert_middle/file_vector", [](micro_state& state) {
+        state.pause();
+        fv col("bench_micro");
+        size_t const size = col.size();
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.insert(col.cbegin() + col.size() / 2, 2);
+        }
+        state.pause();
+        col.resize(size);
+    }, size_t(1) << 16);
+
+    suite.run("insert_middle/std::vector", [&middle_memory](micro_state& state) {
+        size_t const size = middle_memory.size();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            middle_memory.insert(middle_memory.cbegin() + middle_memory.size() / 2, 2);
+        }
+        state.pause();
+        middle_memory.resize(size);
+    }, size_t(1) << 16);
+
+    suite.run("erase_middle/file_vector", [middle_size](micro_state& state) {
+        state.pause();
+        fv col("bench_micro");
+        col.resize(middle_size + state.iterations(), 1);
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.erase(col.cbegin() + col.size() / 2);
+        }
+        state.pause();
+    }, size_t(1) << 16);
+
+    suite.run("erase_middle/std::vector", [middle_size](micro_state& state) {
+        state.pause();
+        vector<int64_t> col(middle_size + state.iterations(), 1);
+        state.resume();
+        for (size_t i = 0; i < state.iterations(); ++i) {
+            col.erase(col.cbegin() + col.size() / 2);
+        }
+        state.pause();
+    }, size_t(1) << 16);
+
+    fv col("bench_micro");
+    col.clear();
+    col.close();
+}
+
+// Usage: bench [--micro] [--filter <substring>] [--json <file>]
+//
+// With --micro only the microbenchmarks are run. --filter runs the
+// microbenchmarks whose names contain the substring, and --json writes
+// their results to a file in google-benchmark's JSON format.
+int main(int argc, char** argv) {
+    bool micro_only = false;
+    string filter;
+    string json;
+    for (int i = 1; i < argc; ++i) {
+        string const arg = argv[i];
+        if (arg == "--micro") {
+            micro_only = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            json = argv[++i];
+        } else {
+            cerr << "usage: bench [--micro] [--filter <substring>] [--json <file>]" << endl;
+            return 1;
+        }
+    }
+
+    micro_suite suite(filter);
+    micro_benchmarks(suite);
+    if (!json.empty()) {
+        suite.write_json(json);
+    }
+    if (micro_only) {
+        return 0;
+    }
+
+    bench_expiry();
+    bench_backfill();
+    bench_bulk_backfill();
+    bench_compressed_scan();
+    bench_dictionary();
+    bench_strings();
+    bench_filter();
+    bench_zone_map();
+    bench_bitset();
+    bench_cold_scan();
+    bench_ingest();
+    bench_coroutine_scan();
+    bench_warm();
+    bench_snapshot();
+    bench_checksums();
+    bench_arena();
+    bench_hash_index();
+    bench_external_sort();
+    bench_joins();
+    bench_group_by();
+    bench_rollup();
+    bench_prefix_sum();
+}
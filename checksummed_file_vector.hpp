@@ -0,0 +1,407 @@
+#ifndef CHECKSUMMED_FILE_VECTOR_HPP
+#define CHECKSUMMED_FILE_VECTOR_HPP
+
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include "file_vector.hpp"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// CRC32C (Castagnoli), with the SSE4.2 or ARMv8 CRC instructions where the
+// target has them, and a table otherwise. A checksum can be extended with
+// more bytes: crc32c(crc32c(0, a), b) is the checksum of a followed by b.
+// The functions below work on the crc register, which crc32c inverts on the
+// way in and out.
+
+inline uint32_t crc32c_bytes(uint32_t crc, unsigned char const* p, size_t n) {
+#if defined(__SSE4_2__)
+    for (; n > 0; --n, ++p) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    for (; n > 0; --n, ++p) {
+        crc = __crc32cb(crc, *p);
+    }
+#else
+    static uint32_t const* const table = [] {
+        static uint32_t t[256];
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c >> 1) ^ ((c & 1) ? 0x82f63b78u : 0);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    for (; n > 0; --n, ++p) {
+        crc = table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+#endif
+    return crc;
+}
+
+// Multiply a and b modulo the (bit reflected) polynomial.
+inline uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = uint32_t(1) << 31; m != 0; m >>= 1) {
+        if (a & m) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ 0x82f63b78u : b >> 1;
+    }
+    return product;
+}
+
+// The crc register 'crc' advanced over 'n' zero bytes, so the register of
+// a followed by b is crc32c_shift(register of a, size of b) ^ register of b
+// started from zero.
+inline uint32_t crc32c_shift(uint32_t const crc, size_t n) {
+    // x^(8 * 2^k) for each k.
+    static uint32_t const* const powers = [] {
+        static uint32_t p[64];
+        p[0] = uint32_t(1) << 23;
+        for (int k = 1; k < 64; ++k) {
+            p[k] = crc32c_multiply(p[k - 1], p[k - 1]);
+        }
+        return p;
+    }();
+
+    uint32_t x = uint32_t(1) << 31;
+    for (int k = 0; n != 0; n >>= 1, ++k) {
+        if (n & 1) {
+            x = crc32c_multiply(powers[k], x);
+        }
+    }
+    return crc32c_multiply(x, crc);
+}
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+
+inline uint32_t crc32c_word(uint32_t const crc, unsigned char const* const p) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+#if defined(__SSE4_2__)
+    return static_cast<uint32_t>(_mm_crc32_u64(crc, word));
+#else
+    return __crc32cd(crc, word);
+#endif
+}
+
+#endif
+
+inline uint32_t crc32c(uint32_t const crc, void const* const data, size_t n) {
+    unsigned char const* p = static_cast<unsigned char const*>(data);
+    uint32_t c = ~crc;
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+    // The crc instruction takes a few cycles, but can start every cycle, so
+    // large buffers are taken as three interleaved streams, combined at the
+    // end.
+    if (n >= 3 * 1024) {
+        size_t const stripe = n / 3 / 8 * 8;
+        unsigned char const* const p1 = p + stripe;
+        unsigned char const* const p2 = p + 2 * stripe;
+        uint32_t c1 = 0;
+        uint32_t c2 = 0;
+        for (size_t i = 0; i < stripe; i += 8) {
+            c = crc32c_word(c, p + i);
+            c1 = crc32c_word(c1, p1 + i);
+            c2 = crc32c_word(c2, p2 + i);
+        }
+        c = crc32c_shift(crc32c_shift(c, stripe) ^ c1, stripe) ^ c2;
+        p += 3 * stripe;
+        n -= 3 * stripe;
+    }
+    for (; n >= 8; n -= 8, p += 8) {
+        c = crc32c_word(c, p);
+    }
+#endif
+
+    return ~crc32c_bytes(c, p, n);
+}
+
+//----------------------------------------------------------------------------
+// A file_vector with a CRC32C of every 'block_bytes' bytes of its elements,
+// kept in a companion file_vector, "<name>.crc", to detect silent
+// corruption of the file. As with zoned_file_vector, rows can only be
+// appended or cleared, so the checksums only ever cover a prefix of the
+// column. They are extended by append, flush and close, continuing the
+// checksum of the last, partly filled, block. Rows pushed back since are
+// not yet covered.
+//
+// Blocks are verified lazily, the first time they are read after open,
+// through at, scan or verify, which throw a checksum_error for a block that
+// does not match. scrub verifies every block, with a number of threads, and
+// returns the blocks that do not match instead. data() and operator[] do
+// not verify. If the checksums cover more bytes than the file holds, the
+// file has been truncated: the blocks past its end do not match, and the
+// checksums are left as they are until an explicit rebuild, with append
+// and flush throwing a checksum_error meanwhile.
+//
+// The const members may be called from several threads at once, but not
+// alongside the modifiers.
+
+class checksum_error : public runtime_error {
+public:
+    size_t const block;
+
+    explicit checksum_error(size_t const block)
+    : runtime_error("Checksum mismatch in block " + to_string(block) + " of checksummed_file_vector.")
+    , block(block) {}
+};
+
+template <typename T>
+class checksummed_file_vector {
+    using size_type = size_t;
+
+public:
+    static int constexpr create_file = file_vector<T>::create_file;
+    static size_type constexpr block_bytes = size_type(1) << 16;
+
+    // The checksum of a block, and the number of bytes it covers, which is
+    // 'block_bytes' for every block but the last.
+    struct block_sum {
+        uint32_t crc;
+        uint32_t bytes;
+    };
+
+private:
+    file_vector<T> values;
+    file_vector<block_sum> sums;
+
+    // Whether each block has been verified since open, set by const
+    // readers, with room for more blocks.
+    mutable vector<atomic<uint8_t>> verified;
+
+    char const* bytes() const {
+        return reinterpret_cast<char const*>(values.data());
+    }
+
+    size_type column_bytes() const {
+        return values.size() * sizeof(T);
+    }
+
+    // Bytes covered by the checksums.
+    size_type summed_bytes() const {
+        return sums.empty() ? 0 : (sums.size() - 1) * block_bytes + sums.back().bytes;
+    }
+
+    bool matches(size_type const b) const {
+        block_sum const& s = sums.data()[b];
+        return b * block_bytes + s.bytes <= column_bytes()
+            && crc32c(0, bytes() + b * block_bytes, s.bytes) == s.crc;
+    }
+
+    bool truncated() const {
+        return summed_bytes() > column_bytes();
+    }
+
+    // Make room for flags for 'n' blocks, new ones unverified. Growing
+    // copies the flags, as atomics cannot be moved.
+    void reserve_verified(size_type const n) {
+        if (n <= verified.size()) {
+            return;
+        }
+        vector<atomic<uint8_t>> grown(max(n, 2 * verified.size()));
+        for (size_type b = 0; b < verified.size(); ++b) {
+            grown[b].store(verified[b].load(memory_order_relaxed), memory_order_relaxed);
+        }
+        verified.swap(grown);
+    }
+
+public:
+    checksummed_file_vector(string const& name, int mode = 0)
+    : values(name, mode), sums(name + ".crc", mode) {
+        reserve_verified(sums.size());
+        if (!truncated()) {
+            update();
+        }
+    }
+
+    void close() {
+        if (!truncated()) {
+            update();
+        }
+        values.close();
+        sums.close();
+        verified.clear();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity and Element Access
+
+    size_type size() const {
+        return values.size();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    // Number of blocks with a checksum.
+    size_type blocks() const {
+        return sums.size();
+    }
+
+    // Unverified access.
+    T const& operator[] (size_type const i) const {
+        assert(i < size());
+
+        return values.data()[i];
+    }
+
+    T const* data() const {
+        return values.data();
+    }
+
+    file_vector<T> const& column() const {
+        return values;
+    }
+
+    // Bounds checked access, verifying the blocks holding element 'i'.
+    T const& at(size_type const i) const {
+        if (i >= size()) {
+            throw out_of_range("checksummed_file_vector::at(size_t)");
+        }
+        verify(i, i + 1);
+        return values.data()[i];
+    }
+
+    //------------------------------------------------------------------------
+    // Verification
+
+    // Verify the blocks holding elements [first, last) that have not been
+    // verified since open, throwing a checksum_error for the first that
+    // does not match. Rows not yet covered by a checksum are not checked.
+    void verify(size_type const first, size_type const last) const {
+        if (first >= last) {
+            return;
+        }
+        size_type const end = min(last * sizeof(T), summed_bytes());
+        for (size_type b = first * sizeof(T) / block_bytes; b * block_bytes < end; ++b) {
+            if (!verified[b].load(memory_order_relaxed)) {
+                if (!matches(b)) {
+                    throw checksum_error(b);
+                }
+                verified[b].store(1, memory_order_relaxed);
+            }
+        }
+    }
+
+    // Call 'f(T const* values, size_type n, size_type first_row)' for
+    // successive runs of rows, each verified before it is passed on.
+    template <typename F>
+    void scan(F f, size_type rows = block_bytes / sizeof(T)) const {
+        rows = max(rows, size_type(1));
+        for (size_type first = 0; first < size(); first += rows) {
+            size_type const n = min(rows, size() - first);
+            verify(first, first + n);
+            f(values.data() + first, n, first);
+        }
+    }
+
+    // Verify every block with up to 'threads' threads, returning the blocks
+    // that do not match, in order.
+    vector<size_type> scrub(unsigned const threads = 4) const {
+        size_type const n = sums.size();
+        size_type const shares = max(min(static_cast<size_type>(threads), n), size_type(1));
+        vector<size_type> bad;
+        mutex lock;
+
+        auto const check = [this, &bad, &lock](size_type const from, size_type const to) {
+            vector<size_type> found;
+            for (size_type b = from; b < to; ++b) {
+                if (matches(b)) {
+                    verified[b].store(1, memory_order_relaxed);
+                } else {
+                    found.push_back(b);
+                }
+            }
+            lock_guard<mutex> guard(lock);
+            bad.insert(bad.end(), found.begin(), found.end());
+        };
+
+        vector<thread> workers;
+        for (size_type s = 1; s < shares; ++s) {
+            workers.emplace_back(check, n * s / shares, n * (s + 1) / shares);
+        }
+        check(0, n / shares);
+        for (thread& t : workers) {
+            t.join();
+        }
+        sort(bad.begin(), bad.end());
+        return bad;
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const& value) {
+        values.push_back(value);
+    }
+
+    template <typename I, typename = typename I::iterator_category>
+    void append(I first, I last) {
+        values.insert(values.cend(), first, last);
+        update();
+    }
+
+    void clear() {
+        values.clear();
+        sums.clear();
+        verified.clear();
+    }
+
+    // Extend the checksums over the rows appended since the last update,
+    // continuing from the last block. If they cover more than the column
+    // holds, the file was truncated, and this throws a checksum_error for
+    // the first block cut short.
+    void update() {
+        size_type from = summed_bytes();
+        size_type const to = column_bytes();
+        if (from > to) {
+            throw checksum_error(to / block_bytes);
+        }
+
+        while (from < to) {
+            size_type const b = from / block_bytes;
+            size_type const n = min(block_bytes * (b + 1), to) - from;
+            if (b == sums.size()) {
+                sums.push_back(block_sum {0, 0});
+                reserve_verified(b + 1);
+                verified[b].store(1, memory_order_relaxed);
+            }
+            block_sum& s = sums.data()[b];
+            s.crc = crc32c(s.crc, bytes() + from, n);
+            s.bytes += n;
+            from += n;
+        }
+    }
+
+    // Checksum the column as it is now, accepting whatever it holds.
+    void rebuild() {
+        sums.clear();
+        verified.clear();
+        update();
+    }
+
+    // Update the checksums and write everything to the file.
+    void flush() {
+        update();
+        values.flush();
+        sums.flush();
+    }
+};
+
+#endif
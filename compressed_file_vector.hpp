@@ -0,0 +1,406 @@
+#ifndef COMPRESSED_FILE_VECTOR_HPP
+#define COMPRESSED_FILE_VECTOR_HPP
+
+#include <cstring>
+#include <limits>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Bit streams, least significant bit first. The reader loads eight bytes at
+// a time without checking for the end, so encoded data is padded with eight
+// zero bytes.
+
+class bit_writer {
+    vector<uint8_t>& out;
+    uint64_t bits;
+    int n;
+
+public:
+    explicit bit_writer(vector<uint8_t>& out) : out(out), bits(0), n(0) {}
+
+    // Write the low 'width' bits of 'value', width <= 64.
+    void write(uint64_t const value, int const width) {
+        if (width == 0) {
+            return;
+        }
+        uint64_t const v = (width == 64) ? value : (value & ((uint64_t(1) << width) - 1));
+        bits |= v << n;
+        if (n + width >= 64) {
+            for (int i = 0; i < 8; ++i) {
+                out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+            }
+            int const used = 64 - n;
+            bits = (used == 64) ? 0 : (v >> used);
+            n = width - used;
+        } else {
+            n += width;
+        }
+    }
+
+    void finish() {
+        for (int i = 0; i < n; i += 8) {
+            out.push_back(static_cast<uint8_t>(bits >> i));
+        }
+        out.insert(out.end(), 8, 0);
+        bits = 0;
+        n = 0;
+    }
+};
+
+class bit_reader {
+    uint8_t const* in;
+    uint64_t position;
+
+    uint64_t peek(int const width) const {
+        uint64_t word;
+        memcpy(&word, in + (position >> 3), sizeof(word));
+        return (word >> (position & 7)) & ((uint64_t(1) << width) - 1);
+    }
+
+public:
+    explicit bit_reader(uint8_t const* in) : in(in), position(0) {}
+
+    uint64_t read(int const width) {
+        if (width == 0) {
+            return 0;
+        }
+        if (width > 56) {
+            uint64_t const low = peek(32);
+            position += 32;
+            uint64_t const high = peek(width - 32);
+            position += width - 32;
+            return low | (high << 32);
+        }
+        uint64_t const v = peek(width);
+        position += width;
+        return v;
+    }
+};
+
+//----------------------------------------------------------------------------
+// A compressed column of integers or floating point values. Values are
+// appended to an uncompressed tail, "<name>.tail", and each time it fills a
+// block of 'block_size' values the block is encoded onto the end of the
+// data file "<name>", and its location recorded in "<name>.index". So
+// appends stream-encode, and a block can be found and decoded directly.
+//
+// Integers are delta encoded with a frame of reference (the smallest delta
+// in the block) and bit-packed at the width of the largest remaining delta,
+// so regular timestamps pack to zero bits per value. Floating point values
+// use Gorilla XOR encoding against the previous value.
+//
+// Recently decoded blocks are kept in a small direct mapped cache, so
+// element access near a previous access does not decode again.
+
+template <typename T>
+class compressed_file_vector {
+    static_assert(is_integral<T>::value || is_floating_point<T>::value,
+        "compressed_file_vector needs an integer or floating point type."
+    );
+
+    using size_type = size_t;
+
+public:
+    static size_type constexpr block_size = 1024;
+    static int constexpr create_file = file_vector<T>::create_file;
+
+private:
+    static size_type constexpr cache_slots = 16;
+
+    struct block_info {
+        uint64_t offset;
+        uint32_t bytes;
+        uint32_t count;
+    };
+
+    //------------------------------------------------------------------------
+    // Codecs for integral and floating point values.
+
+    template<typename U, typename E = void> struct codec;
+
+    template<typename U>
+    struct codec<U, typename enable_if<is_integral<U>::value>::type> {
+        static int bit_width(uint64_t const x) {
+            return (x == 0) ? 0 : 64 - __builtin_clzll(x);
+        }
+
+        static void encode(U const* values, size_type const n, vector<uint8_t>& out) {
+            uint64_t const first = static_cast<uint64_t>(values[0]);
+            int64_t min_delta = numeric_limits<int64_t>::max();
+            for (size_type i = 1; i < n; ++i) {
+                int64_t const d = static_cast<int64_t>(
+                    static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1])
+                );
+                min_delta = (d < min_delta) ? d : min_delta;
+            }
+            if (n < 2) {
+                min_delta = 0;
+            }
+            uint64_t max_offset = 0;
+            for (size_type i = 1; i < n; ++i) {
+                uint64_t const o = static_cast<uint64_t>(values[i])
+                    - static_cast<uint64_t>(values[i - 1]) - static_cast<uint64_t>(min_delta);
+                max_offset = (o > max_offset) ? o : max_offset;
+            }
+            int const width = bit_width(max_offset);
+
+            bit_writer w(out);
+            w.write(first, 64);
+            w.write(static_cast<uint64_t>(min_delta), 64);
+            w.write(width, 8);
+            for (size_type i = 1; i < n; ++i) {
+                w.write(static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1])
+                    - static_cast<uint64_t>(min_delta), width
+                );
+            }
+            w.finish();
+        }
+
+        static void decode(uint8_t const* in, size_type const n, U* values) {
+            bit_reader r(in);
+            uint64_t v = r.read(64);
+            uint64_t const min_delta = r.read(64);
+            int const width = r.read(8);
+
+            values[0] = static_cast<U>(v);
+            if (width == 0) {
+                for (size_type i = 1; i < n; ++i) {
+                    v += min_delta;
+                    values[i] = static_cast<U>(v);
+                }
+            } else {
+                for (size_type i = 1; i < n; ++i) {
+                    v += min_delta + r.read(width);
+                    values[i] = static_cast<U>(v);
+                }
+            }
+        }
+    };
+
+    template<typename U>
+    struct codec<U, typename enable_if<is_floating_point<U>::value>::type> {
+        static int constexpr bits = sizeof(U) * 8;
+
+        static uint64_t to_bits(U const x) {
+            uint64_t b = 0;
+            memcpy(&b, &x, sizeof(U));
+            return b;
+        }
+
+        static U from_bits(uint64_t const b) {
+            U x;
+            memcpy(&x, &b, sizeof(U));
+            return x;
+        }
+
+        static void encode(U const* values, size_type const n, vector<uint8_t>& out) {
+            bit_writer w(out);
+            uint64_t previous = to_bits(values[0]);
+            w.write(previous, bits);
+
+            int lead = -1;
+            int trail = 0;
+            for (size_type i = 1; i < n; ++i) {
+                uint64_t const current = to_bits(values[i]);
+                uint64_t const x = current ^ previous;
+                previous = current;
+
+                if (x == 0) {
+                    w.write(0, 1);
+                    continue;
+                }
+                w.write(1, 1);
+
+                int l = __builtin_clzll(x) - (64 - bits);
+                int const t = __builtin_ctzll(x);
+                l = (l > 31) ? 31 : l;
+
+                if (lead >= 0 && l >= lead && t >= trail) {
+                    // Fits in the previous window.
+                    w.write(0, 1);
+                    w.write(x >> trail, bits - lead - trail);
+                } else {
+                    lead = l;
+                    trail = t;
+                    w.write(1, 1);
+                    w.write(lead, 5);
+                    w.write(bits - lead - trail - 1, 6);
+                    w.write(x >> trail, bits - lead - trail);
+                }
+            }
+            w.finish();
+        }
+
+        static void decode(uint8_t const* in, size_type const n, U* values) {
+            bit_reader r(in);
+            uint64_t previous = r.read(bits);
+            values[0] = from_bits(previous);
+
+            int lead = 0;
+            int trail = 0;
+            for (size_type i = 1; i < n; ++i) {
+                if (r.read(1) != 0) {
+                    if (r.read(1) != 0) {
+                        lead = r.read(5);
+                        trail = bits - lead - (r.read(6) + 1);
+                    }
+                    previous ^= r.read(bits - lead - trail) << trail;
+                }
+                values[i] = from_bits(previous);
+            }
+        }
+    };
+
+    //------------------------------------------------------------------------
+
+    file_vector<uint8_t> data;
+    file_vector<block_info> index;
+    file_vector<T> tail;
+
+    struct cache_slot {
+        size_type block;
+        vector<T> values;
+    };
+    mutable vector<cache_slot> cache;
+
+    void encode_tail() {
+        vector<uint8_t> encoded;
+        codec<T>::encode(tail.data(), tail.size(), encoded);
+
+        block_info const info {
+            data.size(), static_cast<uint32_t>(encoded.size()), static_cast<uint32_t>(tail.size())
+        };
+        data.insert(data.cend(), encoded.cbegin(), encoded.cend());
+        index.push_back(info);
+        tail.clear();
+    }
+
+public:
+    compressed_file_vector(string const& name, int mode = 0)
+    : data(name, mode), index(name + ".index", mode), tail(name + ".tail", mode)
+    , cache(cache_slots, cache_slot {numeric_limits<size_type>::max(), vector<T>()}) {}
+
+    void close() {
+        data.close();
+        index.close();
+        tail.close();
+        cache.clear();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return index.size() * block_size + tail.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Number of blocks, including a partially filled last block.
+    size_type block_count() const {
+        return index.size() + (tail.empty() ? 0 : 1);
+    }
+
+    size_type compressed_bytes() const {
+        return data.size() + index.size() * sizeof(block_info) + tail.size() * sizeof(T);
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    // Decode block 'b' into 'out', which must have room for 'block_size'
+    // values, returning the number of values in the block.
+    size_type read_block(size_type const b, T* out) const {
+        assert(b < block_count());
+
+        if (b == index.size()) {
+            copy(tail.data(), tail.data() + tail.size(), out);
+            return tail.size();
+        }
+        block_info const& info = index.data()[b];
+        codec<T>::decode(data.data() + info.offset, info.count, out);
+        return info.count;
+    }
+
+    // Decoded values of block 'b' through the cache. The pointer is valid
+    // until the next access or modification.
+    T const* block(size_type const b) const {
+        assert(b < block_count());
+
+        if (b == index.size()) {
+            return tail.data();
+        }
+        cache_slot& slot = cache[b % cache_slots];
+        if (slot.block != b) {
+            slot.values.resize(block_size);
+            read_block(b, slot.values.data());
+            slot.block = b;
+        }
+        return slot.values.data();
+    }
+
+    T operator[] (size_type const i) const {
+        assert(i < size());
+
+        return block(i / block_size)[i % block_size];
+    }
+
+    T at(size_type const i) const {
+        if (i >= size()) {
+            throw out_of_range("compressed_file_vector::at(size_type)");
+        }
+        return (*this)[i];
+    }
+
+    // Sequential scan, calling 'f(T const* values, size_type n)' for each
+    // block in order. Blocks are decoded into one buffer, bypassing the
+    // cache.
+    template <typename F> void scan(F f) const {
+        vector<T> buffer(block_size);
+        for (size_type b = 0; b < index.size(); ++b) {
+            f(static_cast<T const*>(buffer.data()), read_block(b, buffer.data()));
+        }
+        if (!tail.empty()) {
+            f(tail.data(), tail.size());
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const value) {
+        tail.push_back(value);
+        if (tail.size() == block_size) {
+            encode_tail();
+        }
+    }
+
+    template <typename I, typename = typename I::iterator_category>
+    void append(I first, I last) {
+        while (first != last) {
+            size_type const n = min(
+                static_cast<size_type>(last - first), block_size - tail.size()
+            );
+            tail.insert(tail.cend(), first, first + n);
+            first += n;
+            if (tail.size() == block_size) {
+                encode_tail();
+            }
+        }
+    }
+
+    void clear() {
+        data.clear();
+        index.clear();
+        tail.clear();
+        for (cache_slot& slot : cache) {
+            slot.block = numeric_limits<size_type>::max();
+        }
+    }
+};
+
+#endif
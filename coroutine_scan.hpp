@@ -0,0 +1,405 @@
+#ifndef COROUTINE_SCAN_HPP
+#define COROUTINE_SCAN_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine_scan.hpp needs C++20 coroutines."
+#endif
+
+#include <coroutine>
+#include <optional>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <exception>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Coroutine scans of file_vectors that do not block on page faults. A
+// coroutine awaiting 'prefetch' of a range of a column, or the next chunk
+// of a 'scan_chunks', carries on at once if the pages are resident.
+// Otherwise the pages are requested with madvise(MADV_WILLNEED) and the
+// coroutine is parked with its page_scheduler, which runs other coroutines
+// and resumes it when mincore shows the pages have arrived. A worker thread
+// running a page_scheduler only touches resident pages, and keeps busy
+// while other columns load.
+//
+// Coroutines are 'task's: lazily started, awaitable from other tasks, and
+// run from the top by spawning them on a page_scheduler.
+
+class page_scheduler;
+
+// Whether all the pages of [first, first + bytes) are resident.
+inline bool pages_resident(char const* const first, size_t const bytes, vector<unsigned char>& scratch) {
+    if (bytes == 0) {
+        return true;
+    }
+    size_t const page_size = getpagesize();
+    uintptr_t const begin = reinterpret_cast<uintptr_t>(first) / page_size * page_size;
+    uintptr_t const end = reinterpret_cast<uintptr_t>(first) + bytes;
+    size_t const pages = (end - begin + page_size - 1) / page_size;
+    scratch.resize(pages);
+    if (mincore(reinterpret_cast<void*>(begin), end - begin, scratch.data()) == -1) {
+        // Nothing can be said, so do not wait.
+        return true;
+    }
+    for (unsigned char const p : scratch) {
+        if ((p & 1) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void pages_willneed(char const* const first, size_t const bytes) {
+    size_t const page_size = getpagesize();
+    uintptr_t const begin = reinterpret_cast<uintptr_t>(first) / page_size * page_size;
+    uintptr_t const end = reinterpret_cast<uintptr_t>(first) + bytes;
+    if (end > begin) {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Tasks.
+
+template <typename T = void> class task;
+
+struct task_promise_base {
+    page_scheduler* scheduler = nullptr;
+    coroutine_handle<> continuation;
+    exception_ptr error;
+
+    suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    // Resume the awaiting task, if any.
+    struct final_awaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> h) noexcept {
+            coroutine_handle<> const c = h.promise().continuation;
+            return c ? c : noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        error = current_exception();
+    }
+};
+
+template <typename T>
+struct task_promise : task_promise_base {
+    optional<T> value;
+
+    task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& v) {
+        value.emplace(forward<U>(v));
+    }
+
+    T result() {
+        if (error) {
+            rethrow_exception(error);
+        }
+        return move(*value);
+    }
+};
+
+template <>
+struct task_promise<void> : task_promise_base {
+    task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+};
+
+template <typename T>
+class task {
+    friend class page_scheduler;
+
+public:
+    using promise_type = task_promise<T>;
+
+private:
+    coroutine_handle<promise_type> handle;
+
+public:
+    explicit task(coroutine_handle<promise_type> const h) : handle(h) {}
+
+    task(task&& that) noexcept : handle(that.handle) {
+        that.handle = nullptr;
+    }
+
+    task(task const&) = delete;
+    task& operator= (task const&) = delete;
+
+    ~task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool done() const {
+        return !handle || handle.done();
+    }
+
+    // Awaiting a task runs it on the awaiting task's scheduler, and
+    // resumes the awaiting task when it finishes.
+    class awaiter {
+        coroutine_handle<promise_type> child;
+
+    public:
+        explicit awaiter(coroutine_handle<promise_type> const child) : child(child) {}
+
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> const parent) noexcept {
+            child.promise().scheduler = parent.promise().scheduler;
+            child.promise().continuation = parent;
+            return child;
+        }
+
+        T await_resume() {
+            return child.promise().result();
+        }
+    };
+
+    awaiter operator co_await() noexcept {
+        return awaiter(handle);
+    }
+};
+
+template <typename T>
+task<T> task_promise<T>::get_return_object() {
+    return task<T>(coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() {
+    return task<void>(coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+//----------------------------------------------------------------------------
+// A single threaded scheduler of tasks. Tasks waiting for pages are polled
+// with mincore when no task is ready to run; when none of them can run
+// either, the scheduler sleeps for 'poll_interval'.
+
+class page_scheduler {
+    struct waiting {
+        char const* first;
+        size_t bytes;
+        coroutine_handle<> handle;
+    };
+
+    deque<coroutine_handle<>> ready;
+    vector<waiting> waits;
+    vector<task<void>> tasks;
+    vector<unsigned char> scratch;
+    chrono::microseconds const poll_interval;
+    size_t suspensions;
+
+    void poll() {
+        size_t kept = 0;
+        for (waiting const& w : waits) {
+            if (pages_resident(w.first, w.bytes, scratch)) {
+                ready.push_back(w.handle);
+            } else {
+                // Ask again, in case pages were read ahead and dropped.
+                pages_willneed(w.first, w.bytes);
+                waits[kept++] = w;
+            }
+        }
+        waits.resize(kept);
+    }
+
+public:
+    explicit page_scheduler(chrono::microseconds const poll_interval = chrono::microseconds(50))
+    : poll_interval(poll_interval), suspensions(0) {}
+
+    void spawn(task<void>&& t) {
+        t.handle.promise().scheduler = this;
+        ready.push_back(t.handle);
+        tasks.push_back(move(t));
+    }
+
+    // Park 'h' until [first, first + bytes) is resident.
+    void wait_resident(char const* const first, size_t const bytes, coroutine_handle<> const h) {
+        waits.push_back(waiting {first, bytes, h});
+        ++suspensions;
+    }
+
+    // Number of times a task has had to wait for pages.
+    size_t waited() const {
+        return suspensions;
+    }
+
+    // Run the spawned tasks to completion, rethrowing the first exception
+    // a task ended with.
+    void run() {
+        while (!ready.empty() || !waits.empty()) {
+            if (ready.empty()) {
+                poll();
+                if (ready.empty()) {
+                    this_thread::sleep_for(poll_interval);
+                    continue;
+                }
+            }
+            coroutine_handle<> const h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+
+        vector<task<void>> finished;
+        finished.swap(tasks);
+        for (task<void>& t : finished) {
+            t.handle.promise().result();
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+// Waiting for pages.
+
+// Awaitable that continues once [first, first + bytes) is resident.
+class resident_awaiter {
+    char const* first;
+    size_t bytes;
+
+public:
+    resident_awaiter(char const* const first, size_t const bytes) : first(first), bytes(bytes) {}
+
+    bool await_ready() {
+        vector<unsigned char> scratch;
+        if (pages_resident(first, bytes, scratch)) {
+            return true;
+        }
+        pages_willneed(first, bytes);
+        return false;
+    }
+
+    template <typename P>
+    void await_suspend(coroutine_handle<P> const h) {
+        h.promise().scheduler->wait_resident(first, bytes, h);
+    }
+
+    void await_resume() {}
+};
+
+// co_await prefetch(col, first, last) continues once rows [first, last) of
+// 'col' are resident.
+template <typename T, typename R>
+resident_awaiter prefetch(file_vector<T, R> const& col, size_t const first, size_t const last) {
+    assert(first <= last && last <= col.size());
+
+    return resident_awaiter(reinterpret_cast<char const*>(col.data() + first), (last - first) * sizeof(T));
+}
+
+//----------------------------------------------------------------------------
+// An asynchronous scan of a column in chunks of 'chunk_rows' rows. Each
+// co_await of next() yields the next chunk, once it is resident, or nullopt
+// at the end, with the following 'lookahead' chunks requested ahead.
+
+template <typename T, typename R = file_vector_recorder>
+class chunk_scan {
+    file_vector<T, R> const& col;
+    size_t const chunk_rows;
+    size_t const lookahead;
+    size_t next_chunk;
+    size_t requested;
+
+    size_t chunks() const {
+        return (col.size() + chunk_rows - 1) / chunk_rows;
+    }
+
+    char const* chunk_data(size_t const c) const {
+        return reinterpret_cast<char const*>(col.data() + c * chunk_rows);
+    }
+
+    size_t chunk_size(size_t const c) const {
+        return min(chunk_rows, col.size() - c * chunk_rows);
+    }
+
+public:
+    struct chunk {
+        T const* values;
+        size_t size;
+        size_t first_row;
+    };
+
+    chunk_scan(file_vector<T, R> const& col, size_t const chunk_rows, size_t const lookahead)
+    : col(col), chunk_rows(max(chunk_rows, size_t(1))), lookahead(lookahead), next_chunk(0), requested(0) {}
+
+    class awaiter {
+        chunk_scan& scan;
+        resident_awaiter pages;
+
+    public:
+        explicit awaiter(chunk_scan& scan) : scan(scan), pages(nullptr, 0) {
+            size_t const n = scan.chunks();
+            size_t const c = scan.next_chunk;
+            for (; scan.requested < min(c + 1 + scan.lookahead, n); ++scan.requested) {
+                size_t const r = scan.requested;
+                if (r > c) {
+                    pages_willneed(scan.chunk_data(r), scan.chunk_size(r) * sizeof(T));
+                }
+            }
+            if (c < n) {
+                pages = resident_awaiter(scan.chunk_data(c), scan.chunk_size(c) * sizeof(T));
+            }
+        }
+
+        bool await_ready() {
+            return pages.await_ready();
+        }
+
+        template <typename P>
+        void await_suspend(coroutine_handle<P> const h) {
+            pages.await_suspend(h);
+        }
+
+        optional<chunk> await_resume() {
+            size_t const c = scan.next_chunk;
+            if (c >= scan.chunks()) {
+                return nullopt;
+            }
+            ++scan.next_chunk;
+            return chunk {col_data(c), scan.chunk_size(c), c * scan.chunk_rows};
+        }
+
+    private:
+        T const* col_data(size_t const c) const {
+            return reinterpret_cast<T const*>(scan.chunk_data(c));
+        }
+    };
+
+    awaiter next() {
+        return awaiter(*this);
+    }
+};
+
+template <typename T, typename R>
+chunk_scan<T, R> scan_chunks(file_vector<T, R> const& col, size_t const chunk_rows = 1 << 16, size_t const lookahead = 4) {
+    return chunk_scan<T, R>(col, chunk_rows, lookahead);
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef DICTIONARY_FILE_VECTOR_HPP
+#define DICTIONARY_FILE_VECTOR_HPP
+
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include "file_vector.hpp"
+#include "filter.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A dictionary encoded column for values with few distinct values. Each
+// distinct value is stored once in "<name>.dict", and the column itself is
+// a file_vector of codes, indexes into the dictionary. The codes are as
+// narrow as the dictionary allows: "<name>.codes8" for up to 256 values,
+// "<name>.codes16" for up to 65536, and "<name>.codes32" beyond that. When
+// the dictionary outgrows the code width, the codes are rewritten at the
+// next width into a temporary file, which is synced and renamed into place
+// before the narrower file is removed, so on open the widest code file
+// present is always complete.
+//
+// Equality and IN-list predicates are evaluated on the codes, without
+// decoding values, producing a selection of the matching rows.
+
+template <typename T, typename Hash = hash<T>, typename Equal = equal_to<T>>
+class dictionary_file_vector {
+    using size_type = size_t;
+
+    string const name;
+    file_vector<T> dictionary;
+    unordered_map<T, uint32_t, Hash, Equal> lookup;
+
+    int width;
+    unique_ptr<file_vector<uint8_t>> codes8;
+    unique_ptr<file_vector<uint16_t>> codes16;
+    unique_ptr<file_vector<uint32_t>> codes32;
+
+    string codes_name(int const w) const {
+        return name + ".codes" + to_string(8 * w);
+    }
+
+    static int width_for(size_type const n) {
+        return (n <= 0x100) ? 1 : (n <= 0x10000) ? 2 : 4;
+    }
+
+    static bool exists(string const& path) {
+        return access(path.c_str(), F_OK) == 0;
+    }
+
+    void open_codes(int const mode) {
+        codes8.reset();
+        codes16.reset();
+        codes32.reset();
+        switch (width) {
+            case 1: codes8.reset(new file_vector<uint8_t>(codes_name(1), mode)); break;
+            case 2: codes16.reset(new file_vector<uint16_t>(codes_name(2), mode)); break;
+            default: codes32.reset(new file_vector<uint32_t>(codes_name(4), mode)); break;
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // Widen the codes by copying them into a file of the next width.
+
+    template <typename From, typename To>
+    void rewrite(file_vector<From>& from, int const to_width) {
+        string const final_name = codes_name(to_width);
+        string const tmp_name = final_name + ".tmp";
+        {
+            file_vector<To> to(tmp_name, file_vector<To>::create_file);
+            to.clear();
+            to.reserve(from.size());
+            for (size_type i = 0; i < from.size(); ++i) {
+                to.push_back(from.data()[i]);
+            }
+            to.close();
+        }
+
+        int const fd = open(tmp_name.c_str(), O_RDONLY);
+        if (fd == -1 || fsync(fd) == -1) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+            throw runtime_error("Unable to sync widened codes for dictionary_file_vector.");
+        }
+        ::close(fd);
+
+        if (rename(tmp_name.c_str(), final_name.c_str()) == -1) {
+            throw runtime_error("Unable to install widened codes for dictionary_file_vector.");
+        }
+        from.close();
+        unlink(codes_name(width).c_str());
+        width = to_width;
+        open_codes(0);
+    }
+
+    void widen(int const to_width) {
+        if (width == 1 && to_width == 2) {
+            rewrite<uint8_t, uint16_t>(*codes8, 2);
+        } else if (width == 1) {
+            rewrite<uint8_t, uint32_t>(*codes8, 4);
+        } else {
+            rewrite<uint16_t, uint32_t>(*codes16, 4);
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // Predicate kernels, building 64 row masks from the codes.
+
+    template <typename U>
+    static void match_equal(U const* codes, size_type const n, U const code, uint64_t* out) {
+        for (size_type w = 0; w * 64 < n; ++w) {
+            U const* const c = codes + w * 64;
+            size_type const m = (n - w * 64 < 64) ? n - w * 64 : 64;
+            uint64_t mask = 0;
+            for (size_type j = 0; j < m; ++j) {
+                mask |= static_cast<uint64_t>(c[j] == code) << j;
+            }
+            out[w] = mask;
+        }
+    }
+
+#ifdef __AVX2__
+    static void match_equal(uint8_t const* codes, size_type const n, uint8_t const code, uint64_t* out) {
+        __m256i const needle = _mm256_set1_epi8(static_cast<char>(code));
+        size_type const full = n / 64;
+        for (size_type w = 0; w < full; ++w) {
+            __m256i const low = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(codes + w * 64));
+            __m256i const high = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(codes + w * 64 + 32));
+            uint64_t const l = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, needle)));
+            uint64_t const h = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, needle)));
+            out[w] = l | (h << 32);
+        }
+        if (full * 64 < n) {
+            match_equal<uint8_t>(codes + full * 64, n - full * 64, code, out + full);
+        }
+    }
+#endif
+
+    template <typename U>
+    static void match_table(U const* codes, size_type const n, uint8_t const* table, uint64_t* out) {
+        for (size_type w = 0; w * 64 < n; ++w) {
+            U const* const c = codes + w * 64;
+            size_type const m = (n - w * 64 < 64) ? n - w * 64 : 64;
+            uint64_t mask = 0;
+            for (size_type j = 0; j < m; ++j) {
+                mask |= static_cast<uint64_t>(table[c[j]]) << j;
+            }
+            out[w] = mask;
+        }
+    }
+
+public:
+    static int constexpr create_file = file_vector<T>::create_file;
+
+    dictionary_file_vector(string const& name, int mode = 0)
+    : name(name), dictionary(name + ".dict", mode), width(0) {
+        for (size_type i = 0; i < dictionary.size(); ++i) {
+            lookup.emplace(dictionary.data()[i], static_cast<uint32_t>(i));
+        }
+
+        // The widest complete code file wins, narrower ones are left over
+        // from an interrupted widening.
+        for (int const w : {4, 2, 1}) {
+            unlink((codes_name(w) + ".tmp").c_str());
+            if (width == 0 && exists(codes_name(w))) {
+                width = w;
+            } else if (width != 0) {
+                unlink(codes_name(w).c_str());
+            }
+        }
+        if (width == 0) {
+            width = width_for(dictionary.size());
+        }
+        open_codes(mode);
+    }
+
+    void close() {
+        dictionary.close();
+        if (codes8) codes8->close();
+        if (codes16) codes16->close();
+        if (codes32) codes32->close();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return (width == 1) ? codes8->size() : (width == 2) ? codes16->size() : codes32->size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Bytes per code.
+    int code_width() const {
+        return width;
+    }
+
+    size_type dictionary_size() const {
+        return dictionary.size();
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    uint32_t code(size_type const i) const {
+        assert(i < size());
+
+        return (width == 1) ? codes8->data()[i]
+            : (width == 2) ? codes16->data()[i] : codes32->data()[i];
+    }
+
+    T const& operator[] (size_type const i) const {
+        return dictionary.data()[code(i)];
+    }
+
+    T const& at(size_type const i) const {
+        if (i >= size()) {
+            throw out_of_range("dictionary_file_vector::at(size_type)");
+        }
+        return (*this)[i];
+    }
+
+    //------------------------------------------------------------------------
+    // Predicates
+
+    // Rows equal to 'value'.
+    selection equal(T const& value) const {
+        size_type const n = size();
+        selection mask(n);
+
+        auto const i = lookup.find(value);
+        if (i == lookup.end() || n == 0) {
+            return mask;
+        }
+
+        uint32_t const c = i->second;
+        switch (width) {
+            case 1: match_equal(codes8->data(), n, static_cast<uint8_t>(c), mask.data()); break;
+            case 2: match_equal(codes16->data(), n, static_cast<uint16_t>(c), mask.data()); break;
+            default: match_equal(codes32->data(), n, c, mask.data()); break;
+        }
+        return mask;
+    }
+
+    // Rows equal to any of the values in [first, last).
+    template <typename I>
+    selection in(I first, I last) const {
+        size_type const n = size();
+        selection mask(n);
+
+        vector<uint8_t> table(dictionary.size(), 0);
+        bool any = false;
+        for (; first != last; ++first) {
+            auto const i = lookup.find(*first);
+            if (i != lookup.end()) {
+                table[i->second] = 1;
+                any = true;
+            }
+        }
+        if (!any || n == 0) {
+            return mask;
+        }
+
+        switch (width) {
+            case 1: match_table(codes8->data(), n, table.data(), mask.data()); break;
+            case 2: match_table(codes16->data(), n, table.data(), mask.data()); break;
+            default: match_table(codes32->data(), n, table.data(), mask.data()); break;
+        }
+        return mask;
+    }
+
+    selection in(initializer_list<T> const& list) const {
+        return in(list.begin(), list.end());
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const& value) {
+        auto i = lookup.find(value);
+        if (i == lookup.end()) {
+            uint32_t const c = static_cast<uint32_t>(dictionary.size());
+            if (width_for(c + 1) > width) {
+                widen(width_for(c + 1));
+            }
+            dictionary.push_back(value);
+            i = lookup.emplace(value, c).first;
+        }
+
+        switch (width) {
+            case 1: codes8->push_back(static_cast<uint8_t>(i->second)); break;
+            case 2: codes16->push_back(static_cast<uint16_t>(i->second)); break;
+            default: codes32->push_back(i->second); break;
+        }
+    }
+
+    template <typename I>
+    void append(I first, I last) {
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    // Clears the rows, the dictionary and its code width are kept.
+    void clear() {
+        if (codes8) codes8->clear();
+        if (codes16) codes16->clear();
+        if (codes32) codes32->clear();
+    }
+};
+
+#endif
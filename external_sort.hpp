@@ -0,0 +1,266 @@
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <exception>
+#include <mutex>
+#include "file_vector.hpp"
+#include "kway_merge.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Sorting columns larger than memory. Sorting a file_vector in place with
+// std::sort touches pages all over the file, and once the column does not
+// fit in the page-cache every comparison can be a read from the device.
+//
+// external_sort instead reads the column sequentially, in runs that fit a
+// memory budget shared by the sorting threads, sorts each run in memory
+// and writes it to a run file with one sequential write. The runs are then
+// merged with a loser tree (see kway_merge.hpp) into the output file, which
+// is written sequentially through a buffer. The output is a file_vector
+// file, and the run files are removed. The sort is not stable.
+//
+// For large records, external_sort_index sorts only keys and row numbers,
+// writing the row numbers in key order (and by row number for equal keys),
+// to be used as a permutation of the column.
+
+struct sort_options {
+    size_t memory_bytes = size_t(1) << 30;
+    unsigned threads = 4;
+    size_t write_bytes = size_t(1) << 20;
+};
+
+namespace external_sort_detail {
+
+inline void write_all(int const fd, char const* bytes, size_t length, size_t offset) {
+    while (length > 0) {
+        ssize_t const n = pwrite(fd, bytes, length, offset);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Unable to write file for external_sort.");
+        }
+        bytes += n;
+        length -= n;
+        offset += n;
+    }
+}
+
+inline void read_all(int const fd, char* bytes, size_t length, size_t offset) {
+    while (length > 0) {
+        ssize_t const n = pread(fd, bytes, length, offset);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Unable to read file for external_sort.");
+        }
+        bytes += n;
+        length -= n;
+        offset += n;
+    }
+}
+
+// Create 'name' empty, to be opened as a file_vector, removing any head or
+// commit record left by an earlier file of the same name.
+inline int create(string const& name) {
+    unlink((name + ".head").c_str());
+    unlink((name + ".commit").c_str());
+    int const fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        throw runtime_error("Unable to create file for external_sort.");
+    }
+    return fd;
+}
+
+// Writes values of type O to a file sequentially, a buffer at a time, taking
+// them through 'project'.
+template <typename O, typename Project>
+class sequential_writer {
+    int const fd;
+    Project project;
+    vector<O> buffer;
+    size_t fill;
+    size_t offset;
+
+public:
+    sequential_writer(int const fd, Project project, size_t const bytes)
+    : fd(fd), project(project), buffer(max(bytes / sizeof(O), size_t(1))), fill(0), offset(0) {}
+
+    template <typename R>
+    void push_back(R const& r) {
+        buffer[fill++] = project(r);
+        if (fill == buffer.size()) {
+            flush();
+        }
+    }
+
+    void flush() {
+        write_all(fd, reinterpret_cast<char const*>(buffer.data()), fill * sizeof(O), offset);
+        offset += fill * sizeof(O);
+        fill = 0;
+    }
+};
+
+// Sort 'rows' records of type R, produced by 'fill(R* records, first_row,
+// n)', into the file 'out_name' as O's, through 'project', returning the
+// number of runs.
+template <typename R, typename O, typename Fill, typename Compare, typename Project>
+size_t sort_runs(
+    size_t const rows, Fill fill, Compare comp, Project project,
+    string const& out_name, sort_options const& options
+) {
+    unsigned const threads = max(options.threads, 1u);
+    size_t const budget_rows = max(options.memory_bytes / threads / sizeof(R), size_t(1));
+    size_t const run_rows = max(min(budget_rows, (rows + threads - 1) / threads), size_t(1));
+    size_t const runs = (rows + run_rows - 1) / run_rows;
+
+    auto const run_name = [&out_name](size_t const r) {
+        return out_name + ".run" + to_string(r);
+    };
+
+    // Sort runs, each thread taking the next run, with its own buffer.
+    atomic<size_t> next_run(0);
+    exception_ptr error;
+    mutex error_lock;
+    auto const sort_some = [&] {
+        try {
+            vector<R> records;
+            for (size_t r = next_run++; r < runs; r = next_run++) {
+                size_t const first = r * run_rows;
+                size_t const n = min(run_rows, rows - first);
+                records.resize(n);
+                fill(records.data(), first, n);
+                sort(records.begin(), records.end(), comp);
+
+                int const fd = create(run_name(r));
+                try {
+                    write_all(fd, reinterpret_cast<char const*>(records.data()), n * sizeof(R), 0);
+                } catch (...) {
+                    ::close(fd);
+                    throw;
+                }
+                ::close(fd);
+            }
+        } catch (...) {
+            lock_guard<mutex> guard(error_lock);
+            error = error ? error : current_exception();
+            next_run = runs;
+        }
+    };
+
+    vector<thread> workers;
+    for (unsigned t = 1; t < min(static_cast<size_t>(threads), runs); ++t) {
+        workers.emplace_back(sort_some);
+    }
+    sort_some();
+    for (thread& w : workers) {
+        w.join();
+    }
+
+    auto const remove_runs = [&run_name, runs] {
+        for (size_t r = 0; r < runs; ++r) {
+            unlink(run_name(r).c_str());
+        }
+    };
+    if (error) {
+        remove_runs();
+        rethrow_exception(error);
+    }
+
+    // Merge the runs into the output.
+    int const fd = create(out_name);
+    try {
+        vector<unique_ptr<file_vector<R>>> run_files;
+        vector<typename loser_tree<R, Compare>::source> sources;
+        for (size_t r = 0; r < runs; ++r) {
+            run_files.emplace_back(new file_vector<R>(run_name(r)));
+            file_vector<R> const& run = *run_files.back();
+            madvise(const_cast<R*>(run.data()), run.size() * sizeof(R), MADV_SEQUENTIAL);
+            sources.emplace_back(run.data(), run.data() + run.size());
+        }
+
+        sequential_writer<O, Project> out(fd, project, options.write_bytes);
+        kway_merge<R>(sources, out, comp);
+        out.flush();
+    } catch (...) {
+        ::close(fd);
+        remove_runs();
+        throw;
+    }
+    ::close(fd);
+    remove_runs();
+    return runs;
+}
+
+template <typename K>
+struct keyed_row {
+    K key;
+    uint64_t row;
+};
+
+}
+
+// Sort 'col' by 'comp' into a new file_vector file 'out_name', returning
+// the number of runs merged.
+template <typename T, typename R, typename Compare = less<T>>
+size_t external_sort(
+    file_vector<T, R> const& col, string const& out_name,
+    Compare comp = Compare(), sort_options const& options = sort_options()
+) {
+    int const fd = open(col.file_name().c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("Unable to open file for external_sort.");
+    }
+    size_t const offset = col.file_offset();
+    posix_fadvise(fd, offset, col.size() * sizeof(T), POSIX_FADV_SEQUENTIAL);
+
+    auto const fill = [fd, offset](T* const records, size_t const first, size_t const n) {
+        external_sort_detail::read_all(fd, reinterpret_cast<char*>(records), n * sizeof(T), offset + first * sizeof(T));
+    };
+    auto const identity = [](T const& value) {
+        return value;
+    };
+
+    try {
+        size_t const runs = external_sort_detail::sort_runs<T, T>(col.size(), fill, comp, identity, out_name, options);
+        ::close(fd);
+        return runs;
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+// Write the row numbers of 'col' into a new file_vector<uint64_t> file
+// 'out_name', ordered by 'key(value)', and by row number for equal keys,
+// returning the number of runs merged. Only the keys and row numbers are
+// sorted and merged.
+template <typename T, typename R, typename Key>
+size_t external_sort_index(
+    file_vector<T, R> const& col, Key key, string const& out_name,
+    sort_options const& options = sort_options()
+) {
+    using K = decltype(key(declval<T const&>()));
+    using record = external_sort_detail::keyed_row<K>;
+
+    T const* const values = col.data();
+    auto const fill = [values, key](record* const records, size_t const first, size_t const n) {
+        for (size_t i = 0; i < n; ++i) {
+            records[i] = record {key(values[first + i]), first + i};
+        }
+    };
+    auto const comp = [](record const& a, record const& b) {
+        return a.key < b.key || (!(b.key < a.key) && a.row < b.row);
+    };
+    auto const row_of = [](record const& r) {
+        return r.row;
+    };
+    return external_sort_detail::sort_runs<record, uint64_t>(col.size(), fill, comp, row_of, out_name, options);
+}
+
+#endif
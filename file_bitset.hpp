@@ -0,0 +1,332 @@
+#ifndef FILE_BITSET_HPP
+#define FILE_BITSET_HPP
+
+#include "file_vector.hpp"
+#include "filter.hpp"
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A file backed column of bits, packed 64 to a word. The file is a
+// file_vector<uint64_t> whose first word is the number of bits, followed by
+// the bit words, with bit (i % 64) of word (i / 64) holding bit i. Bits past
+// the end are kept clear, so whole words can be combined and counted.
+//
+// rank and select use a directory of the number of set bits before every
+// 'rank_words' words. It is kept in memory, built when first needed, and
+// extended or rebuilt lazily after the bits change.
+
+class file_bitset {
+    using size_type = size_t;
+
+    static size_type constexpr rank_words = 8;
+
+    file_vector<uint64_t> words;
+
+    mutable vector<uint64_t> ranks;
+    mutable size_type ranked;
+
+    uint64_t* bits() {
+        return words.data() + 1;
+    }
+
+    uint64_t const* bits() const {
+        return words.data() + 1;
+    }
+
+    size_type bit_words() const {
+        return words.size() - 1;
+    }
+
+    void set_size(size_type const n) {
+        size_type const w = (n + 63) / 64;
+        if (w > bit_words()) {
+            words.resize(w + 1, 0);
+        } else if (w < bit_words()) {
+            words.resize(w + 1);
+        }
+        if (n % 64 != 0) {
+            bits()[n / 64] &= (uint64_t(1) << (n % 64)) - 1;
+        }
+        words.front() = n;
+    }
+
+    // Note a change to the bits in word 'w', so the rank directory is
+    // rebuilt from its block.
+    void changed(size_type const w) const {
+        size_type const block = w / rank_words;
+        if (block < ranked) {
+            ranked = block;
+        }
+    }
+
+    // Extend the rank directory to cover block 'block'.
+    void rank_to(size_type const block) const {
+        if (ranks.size() < ranked + 1) {
+            ranks.resize(ranked + 1, 0);
+        }
+        ranks[0] = 0;
+        uint64_t const* const b = bits();
+        size_type const n = bit_words();
+        for (; ranked < block; ++ranked) {
+            uint64_t count = ranks[ranked];
+            size_type const first = ranked * rank_words;
+            size_type const last = min(first + rank_words, n);
+            for (size_type w = first; w < last; ++w) {
+                count += __builtin_popcountll(b[w]);
+            }
+            if (ranks.size() < ranked + 2) {
+                ranks.resize(ranked + 2);
+            }
+            ranks[ranked + 1] = count;
+        }
+    }
+
+    static size_type select_in_word(uint64_t const w, size_type const k) {
+#ifdef __BMI2__
+        return __builtin_ctzll(_pdep_u64(uint64_t(1) << k, w));
+#else
+        uint64_t x = w;
+        for (size_type i = 0; i < k; ++i) {
+            x &= x - 1;
+        }
+        return __builtin_ctzll(x);
+#endif
+    }
+
+public:
+    static int constexpr create_file = file_vector<uint64_t>::create_file;
+
+    file_bitset(string const& name, int mode = 0) : words(name, mode), ranked(0) {
+        if (words.empty()) {
+            words.push_back(0);
+        } else if (words.front() > bit_words() * 64) {
+            throw runtime_error("Bit count is beyond the end of file for file_bitset.");
+        }
+    }
+
+    void close() {
+        words.close();
+        ranks.clear();
+        ranked = 0;
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return words.front();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void resize(size_type const n) {
+        changed(n / 64);
+        set_size(n);
+    }
+
+    void reserve(size_type const n) {
+        words.reserve((n + 63) / 64);
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    bool operator[] (size_type const i) const {
+        assert(i < size());
+
+        return (bits()[i / 64] >> (i % 64)) & 1;
+    }
+
+    bool at(size_type const i) const {
+        if (i >= size()) {
+            throw out_of_range("file_bitset::at(size_type)");
+        }
+        return (*this)[i];
+    }
+
+    void set(size_type const i, bool const value = true) {
+        assert(i < size());
+
+        uint64_t const mask = uint64_t(1) << (i % 64);
+        uint64_t& w = bits()[i / 64];
+        w = value ? (w | mask) : (w & ~mask);
+        changed(i / 64);
+    }
+
+    // The raw words, bit i is bit (i % 64) of word (i / 64).
+    uint64_t const* data() const {
+        return bits();
+    }
+
+    size_type word_count() const {
+        return bit_words();
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(bool const value) {
+        size_type const n = size();
+        if (n % 64 == 0) {
+            words.push_back(0);
+        }
+        bits()[n / 64] |= uint64_t(value) << (n % 64);
+        words.front() = n + 1;
+        changed(n / 64);
+    }
+
+    // Append the low 'count' bits of 'value', count <= 64.
+    void push_back_word(uint64_t const value, size_type const count = 64) {
+        assert(count <= 64);
+
+        if (count == 0) {
+            return;
+        }
+        uint64_t const v = (count == 64) ? value : (value & ((uint64_t(1) << count) - 1));
+        size_type const n = size();
+        size_type const shift = n % 64;
+
+        if (shift == 0) {
+            words.push_back(v);
+        } else {
+            bits()[n / 64] |= v << shift;
+            if (shift + count > 64) {
+                words.push_back(v >> (64 - shift));
+            }
+        }
+        words.front() = n + count;
+        changed(n / 64);
+    }
+
+    void clear() {
+        words.resize(1);
+        words.front() = 0;
+        ranks.clear();
+        ranked = 0;
+    }
+
+    //------------------------------------------------------------------------
+    // Counting, rank and select
+
+    // Number of set bits.
+    size_type count() const {
+        uint64_t const* const b = bits();
+        size_type const n = bit_words();
+        size_type total = 0;
+        for (size_type w = 0; w < n; ++w) {
+            total += __builtin_popcountll(b[w]);
+        }
+        return total;
+    }
+
+    // Number of set bits before bit 'i'.
+    size_type rank(size_type const i) const {
+        assert(i <= size());
+
+        size_type const w = i / 64;
+        size_type const block = w / rank_words;
+        rank_to(block);
+
+        uint64_t const* const b = bits();
+        size_type r = ranks[block];
+        for (size_type j = block * rank_words; j < w; ++j) {
+            r += __builtin_popcountll(b[j]);
+        }
+        if (i % 64 != 0) {
+            r += __builtin_popcountll(b[w] & ((uint64_t(1) << (i % 64)) - 1));
+        }
+        return r;
+    }
+
+    // Position of the set bit with rank 'k' (the k + 1th set bit), or size()
+    // if there are not that many.
+    size_type select(size_type const k) const {
+        size_type const blocks = (bit_words() + rank_words - 1) / rank_words;
+        rank_to(blocks);
+
+        // The last block whose rank is at most k.
+        size_type const block = upper_bound(
+            ranks.begin(), ranks.begin() + blocks + 1, k
+        ) - ranks.begin() - 1;
+        if (block >= blocks) {
+            return size();
+        }
+
+        uint64_t const* const b = bits();
+        size_type remaining = k - ranks[block];
+        size_type const last = min((block + 1) * rank_words, bit_words());
+        for (size_type w = block * rank_words; w < last; ++w) {
+            size_type const c = __builtin_popcountll(b[w]);
+            if (remaining < c) {
+                return w * 64 + select_in_word(b[w], remaining);
+            }
+            remaining -= c;
+        }
+        return size();
+    }
+
+    //------------------------------------------------------------------------
+    // Combining bitsets of the same size
+
+    file_bitset& operator&= (file_bitset const& that) {
+        assert(size() == that.size());
+
+        uint64_t* const a = bits();
+        uint64_t const* const b = that.bits();
+        for (size_type w = 0; w < bit_words(); ++w) {
+            a[w] &= b[w];
+        }
+        changed(0);
+        return *this;
+    }
+
+    file_bitset& operator|= (file_bitset const& that) {
+        assert(size() == that.size());
+
+        uint64_t* const a = bits();
+        uint64_t const* const b = that.bits();
+        for (size_type w = 0; w < bit_words(); ++w) {
+            a[w] |= b[w];
+        }
+        changed(0);
+        return *this;
+    }
+
+    // Clear the bits set in 'that'.
+    file_bitset& and_not(file_bitset const& that) {
+        assert(size() == that.size());
+
+        uint64_t* const a = bits();
+        uint64_t const* const b = that.bits();
+        for (size_type w = 0; w < bit_words(); ++w) {
+            a[w] &= ~b[w];
+        }
+        changed(0);
+        return *this;
+    }
+
+    //------------------------------------------------------------------------
+    // Conversion to and from selections
+
+    void assign(selection const& s) {
+        words.resize(s.word_count() + 1);
+        copy(s.data(), s.data() + s.word_count(), bits());
+        words.front() = s.size();
+        changed(0);
+    }
+
+    selection selected() const {
+        selection s(size());
+        copy(bits(), bits() + bit_words(), s.data());
+        return s;
+    }
+};
+
+#endif
@@ -5,12 +5,20 @@
 #include <stdexcept>
 #include <type_traits>
 #include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <cassert>
+#include <utility>
+#include <thread>
+#include "file_vector_stats.hpp"
+#include "file_vector_snapshot.hpp"
 
 extern "C" {
     #include <unistd.h>
     #include <stdio.h>
     #include <sys/mman.h>
     #include <fcntl.h>
+    #include <linux/falloc.h>
 }
 
 using namespace std;
@@ -19,10 +27,12 @@ using namespace std;
 // The template stops trivial pointers and references,
 // but not ones embedded in structs.
 
-template <typename T, typename = void> class file_vector;
+// The recorder counts the file operations, see file_vector_stats.hpp.
 
-template <typename T>
-class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T>::value)>::type> {
+template <typename T, typename Recorder = file_vector_recorder, typename = void> class file_vector;
+
+template <typename T, typename Recorder>
+class file_vector<T, Recorder, typename enable_if<!(is_pointer<T>::value || is_reference<T>::value)>::type> {
     using value_type = T;
     using reference = T&;
     using const_reference = T const&;
@@ -37,7 +47,7 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
     template<typename U, typename E = void> struct construct;
 
     template<typename U>
-    struct construct<U, typename enable_if<!is_class<U>::value || is_pod<U>::value>::type> {
+    struct construct<U, typename enable_if<!is_class<U>::value || (is_standard_layout<U>::value && is_trivial<U>::value)>::type> {
         static void single(pointer value) {}
         static void single(pointer value, const_reference from) {
             *value = from;
@@ -59,7 +69,7 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
     };
 
     template<typename U>
-    struct construct<U, typename enable_if<is_class<U>::value && !is_pod<U>::value>::type> {
+    struct construct<U, typename enable_if<is_class<U>::value && !(is_standard_layout<U>::value && is_trivial<U>::value)>::type> {
         static void single(pointer value) {
             new (static_cast<void*>(value)) value_type();
         }
@@ -97,13 +107,13 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
     template<typename U, typename E = void> struct destroy;
 
     template<typename U>
-    struct destroy<U, typename enable_if<!is_class<U>::value || is_pod<U>::value>::type> {
+    struct destroy<U, typename enable_if<!is_class<U>::value || (is_standard_layout<U>::value && is_trivial<U>::value)>::type> {
         static void single(pointer value) {}
         static void many(pointer first, pointer last) {}
     };
 
     template<typename U>
-    struct destroy<U, typename enable_if<is_class<U>::value && !is_pod<U>::value>::type> {
+    struct destroy<U, typename enable_if<is_class<U>::value && !(is_standard_layout<U>::value && is_trivial<U>::value)>::type> {
         static void single(pointer value) {
             value->~value_type();
         }
@@ -125,6 +135,238 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
     int fd;
     pointer values;
 
+    // Byte offset of the first element in the file. This is zero unless
+    // elements have been dropped from the front, in which case the dead
+    // prefix is kept as a (punched or collapsed) gap, and the offset is
+    // persisted in a small companion file "<name>.head".
+    size_type head;
+
+    // Set once collapsing the front is found to be unsupported by the
+    // file-system, after which drop_front only punches holes.
+    bool collapse_unsupported;
+
+    // Whether the length is kept in a commit record, and the sequence
+    // number of the last commit.
+    bool committing;
+    uint64_t commit_sequence;
+
+    // With 'fixed_address', the address space the file is mapped into.
+    char* reservation;
+
+    // No space for the empty default recorder. The attribute is standard
+    // from C++20; GCC and Clang honour it in earlier modes too, but other
+    // compilers may give the recorder a byte plus padding below C++20.
+    [[no_unique_address]] Recorder recorder;
+
+    char* mapping() const {
+        return reinterpret_cast<char*>(values) - head;
+    }
+
+    size_type mapping_size() const {
+        return head + reserved * value_size;
+    }
+
+    // Map the first 'bytes' bytes of the file. With 'fixed_address' the
+    // file is mapped at the start of the reserved address space, replacing
+    // whatever was mapped there.
+    void* map_file(size_type const bytes) {
+        if (reservation == nullptr) {
+            return mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (bytes > address_space) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        return mmap(reservation, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    }
+
+    // Unmap 'bytes' bytes mapped at 'base'. With 'fixed_address' they go
+    // back to being reserved.
+    int unmap_file(char* const base, size_type const bytes) {
+        if (reservation == nullptr) {
+            return munmap(base, bytes);
+        }
+        return (mmap(base, bytes, PROT_NONE
+            , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0
+        ) == MAP_FAILED) ? -1 : 0;
+    }
+
+    // Unmap the file, and release any reserved address space.
+    int unmap_all() {
+        if (reservation != nullptr) {
+            int const result = munmap(reservation, address_space);
+            reservation = nullptr;
+            return result;
+        }
+        return munmap(mapping(), mapping_size());
+    }
+
+    // mincore of the pages holding elements [first, last), one byte per
+    // page in 'pages', returning the number of pages.
+    size_type page_residency(size_type const first, size_type const last, vector<unsigned char>& pages) const {
+        assert(first <= last && last <= used);
+
+        pages.clear();
+        if (first == last) {
+            return 0;
+        }
+        size_type const page_size = getpagesize();
+        size_type const begin = (head + first * value_size) / page_size * page_size;
+        size_type const end = head + last * value_size;
+        pages.resize((end - begin + page_size - 1) / page_size);
+        if (mincore(mapping() + begin, end - begin, pages.data()) == -1) {
+            throw runtime_error("Unable to get page residency for file_vector.");
+        }
+        return pages.size();
+    }
+
+    //------------------------------------------------------------------------
+    // The head record. While collapsing the front of the file the record
+    // holds the intended head, the number of bytes being collapsed, and the
+    // file size before the collapse, so that a crash part way through can be
+    // resolved on open by looking at the file size.
+
+    struct head_record {
+        uint64_t head;
+        uint64_t collapsing;
+        uint64_t size_before;
+    };
+
+    string head_name() const {
+        return name + ".head";
+    }
+
+    void read_head_record(size_type const size) {
+        head = 0;
+
+        int const hfd = open(head_name().c_str(), O_RDONLY);
+        if (hfd == -1) {
+            if (errno == ENOENT) {
+                return;
+            }
+            throw runtime_error("Unable to open head record for file_vector.");
+        }
+
+        head_record record {0, 0, 0};
+        ssize_t const n = pread(hfd, &record, sizeof(record), 0);
+        if (::close(hfd) == -1 || n != sizeof(record)) {
+            throw runtime_error("Unable to read head record for file_vector.");
+        }
+
+        head = record.head;
+        if (record.collapsing > 0 && size == record.size_before) {
+            // The collapse never happened, the dead bytes are still there.
+            head += record.collapsing;
+        }
+    }
+
+    void write_head_record(
+        size_type const h, size_type const collapsing = 0, size_type const size_before = 0
+    ) {
+        int const hfd = open(head_name().c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+        if (hfd == -1) {
+            throw runtime_error("Unable to open head record for file_vector.");
+        }
+
+        head_record const record {h, collapsing, size_before};
+        ssize_t const n = pwrite(hfd, &record, sizeof(record), 0);
+        if (n != sizeof(record) || fdatasync(hfd) == -1) {
+            ::close(hfd);
+            throw runtime_error("Unable to write head record for file_vector.");
+        }
+        if (::close(hfd) == -1) {
+            throw runtime_error("Unable to close head record for file_vector.");
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // The commit record. When committing, the length of the vector only
+    // becomes durable when it is committed: the elements are flushed, and
+    // then the end of the elements (a byte offset in the file) is written to
+    // a small companion file "<name>.commit" and synced. On open the vector
+    // is recovered to the last committed end, so slots that were reserved
+    // but not committed before a crash never become elements. The record
+    // has two slots, written alternately with an increasing sequence number
+    // and a checksum, so a torn write leaves the previous commit intact.
+
+    struct commit_record {
+        uint64_t sequence;
+        uint64_t end;
+        uint64_t checksum;
+    };
+
+    string commit_name() const {
+        return name + ".commit";
+    }
+
+    static uint64_t commit_checksum(uint64_t const sequence, uint64_t const end) {
+        uint64_t x = (sequence + 0x66696c65766563ull) * 0x9e3779b97f4a7c15ull ^ end;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // Reads the committed end, if there is a commit record, setting
+    // 'committing' and 'commit_sequence'.
+    size_type read_commit_record(size_type const size) {
+        commit_sequence = 0;
+
+        int const cfd = open(commit_name().c_str(), O_RDONLY);
+        if (cfd == -1) {
+            if (errno == ENOENT) {
+                return size;
+            }
+            throw runtime_error("Unable to open commit record for file_vector.");
+        }
+
+        commit_record slots[2] {};
+        ssize_t const n = pread(cfd, slots, sizeof(slots), 0);
+        if (::close(cfd) == -1 || n == -1) {
+            throw runtime_error("Unable to read commit record for file_vector.");
+        }
+
+        size_type end = 0;
+        bool found = false;
+        for (size_type i = 0; i < 2; ++i) {
+            commit_record const& r = slots[i];
+            if (static_cast<size_type>(n) >= (i + 1) * sizeof(commit_record)
+                && r.checksum == commit_checksum(r.sequence, r.end)
+                && (!found || r.sequence > commit_sequence)
+            ) {
+                found = true;
+                commit_sequence = r.sequence;
+                end = r.end;
+            }
+        }
+        if (!found) {
+            throw runtime_error("No valid commit record for file_vector.");
+        }
+        committing = true;
+        return end;
+    }
+
+    void write_commit_record(size_type const end) {
+        int const cfd = open(commit_name().c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+        if (cfd == -1) {
+            throw runtime_error("Unable to open commit record for file_vector.");
+        }
+
+        uint64_t const sequence = commit_sequence + 1;
+        commit_record const record {sequence, end, commit_checksum(sequence, end)};
+        ssize_t const n = pwrite(cfd, &record, sizeof(record), (sequence % 2) * sizeof(record));
+        if (n != sizeof(record) || fdatasync(cfd) == -1) {
+            ::close(cfd);
+            throw runtime_error("Unable to write commit record for file_vector.");
+        }
+        if (::close(cfd) == -1) {
+            throw runtime_error("Unable to close commit record for file_vector.");
+        }
+        commit_sequence = sequence;
+        committing = true;
+    }
+
+    //------------------------------------------------------------------------
+
     void map_file_into_memory() {
         int flags = O_RDWR;
         if (mode & create_file) {
@@ -136,7 +378,7 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
             throw runtime_error("Unable to open file for file_vector.");
         }
 
-        size_type size = lseek(fd, 0, SEEK_END);
+        off_t const size = lseek(fd, 0, SEEK_END);
 
         if (size == -1) {
             if (::close(fd) == -1) {
@@ -147,20 +389,46 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
             throw runtime_error("Unanble to get length of file for file_vector.");
         }
 
-        used = size / value_size;
-        reserved = size / value_size;
+        read_head_record(size);
+
+        if (head > static_cast<size_type>(size)) {
+            ::close(fd);
+            throw runtime_error("Head record is beyond the end of file for file_vector.");
+        }
+
+        size_type end = size;
+        try {
+            end = min(read_commit_record(size), end);
+        } catch (...) {
+            ::close(fd);
+            fd = -1;
+            throw;
+        }
+        used = (end > head) ? (end - head) / value_size : 0;
+        reserved = (size - head) / value_size;
+
+        if (mode & fixed_address) {
+            void* const space = mmap(nullptr, address_space, PROT_NONE
+                , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+            );
+            if (space == MAP_FAILED) {
+                ::close(fd);
+                fd = -1;
+                throw runtime_error("Unable to reserve address space for file_vector.");
+            }
+            reservation = static_cast<char*>(space);
+        }
 
         // Posix does not allow mmap of zero size.
-        if (reserved > 0) {
-            values = static_cast<pointer>(mmap(nullptr
-            , reserved * value_size
-            , PROT_READ | PROT_WRITE
-            , MAP_SHARED
-            , fd
-            , 0
-            ));
-
-            if (values == nullptr) {
+        if (mapping_size() > 0) {
+            void* const base = recorder.timed(file_vector_stats::mmap_op, [this] {
+                return map_file(mapping_size());
+            });
+
+            if (base == MAP_FAILED) {
+                if (reservation != nullptr) {
+                    unmap_all();
+                }
                 if (::close(fd) == -1) {
                     throw runtime_error("Unanble close file after failing "
                         "to mmap file for file_vector."
@@ -168,6 +436,12 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
                 }
                 throw runtime_error("Unable to mmap file for file_vector.");
             }
+
+            values = reinterpret_cast<pointer>(static_cast<char*>(base) + head);
+        }
+
+        if ((mode & commit_appends) && !committing) {
+            write_commit_record(head + used * value_size);
         }
     }
 
@@ -183,42 +457,49 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
             return;
         }
 
+        size_type const new_size = head + size * value_size;
+        [[maybe_unused]] auto const faults = recorder.sample_faults();
+
         // First, resize the file.
-        if (ftruncate(fd, size * value_size) == -1) {
+        if (recorder.timed(file_vector_stats::ftruncate_op, [this, new_size] {
+            return ftruncate(fd, new_size);
+        }) == -1) {
             throw runtime_error("Unanble to extend memory for file_vector resize.");
         }
 
         // Second, map the resized file to a new address, sharing the elements.
-        pointer new_values = nullptr;
-        if (size > 0) {
-            new_values = static_cast<pointer>(mmap(nullptr
-            , size * value_size
-            , PROT_READ | PROT_WRITE
-            , MAP_SHARED
-            , fd
-            , 0
-            ));
-
-            if (new_values == nullptr) {
+        // With 'fixed_address' it is mapped in place of the old mapping.
+        char* new_base = nullptr;
+        if (new_size > 0) {
+            void* const base = recorder.timed(file_vector_stats::mmap_op, [this, new_size] {
+                return map_file(new_size);
+            });
+
+            if (base == MAP_FAILED) {
                 throw runtime_error("Unable to mmap file for file_vector resize.");
             }
+            new_base = static_cast<char*>(base);
         }
 
-        // Third, unmap the file from the old address.
-        if (reserved > 0) {
-            if (values != nullptr && munmap(values, reserved * value_size) == -1) {
-                if (new_values != nullptr && munmap(new_values, size) == -1) {
-                    throw runtime_error(
-                        "Unable to munmap file while "
-                        "handling failed munmap for file_vector."
-                    );
-                };
-                throw runtime_error("Unable to munmap file for file_vector resize.");
-            }
+        // Third, unmap the file from the old address, or what the new mapping
+        // did not replace of it.
+        size_type const kept = (reservation == nullptr) ? 0 : min(new_size, mapping_size());
+        if (values != nullptr && mapping_size() > kept && recorder.timed(file_vector_stats::munmap_op, [this, kept] {
+            return unmap_file(mapping() + kept, mapping_size() - kept);
+        }) == -1) {
+            if (reservation == nullptr && new_base != nullptr && munmap(new_base, new_size) == -1) {
+                throw runtime_error(
+                    "Unable to munmap file while "
+                    "handling failed munmap for file_vector."
+                );
+            };
+            throw runtime_error("Unable to munmap file for file_vector resize.");
         }
 
         // Finally, update the class.
-        values = new_values;
+        recorder.remapped(mapping_size(), new_size);
+        values = (new_base == nullptr) ? nullptr
+            : reinterpret_cast<pointer>(new_base + head);
         reserved = size;
     }
 
@@ -230,18 +511,130 @@ class file_vector<T, typename enable_if<!(is_pointer<T>::value || is_reference<T
         return capacity;
     }
 
+    //------------------------------------------------------------------------
+    // Gives the disk blocks of whole pages in front of the head back to the
+    // file-system. Pages that became dead since 'old_head' have holes punched
+    // in them, which only drops their page-cache. Once the dead prefix is at
+    // least as large as the live part of the file it is collapsed out of the
+    // file where the file-system supports it, moving the head back into the
+    // first page. Collapsing drops the page-cache for the whole file, so
+    // waiting for the prefix to grow this large keeps the cost amortised.
+
+    bool collapse_front(size_type const whole) {
+        size_type const size_before = mapping_size();
+        write_head_record(head - whole, whole, size_before);
+
+        if (recorder.timed(file_vector_stats::munmap_op, [this, size_before] {
+            return unmap_file(mapping(), size_before);
+        }) == -1) {
+            throw runtime_error("Unable to munmap file for file_vector drop_front.");
+        }
+        values = nullptr;
+
+        bool const collapsed = fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, 0, whole) == 0;
+        if (collapsed) {
+            head -= whole;
+        } else if (errno == EOPNOTSUPP) {
+            collapse_unsupported = true;
+        }
+        write_head_record(head);
+
+        void* const base = recorder.timed(file_vector_stats::mmap_op, [this] {
+            return map_file(mapping_size());
+        });
+
+        if (base == MAP_FAILED) {
+            throw runtime_error("Unable to mmap file for file_vector drop_front.");
+        }
+        values = reinterpret_cast<pointer>(static_cast<char*>(base) + head);
+        return collapsed;
+    }
+
+    void release_front(size_type const old_head) {
+        size_type const page_size = getpagesize();
+        size_type const first = old_head / page_size * page_size;
+        size_type const whole = head / page_size * page_size;
+
+        if (whole > first && fallocate(fd
+            , FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE
+            , first
+            , whole - first
+        ) == -1 && errno != EOPNOTSUPP) {
+            throw runtime_error("Unable to punch hole for file_vector drop_front.");
+        }
+
+        // Collapsing would move the committed end, so only holes are
+        // punched when committing.
+        if (!committing && !collapse_unsupported && whole > 0 && whole >= reserved * value_size) {
+            collapse_front(whole);
+        }
+    }
+
+    // Move the head of an empty vector back to the start of the file,
+    // keeping the reserved capacity.
+    void reset_head() {
+        assert(used == 0);
+
+        // A committed end before the head is empty whichever head is read.
+        if (committing) {
+            write_commit_record(0);
+        }
+        size_type const size_before = mapping_size();
+        if (values != nullptr && recorder.timed(file_vector_stats::munmap_op, [this, size_before] {
+            return unmap_file(mapping(), size_before);
+        }) == -1) {
+            throw runtime_error("Unable to munmap file for file_vector clear.");
+        }
+        values = nullptr;
+
+        head = 0;
+        write_head_record(head);
+        if (recorder.timed(file_vector_stats::ftruncate_op, [this] {
+            return ftruncate(fd, mapping_size());
+        }) == -1) {
+            throw runtime_error("Unable to resize file for file_vector clear.");
+        }
+
+        if (mapping_size() > 0) {
+            void* const base = recorder.timed(file_vector_stats::mmap_op, [this] {
+                return map_file(mapping_size());
+            });
+            if (base == MAP_FAILED) {
+                throw runtime_error("Unable to mmap file for file_vector clear.");
+            }
+            values = static_cast<pointer>(base);
+        }
+        recorder.remapped(size_before, mapping_size());
+    }
+
 public:
     static int constexpr create_file = 1;
 
+    // Keep the length in a commit record, see commit.
+    static int constexpr commit_appends = 2;
+
+    // Map the file into 'address_space' bytes of address space reserved on
+    // open, growing it in place, so the elements never move while the file
+    // is open, see persistent_arena.hpp.
+    static int constexpr fixed_address = 4;
+    static size_type constexpr address_space = size_type(1) << 38;
+
     void close() {
-        if (values != nullptr) {
-            if (munmap(values, reserved * value_size) == -1) {
+        if (committing && fd != -1) {
+            commit();
+        }
+        if (values != nullptr || reservation != nullptr) {
+            if (recorder.timed(file_vector_stats::munmap_op, [this] {
+                return unmap_all();
+            }) == -1) {
                 throw runtime_error("Unable to munmap file when closing file_vector.");
             }
             values = nullptr;
         }
         if (fd != -1) {
-            if (ftruncate(fd, used * value_size) == -1) {
+            if (recorder.timed(file_vector_stats::ftruncate_op, [this] {
+                return ftruncate(fd, head + used * value_size);
+            }) == -1) {
                 throw runtime_error("Unable to resize file when closing file_vector.");
             }
             if (::close(fd) == -1) {
@@ -251,16 +644,27 @@ public:
         }
         reserved = 0;
         used = 0;
+        head = 0;
+        collapse_unsupported = false;
+        committing = false;
+        commit_sequence = 0;
     }
 
     virtual ~file_vector() noexcept {
+        if (committing && fd != -1) {
+            try {
+                commit();
+            } catch (...) {
+                // ignore.
+            }
+        }
         if (values != nullptr) {
             if (values != nullptr) {
-                munmap(values, reserved);
+                unmap_all();
                 values = nullptr;
             }
             if (fd != -1) {
-                if (ftruncate(fd, used * value_size) == -1) {
+                if (ftruncate(fd, head + used * value_size) == -1) {
                     // ignore.
                 }
                 ::close(fd);
@@ -269,6 +673,9 @@ public:
             reserved = 0;
             used = 0;
         }
+        if (reservation != nullptr) {
+            unmap_all();
+        }
     }
 
     //------------------------------------------------------------------------
@@ -280,25 +687,29 @@ public:
     // file_vector<T> dst_file("dst_file", file_vector<T>("src_file"));
     
     file_vector(string const& name, int mode = 0)
-    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr) {
+    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr), head(0)
+    , collapse_unsupported(false), committing(false), commit_sequence(0), reservation(nullptr) {
         map_file_into_memory();
     }
 
     file_vector(string const& name, size_t n, int mode = 0)
-    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr) {
+    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr), head(0)
+    , collapse_unsupported(false), committing(false), commit_sequence(0), reservation(nullptr) {
         map_file_into_memory();
         assign(n);
     }
 
     file_vector(string const& name, size_t n, const_reference value, int mode = 0)
-     : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr) {
+     : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr), head(0)
+    , collapse_unsupported(false), committing(false), commit_sequence(0), reservation(nullptr) {
         map_file_into_memory();
         assign(n, value);
     }
 
     template <typename InputIterator>
     file_vector(string const& name, InputIterator first, InputIterator last, int mode = 0)
-    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr) {
+    : mode(mode), name(name), reserved(0), used(0), fd(-1), values(nullptr), head(0)
+    , collapse_unsupported(false), committing(false), commit_sequence(0), reservation(nullptr) {
         assert (first <= last);
 
         map_file_into_memory();
@@ -750,7 +1161,7 @@ public:
         if (size < used) {
             destroy<value_type>::many(values + size, values + used);
         } else if (size > used) {
-            reserve(size);
+            reserve(size - used);
             construct<value_type>::many(values + used, values + size);
         }
 
@@ -842,6 +1253,149 @@ public:
         return values;
     }
 
+    // The file, and the byte offset of the first element in it, for readers
+    // that bypass the mapping.
+    string const& file_name() const noexcept {
+        return name;
+    }
+
+    size_type file_offset() const noexcept {
+        return head;
+    }
+
+    // A read-only view of the elements as they are now, unaffected by later
+    // changes to the vector, see file_vector_snapshot.hpp.
+    file_vector_snapshot<value_type> snapshot() const {
+        return file_vector_snapshot<value_type>(fd, name, head, used);
+    }
+
+    //------------------------------------------------------------------------
+    // Residency, how much of the vector is in the page-cache, from mincore
+    // over the mapping.
+
+    // Fraction of the pages holding elements [first, last) that are
+    // resident.
+    double resident_ratio(size_type const first, size_type const last) const {
+        vector<unsigned char> pages;
+        size_type const n = page_residency(first, last, pages);
+        if (n == 0) {
+            return 1.0;
+        }
+        size_type resident = 0;
+        for (unsigned char const p : pages) {
+            resident += p & 1;
+        }
+        return static_cast<double>(resident) / n;
+    }
+
+    double resident_ratio() const {
+        return resident_ratio(0, used);
+    }
+
+    // The ranges [a, b) of elements within [first, last) whose pages are
+    // all resident.
+    vector<pair<size_type, size_type>> resident_ranges(size_type const first, size_type const last) const {
+        vector<pair<size_type, size_type>> ranges;
+        vector<unsigned char> pages;
+        size_type const n = page_residency(first, last, pages);
+        size_type const page_size = getpagesize();
+        size_type const page0 = (head + first * value_size) / page_size;
+
+        for (size_type p = 0; p < n;) {
+            if ((pages[p] & 1) == 0) {
+                ++p;
+                continue;
+            }
+            size_type q = p;
+            while (q < n && (pages[q] & 1) != 0) {
+                ++q;
+            }
+            // Elements lying wholly within resident pages [p, q).
+            size_type const begin_byte = (page0 + p) * page_size;
+            size_type const end_byte = (page0 + q) * page_size;
+            size_type const a = max(first,
+                (begin_byte <= head) ? 0 : (begin_byte - head + value_size - 1) / value_size
+            );
+            size_type const b = min(last, (end_byte - head) / value_size);
+            if (a < b) {
+                ranges.emplace_back(a, b);
+            }
+            p = q;
+        }
+        return ranges;
+    }
+
+    // Read the missing pages of elements [first, last) into the page-cache,
+    // with up to 'threads' threads each faulting in a share of them. Returns
+    // the number of pages that were missing.
+    size_type warm(size_type const first, size_type const last, unsigned const threads = 4) {
+        vector<unsigned char> pages;
+        size_type const n = page_residency(first, last, pages);
+        size_type const page_size = getpagesize();
+        char* const base = mapping() + (head + first * value_size) / page_size * page_size;
+
+        vector<size_type> missing;
+        for (size_type p = 0; p < n; ++p) {
+            if ((pages[p] & 1) == 0) {
+                missing.push_back(p);
+            }
+        }
+        if (missing.empty()) {
+            return 0;
+        }
+
+        auto const fault = [base, page_size, &missing](size_type const from, size_type const to) {
+            for (size_type i = from; i < to;) {
+                // Runs of consecutive missing pages are populated together.
+                size_type j = i + 1;
+                while (j < to && missing[j] == missing[j - 1] + 1) {
+                    ++j;
+                }
+                char* const p = base + missing[i] * page_size;
+#ifdef MADV_POPULATE_READ
+                if (madvise(p, (j - i) * page_size, MADV_POPULATE_READ) == 0) {
+                    i = j;
+                    continue;
+                }
+#endif
+                for (; i < j; ++i) {
+                    *static_cast<char const volatile*>(base + missing[i] * page_size);
+                }
+            }
+        };
+
+        size_type const shares = max(min(static_cast<size_type>(threads), missing.size()), size_type(1));
+        vector<thread> workers;
+        for (size_type s = 1; s < shares; ++s) {
+            workers.emplace_back(fault, missing.size() * s / shares, missing.size() * (s + 1) / shares);
+        }
+        fault(0, missing.size() / shares);
+        for (thread& t : workers) {
+            t.join();
+        }
+        return missing.size();
+    }
+
+    size_type warm(unsigned const threads = 4) {
+        return warm(0, used, threads);
+    }
+
+    //------------------------------------------------------------------------
+    // Instrumentation, counted with file_vector_counting_recorder (see
+    // file_vector_stats.hpp), and otherwise all zero apart from the bytes
+    // reserved and used.
+
+    file_vector_stats stats() const {
+        file_vector_stats s = recorder.stats();
+        s.reserved_bytes = reserved * value_size;
+        s.used_bytes = used * value_size;
+        return s;
+    }
+
+    void reset_stats() {
+        recorder.reset();
+    }
+
     //------------------------------------------------------------------------
     // Modifiers
     
@@ -923,9 +1477,64 @@ public:
         destroy<value_type>::single(values + (used--));
     }
 
+    // Remove all elements. If elements were dropped from the front, the
+    // head is moved back to the start of the file, and when committing the
+    // empty vector is committed first, as the last commit would not survive
+    // the move.
     void clear() {
         destroy<value_type>::many(values, values + used);
         used = 0;
+        if (head > 0) {
+            reset_head();
+        }
+    }
+
+    // Write the elements back to the file, and wait for the writes to
+    // complete.
+    void flush() {
+        if (values == nullptr) {
+            return;
+        }
+        [[maybe_unused]] auto const faults = recorder.sample_faults();
+        if (recorder.timed(file_vector_stats::flush_op, [this] {
+            return msync(mapping(), head + used * value_size, MS_SYNC);
+        }) == -1) {
+            throw runtime_error("Unable to flush file for file_vector.");
+        }
+    }
+
+    // Make the current length durable: flush the elements, then record
+    // where they end. Until the next commit, reopening after a crash
+    // recovers the vector to this length. This is not a transaction, writes
+    // to existing elements are not undone. Committing starts with the first
+    // commit, or on open with 'commit_appends', and continues for the file
+    // from then on, with close committing too.
+    void commit() {
+        flush();
+        write_commit_record(head + used * value_size);
+    }
+
+    // Remove the first 'n' elements without moving the rest. The new first
+    // element's offset is persisted, and the disk blocks under the dropped
+    // elements are released, so expiring old data costs the same however
+    // long the vector is.
+    void drop_front(size_type const n) {
+        assert(n <= used);
+
+        if (n == 0) {
+            return;
+        }
+
+        size_type const old_head = head;
+
+        destroy<value_type>::many(values, values + n);
+        values += n;
+        head += n * value_size;
+        reserved -= n;
+        used -= n;
+
+        write_head_record(head);
+        release_front(old_head);
     }
 
     //------------------------------------------------------------------------
@@ -1117,10 +1726,13 @@ public:
     }
 };
 
-template <typename T> void swap (file_vector<T>& a, file_vector<T>& b) {
+template <typename T, typename R> void swap (file_vector<T, R>& a, file_vector<T, R>& b) {
     vector<T> tmp(a);
     a = b;
     b = tmp;
 }
 
+// A file_vector that counts its file operations, see stats.
+template <typename T> using counted_file_vector = file_vector<T, file_vector_counting_recorder>;
+
 #endif
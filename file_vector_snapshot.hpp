@@ -0,0 +1,196 @@
+#ifndef FILE_VECTOR_SNAPSHOT_HPP
+#define FILE_VECTOR_SNAPSHOT_HPP
+
+#include <string>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+
+extern "C" {
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/ioctl.h>
+    #include <fcntl.h>
+    #include <linux/fs.h>
+}
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A read-only view of the elements of a file_vector, frozen when it was
+// taken, for long running reads while the vector carries on changing.
+//
+// Mapping the vector's own file MAP_PRIVATE is not enough: pages of a
+// private mapping that have not been copied show later writes to the file.
+// The snapshot is instead a copy of the file, made with a reflink
+// (FICLONE) where the file-system supports it, which shares the file's
+// blocks and takes time independent of its size, so only the blocks
+// written afterwards take space. Elsewhere the elements are copied with
+// copy_file_range, which is proportional to the size of the vector. The
+// copy is unlinked as soon as it is mapped, so it goes when the snapshot
+// does.
+
+template <typename T>
+class file_vector_snapshot {
+    using size_type = size_t;
+
+    char const* base;
+    size_type mapped;
+    T const* values;
+    size_type used;
+    bool shared;
+
+    // Copy bytes [first, last) of 'from' to 'to', returning whether the
+    // blocks are shared.
+    static bool clone(int const from, int const to, size_type const first, size_type const last) {
+        if (ioctl(to, FICLONE, from) == 0) {
+            return true;
+        }
+        loff_t in = first;
+        loff_t out = first;
+        while (static_cast<size_type>(in) < last) {
+            ssize_t const n = copy_file_range(from, &in, to, &out, last - in, 0);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Unable to copy file for file_vector_snapshot.");
+            }
+        }
+        return false;
+    }
+
+    void release() noexcept {
+        if (base != nullptr) {
+            munmap(const_cast<char*>(base), mapped);
+        }
+        base = nullptr;
+        mapped = 0;
+        values = nullptr;
+        used = 0;
+    }
+
+public:
+    file_vector_snapshot() noexcept
+    : base(nullptr), mapped(0), values(nullptr), used(0), shared(false) {}
+
+    // Snapshot 'count' elements starting 'offset' bytes into the file 'fd',
+    // which is called 'name'. The copy is made next to the file, as a
+    // reflink needs the same file-system.
+    file_vector_snapshot(int const fd, string const& name, size_type const offset, size_type const count)
+    : base(nullptr), mapped(offset + count * sizeof(T)), values(nullptr), used(count), shared(false) {
+        string copy_name = name + ".snapshot-XXXXXX";
+        int const copy = mkstemp(&copy_name[0]);
+        if (copy == -1) {
+            throw runtime_error("Unable to create file for file_vector_snapshot.");
+        }
+        unlink(copy_name.c_str());
+
+        try {
+            size_type const page_size = getpagesize();
+            shared = clone(fd, copy, offset / page_size * page_size, mapped);
+        } catch (...) {
+            ::close(copy);
+            throw;
+        }
+
+        if (mapped > 0) {
+            void* const p = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE, copy, 0);
+            if (p == MAP_FAILED) {
+                ::close(copy);
+                throw runtime_error("Unable to mmap file for file_vector_snapshot.");
+            }
+            base = static_cast<char const*>(p);
+            values = reinterpret_cast<T const*>(base + offset);
+        }
+        ::close(copy);
+    }
+
+    file_vector_snapshot(file_vector_snapshot&& that) noexcept
+    : base(that.base), mapped(that.mapped), values(that.values), used(that.used), shared(that.shared) {
+        that.base = nullptr;
+        that.release();
+    }
+
+    file_vector_snapshot& operator= (file_vector_snapshot&& that) noexcept {
+        if (this != &that) {
+            release();
+            base = that.base;
+            mapped = that.mapped;
+            values = that.values;
+            used = that.used;
+            shared = that.shared;
+            that.base = nullptr;
+            that.release();
+        }
+        return *this;
+    }
+
+    file_vector_snapshot(file_vector_snapshot const&) = delete;
+    file_vector_snapshot& operator= (file_vector_snapshot const&) = delete;
+
+    ~file_vector_snapshot() noexcept {
+        release();
+    }
+
+    // Whether the snapshot shares blocks with the file, through a reflink,
+    // rather than being a copy.
+    bool cloned() const {
+        return shared;
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return used;
+    }
+
+    bool empty() const {
+        return used == 0;
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    T const& operator[] (size_type const i) const {
+        assert(i < used);
+
+        return values[i];
+    }
+
+    T const& at(size_type const i) const {
+        if (i >= used) {
+            throw out_of_range("file_vector_snapshot::at(size_t)");
+        }
+        return values[i];
+    }
+
+    T const& front() const {
+        assert(used > 0);
+
+        return values[0];
+    }
+
+    T const& back() const {
+        assert(used > 0);
+
+        return values[used - 1];
+    }
+
+    T const* data() const noexcept {
+        return values;
+    }
+
+    T const* begin() const noexcept {
+        return values;
+    }
+
+    T const* end() const noexcept {
+        return values + used;
+    }
+};
+
+#endif
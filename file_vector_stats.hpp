@@ -0,0 +1,137 @@
+#ifndef FILE_VECTOR_STATS_HPP
+#define FILE_VECTOR_STATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+extern "C" {
+    #include <sys/resource.h>
+}
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Counters kept by a file_vector: the number of remaps and the bytes the
+// file grew by, the calls to and time spent in ftruncate, mmap, munmap and
+// flush, and the minor and major page faults taken during those operations,
+// sampled with getrusage. Reserved and used bytes are filled in when the
+// stats are read.
+
+struct file_vector_stats {
+    enum operation {ftruncate_op, mmap_op, munmap_op, flush_op, operations};
+
+    uint64_t remaps;
+    uint64_t bytes_grown;
+    uint64_t calls[operations];
+    uint64_t ns[operations];
+    uint64_t max_ns[operations];
+    uint64_t minor_faults;
+    uint64_t major_faults;
+    uint64_t reserved_bytes;
+    uint64_t used_bytes;
+
+    static char const* operation_name(int const op) {
+        static char const* const names[operations] = {"ftruncate", "mmap", "munmap", "flush"};
+        return names[op];
+    }
+
+    string json() const {
+        string s = "{\"remaps\": " + to_string(remaps)
+            + ", \"bytes_grown\": " + to_string(bytes_grown);
+        for (int op = 0; op < operations; ++op) {
+            s += ", \"" + string(operation_name(op)) + "\": {\"calls\": " + to_string(calls[op])
+                + ", \"ns\": " + to_string(ns[op])
+                + ", \"max_ns\": " + to_string(max_ns[op]) + "}";
+        }
+        return s + ", \"minor_faults\": " + to_string(minor_faults)
+            + ", \"major_faults\": " + to_string(major_faults)
+            + ", \"reserved_bytes\": " + to_string(reserved_bytes)
+            + ", \"used_bytes\": " + to_string(used_bytes) + "}";
+    }
+};
+
+//----------------------------------------------------------------------------
+// The recorders a file_vector counts through, its second template argument.
+// The default, file_vector_recorder, is empty and its methods do nothing, so
+// instrumented code compiles to what it would be without instrumentation.
+// file_vector_counting_recorder counts, and counted_file_vector<T> (in
+// file_vector.hpp) is a file_vector with it.
+
+class file_vector_recorder {
+public:
+    template <typename F> auto timed(file_vector_stats::operation, F f) -> decltype(f()) {
+        return f();
+    }
+
+    void remapped(uint64_t, uint64_t) {}
+
+    struct fault_sample {};
+
+    fault_sample sample_faults() {
+        return fault_sample();
+    }
+
+    file_vector_stats stats() const {
+        return file_vector_stats();
+    }
+
+    void reset() {}
+};
+
+class file_vector_counting_recorder {
+    file_vector_stats counts;
+
+public:
+    file_vector_counting_recorder() : counts() {}
+
+    // Call 'f', counting it as 'op'.
+    template <typename F> auto timed(file_vector_stats::operation const op, F f) -> decltype(f()) {
+        auto const start = chrono::steady_clock::now();
+        auto const result = f();
+        uint64_t const ns = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start
+        ).count();
+        ++counts.calls[op];
+        counts.ns[op] += ns;
+        counts.max_ns[op] = (ns > counts.max_ns[op]) ? ns : counts.max_ns[op];
+        return result;
+    }
+
+    void remapped(uint64_t const old_bytes, uint64_t const new_bytes) {
+        ++counts.remaps;
+        counts.bytes_grown += (new_bytes > old_bytes) ? new_bytes - old_bytes : 0;
+    }
+
+    // Adds the page faults taken by this thread during its lifetime.
+    class fault_sample {
+        file_vector_counting_recorder& recorder;
+        rusage before;
+
+    public:
+        explicit fault_sample(file_vector_counting_recorder& recorder) : recorder(recorder) {
+            getrusage(RUSAGE_THREAD, &before);
+        }
+
+        ~fault_sample() {
+            rusage after;
+            getrusage(RUSAGE_THREAD, &after);
+            recorder.counts.minor_faults += after.ru_minflt - before.ru_minflt;
+            recorder.counts.major_faults += after.ru_majflt - before.ru_majflt;
+        }
+    };
+
+    fault_sample sample_faults() {
+        return fault_sample(*this);
+    }
+
+    file_vector_stats stats() const {
+        return counts;
+    }
+
+    void reset() {
+        counts = file_vector_stats();
+    }
+};
+
+#endif
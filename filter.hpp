@@ -0,0 +1,283 @@
+#ifndef FILTER_HPP
+#define FILTER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "file_vector.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// The rows of a column selected by a predicate, as a bitmap with bit
+// (i % 64) of word (i / 64) set when row i is selected. Bits past the end of
+// the column are always clear, so selections can be combined word by word.
+
+class selection {
+    size_t rows;
+    vector<uint64_t> words;
+
+public:
+    explicit selection(size_t const rows = 0)
+    : rows(rows), words((rows + 63) / 64, 0) {}
+
+    selection(size_t const rows, vector<uint64_t>&& words)
+    : rows(rows), words(move(words)) {
+        assert(this->words.size() == (rows + 63) / 64);
+    }
+
+    size_t size() const {
+        return rows;
+    }
+
+    uint64_t const* data() const {
+        return words.data();
+    }
+
+    uint64_t* data() {
+        return words.data();
+    }
+
+    size_t word_count() const {
+        return words.size();
+    }
+
+    bool test(size_t const i) const {
+        assert(i < rows);
+
+        return (words[i / 64] >> (i % 64)) & 1;
+    }
+
+    void set(size_t const i) {
+        assert(i < rows);
+
+        words[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    // Number of selected rows.
+    size_t count() const {
+        size_t n = 0;
+        for (uint64_t const w : words) {
+            n += __builtin_popcountll(w);
+        }
+        return n;
+    }
+
+    selection& operator&= (selection const& that) {
+        assert(rows == that.rows);
+
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] &= that.words[i];
+        }
+        return *this;
+    }
+
+    selection& operator|= (selection const& that) {
+        assert(rows == that.rows);
+
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] |= that.words[i];
+        }
+        return *this;
+    }
+
+    // Remove the rows selected in 'that'.
+    selection& and_not(selection const& that) {
+        assert(rows == that.rows);
+
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] &= ~that.words[i];
+        }
+        return *this;
+    }
+
+    // Call 'f(i)' for each selected row, in order.
+    template <typename F> void for_each(F f) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                f(w * 64 + __builtin_ctzll(bits));
+            }
+        }
+    }
+
+    // The selected rows as an index vector.
+    template <typename Index = uint32_t> vector<Index> indices() const {
+        vector<Index> out;
+        out.reserve(count());
+        for_each([&out](size_t const i) {
+            out.push_back(static_cast<Index>(i));
+        });
+        return out;
+    }
+};
+
+inline selection operator& (selection a, selection const& b) {
+    return a &= b;
+}
+
+inline selection operator| (selection a, selection const& b) {
+    return a |= b;
+}
+
+//----------------------------------------------------------------------------
+// Predicate kernels. Each chunk of 64 rows is compared into a byte per row,
+// which the compiler vectorises, and the bytes are packed into the chunk's
+// bitmap word.
+
+inline uint64_t pack_bits(uint8_t const* bytes, size_t const n) {
+#ifdef __AVX2__
+    if (n == 64) {
+        __m256i const low = _mm256_slli_epi16(
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(bytes)), 7
+        );
+        __m256i const high = _mm256_slli_epi16(
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(bytes + 32)), 7
+        );
+        return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(low)))
+            | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(high))) << 32);
+    }
+#endif
+    uint64_t word = 0;
+    for (size_t j = 0; j < n; ++j) {
+        word |= static_cast<uint64_t>(bytes[j]) << j;
+    }
+    return word;
+}
+
+// Select the rows of 'values' for which 'p' is true, 'p' must be cheap and
+// free of side effects, as it is evaluated on every row.
+template <typename T, typename P>
+selection select_if(T const* values, size_t const n, P p) {
+    selection s(n);
+    uint64_t* const out = s.data();
+    uint8_t bytes[64];
+
+    for (size_t w = 0; w * 64 < n; ++w) {
+        T const* const chunk = values + w * 64;
+        size_t const m = (n - w * 64 < 64) ? n - w * 64 : 64;
+        for (size_t j = 0; j < m; ++j) {
+            bytes[j] = p(chunk[j]);
+        }
+        out[w] = pack_bits(bytes, m);
+    }
+    return s;
+}
+
+// Rows with lo <= value <= hi.
+template <typename T>
+selection select_between(T const* values, size_t const n, T const lo, T const hi) {
+    static_assert(is_arithmetic<T>::value, "select_between needs an arithmetic type.");
+
+    return select_if(values, n, [lo, hi](T const x) {
+        return (x >= lo) & (x <= hi);
+    });
+}
+
+template <typename T>
+selection select_equal(T const* values, size_t const n, T const value) {
+    static_assert(is_arithmetic<T>::value, "select_equal needs an arithmetic type.");
+
+    return select_if(values, n, [value](T const x) {
+        return x == value;
+    });
+}
+
+// Rows equal to one of the values in [first, last). Short lists are
+// compared directly, long ones are sorted and searched.
+template <typename T, typename I>
+selection select_in(T const* values, size_t const n, I first, I last) {
+    static_assert(is_arithmetic<T>::value, "select_in needs an arithmetic type.");
+
+    vector<T> list(first, last);
+    sort(list.begin(), list.end());
+    list.erase(unique(list.begin(), list.end()), list.end());
+
+    if (list.size() <= 16) {
+        T const* const l = list.data();
+        size_t const k = list.size();
+        return select_if(values, n, [l, k](T const x) {
+            bool found = false;
+            for (size_t i = 0; i < k; ++i) {
+                found |= (x == l[i]);
+            }
+            return found;
+        });
+    }
+
+    return select_if(values, n, [&list](T const x) {
+        return binary_search(list.begin(), list.end(), x);
+    });
+}
+
+//----------------------------------------------------------------------------
+// The same predicates over whole file_vectors.
+
+template <typename T, typename R, typename P>
+selection select_if(file_vector<T, R> const& col, P p) {
+    return select_if(col.data(), col.size(), p);
+}
+
+template <typename T, typename R>
+selection select_between(file_vector<T, R> const& col, T const lo, T const hi) {
+    return select_between(col.data(), col.size(), lo, hi);
+}
+
+template <typename T, typename R>
+selection select_equal(file_vector<T, R> const& col, T const value) {
+    return select_equal(col.data(), col.size(), value);
+}
+
+template <typename T, typename R, typename I>
+selection select_in(file_vector<T, R> const& col, I first, I last) {
+    return select_in(col.data(), col.size(), first, last);
+}
+
+template <typename T, typename R>
+selection select_in(file_vector<T, R> const& col, initializer_list<T> const& list) {
+    return select_in(col.data(), col.size(), list.begin(), list.end());
+}
+
+//----------------------------------------------------------------------------
+// Gather the selected rows of a column into 'out' (anything with
+// push_back). Selections are usually sparse over the other columns, so the
+// rows are prefetched ahead: 'distance' rows ahead for an index vector, and
+// the first selected row 'distance' words (of 64 rows) ahead for a bitmap.
+
+template <typename T, typename Index, typename Out>
+void gather(T const* values, vector<Index> const& rows, Out& out, size_t const distance = 16) {
+    size_t const n = rows.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (i + distance < n) {
+            __builtin_prefetch(values + rows[i + distance]);
+        }
+        out.push_back(values[rows[i]]);
+    }
+}
+
+template <typename T, typename R, typename Out>
+void gather(file_vector<T, R> const& col, selection const& s, Out& out, size_t const distance = 4) {
+    assert(s.size() <= col.size());
+
+    T const* const values = col.data();
+    uint64_t const* const words = s.data();
+    size_t const n = s.word_count();
+    for (size_t w = 0; w < n; ++w) {
+        if (w + distance < n && words[w + distance] != 0) {
+            __builtin_prefetch(values + (w + distance) * 64 + __builtin_ctzll(words[w + distance]));
+        }
+        for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+            out.push_back(values[w * 64 + __builtin_ctzll(bits)]);
+        }
+    }
+}
+
+template <typename T, typename R, typename Index, typename Out>
+void gather(file_vector<T, R> const& col, vector<Index> const& rows, Out& out, size_t const distance = 16) {
+    gather(col.data(), rows, out, distance);
+}
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef GROUP_BY_HPP
+#define GROUP_BY_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <type_traits>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Group-by aggregation over file_vector columns, writing one key and one
+// aggregate per group to two outputs (file_vector's, or anything with
+// cend() and a range insert). The rows are split into contiguous shares,
+// one per thread, and one of three strategies is used, chosen after a
+// first pass over the keys:
+//
+// - Sorted keys: each share aggregates its runs of equal keys, and the
+//   runs are joined where a group spans two shares. Groups come out in key
+//   order.
+// - Dense integer keys, spanning no more than 'dense_limit' values: each
+//   share aggregates into an array indexed by key, and the arrays are
+//   merged a slice of keys per thread. Groups come out in key order.
+// - Otherwise, each share aggregates into its own small hash table, a run
+//   of equal keys at a time, moving groups out to radix partitions of the
+//   key's hash as the table fills. The groups of each partition are then
+//   merged, in parallel, a partition per thread. Groups come out in no
+//   particular order.
+//
+// An aggregate A has 'A::of(value)' for a group's first value, 'add(value)'
+// for the next, and 'merge(that)' for the aggregate of later rows of the
+// same group. Rows are always aggregated in row order. group_aggregate
+// keeps the count, sum, min and max of the values.
+
+template <typename V>
+struct group_aggregate {
+    using sum_type = typename conditional<is_floating_point<V>::value, double,
+        typename conditional<is_signed<V>::value, int64_t, uint64_t>::type>::type;
+
+    uint64_t count;
+    sum_type sum;
+    V min;
+    V max;
+
+    static group_aggregate of(V const& value) {
+        return group_aggregate {1, static_cast<sum_type>(value), value, value};
+    }
+
+    void add(V const& value) {
+        ++count;
+        sum += value;
+        min = (value < min) ? value : min;
+        max = (max < value) ? value : max;
+    }
+
+    void merge(group_aggregate const& that) {
+        count += that.count;
+        sum += that.sum;
+        min = (that.min < min) ? that.min : min;
+        max = (max < that.max) ? that.max : max;
+    }
+};
+
+enum class group_strategy {
+    automatic, hash, dense, sorted
+};
+
+struct group_options {
+    unsigned threads = 4;
+    size_t dense_limit = size_t(1) << 16;
+    group_strategy strategy = group_strategy::automatic;
+};
+
+namespace group_by_detail {
+
+// Call 'f(share)' for each share in [0, shares), each on its own thread.
+template <typename F>
+void for_each_share(unsigned const shares, F f) {
+    vector<thread> workers;
+    for (unsigned s = 1; s < shares; ++s) {
+        workers.emplace_back(f, s);
+    }
+    f(0);
+    for (thread& w : workers) {
+        w.join();
+    }
+}
+
+template <typename K>
+uint64_t hash_of(K const& key) {
+    uint64_t x = hash<K>()(key);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+template <typename K, typename A>
+struct group {
+    K key;
+    A aggregate;
+};
+
+// A table of groups, kept in the order they were first seen. The groups
+// are found through an open addressed index of keys and group numbers,
+// probed linearly from the low bits of the hash and kept under half full,
+// so growing it moves only the small index entries.
+template <typename K, typename A>
+class group_table {
+    struct entry {
+        K key;
+        uint32_t group;
+    };
+
+    static uint32_t constexpr unused = numeric_limits<uint32_t>::max();
+
+    vector<entry> index;
+    vector<group<K, A>> groups;
+
+    void grow() {
+        vector<entry> old_index(index.size() * 2, entry {K(), unused});
+        old_index.swap(index);
+        size_t const mask = index.size() - 1;
+        for (entry const& e : old_index) {
+            if (e.group != unused) {
+                size_t s = hash_of(e.key) & mask;
+                while (index[s].group != unused) {
+                    s = (s + 1) & mask;
+                }
+                index[s] = e;
+            }
+        }
+    }
+
+public:
+    // For up to 'groups' groups without growing.
+    explicit group_table(size_t const groups = 8) {
+        size_t slots = 16;
+        while (slots < 2 * groups) {
+            slots *= 2;
+        }
+        index.assign(slots, entry {K(), unused});
+    }
+
+    size_t size() const {
+        return groups.size();
+    }
+
+    // Merge 'a', from rows after any already added, into the group of 'key'.
+    void add(K const& key, uint64_t const h, A const& a) {
+        size_t const mask = index.size() - 1;
+        size_t s = h & mask;
+        for (; index[s].group != unused; s = (s + 1) & mask) {
+            if (index[s].key == key) {
+                groups[index[s].group].aggregate.merge(a);
+                return;
+            }
+        }
+        if (groups.size() >= unused) {
+            throw runtime_error("Too many groups for group_by.");
+        }
+        index[s] = entry {key, static_cast<uint32_t>(groups.size())};
+        groups.push_back(group<K, A> {key, a});
+        if (groups.size() * 2 > index.size()) {
+            grow();
+        }
+    }
+
+    vector<group<K, A>>& contents() {
+        return groups;
+    }
+};
+
+// What the first pass learns of the keys.
+template <typename K>
+struct key_profile {
+    bool sorted;
+    K min;
+    K max;
+};
+
+template <typename K, typename KeyAt>
+key_profile<K> profile(size_t const n, KeyAt key_at, unsigned const shares) {
+    vector<key_profile<K>> found(shares);
+    for_each_share(shares, [n, &key_at, shares, &found](unsigned const s) {
+        size_t const first = n * s / shares;
+        size_t const last = n * (s + 1) / shares;
+        K const k = key_at(first);
+        key_profile<K> p {true, k, k};
+        for (size_t i = first + 1; i < last; ++i) {
+            K const next = key_at(i);
+            p.sorted = p.sorted && !(next < key_at(i - 1));
+            p.min = (next < p.min) ? next : p.min;
+            p.max = (p.max < next) ? next : p.max;
+        }
+        found[s] = p;
+    });
+
+    key_profile<K> all = found[0];
+    for (unsigned s = 1; s < shares; ++s) {
+        all.sorted = all.sorted && found[s].sorted && !(key_at(n * s / shares) < key_at(n * s / shares - 1));
+        all.min = (found[s].min < all.min) ? found[s].min : all.min;
+        all.max = (all.max < found[s].max) ? found[s].max : all.max;
+    }
+    return all;
+}
+
+// Call 'f(key, aggregate)' for each run of equal keys in [first, last).
+template <typename K, typename A, typename KeyAt, typename ValueAt, typename F>
+void for_each_run(size_t const first, size_t const last, KeyAt& key_at, ValueAt& value_at, F f) {
+    if (first == last) {
+        return;
+    }
+    K key = key_at(first);
+    A a = A::of(value_at(first));
+    for (size_t i = first + 1; i < last; ++i) {
+        K const next = key_at(i);
+        if (next == key) {
+            a.add(value_at(i));
+        } else {
+            f(key, a);
+            key = next;
+            a = A::of(value_at(i));
+        }
+    }
+    f(key, a);
+}
+
+// The groups found by a strategy, in pieces, to be written in order.
+template <typename K, typename A>
+using pieces = vector<vector<group<K, A>>>;
+
+// Write the keys and aggregates of 'groups' to the outputs, through
+// buffers of a fixed number of groups, returning the number of groups.
+template <typename K, typename A, typename KeyOut, typename AggregateOut>
+size_t write(pieces<K, A> const& groups, KeyOut& key_out, AggregateOut& aggregate_out) {
+    size_t const buffer_groups = size_t(1) << 16;
+    vector<K> keys;
+    vector<A> aggregates;
+    size_t written = 0;
+    auto const flush = [&keys, &aggregates, &key_out, &aggregate_out, &written] {
+        key_out.insert(key_out.cend(), keys.cbegin(), keys.cend());
+        aggregate_out.insert(aggregate_out.cend(), aggregates.cbegin(), aggregates.cend());
+        written += keys.size();
+        keys.clear();
+        aggregates.clear();
+    };
+    for (vector<group<K, A>> const& piece : groups) {
+        for (group<K, A> const& g : piece) {
+            keys.push_back(g.key);
+            aggregates.push_back(g.aggregate);
+            if (keys.size() == buffer_groups) {
+                flush();
+            }
+        }
+    }
+    flush();
+    return written;
+}
+
+template <typename K, typename A, typename KeyAt, typename ValueAt>
+pieces<K, A> group_sorted(size_t const n, KeyAt key_at, ValueAt value_at, unsigned const shares) {
+    pieces<K, A> runs(shares);
+    for_each_share(shares, [n, &key_at, &value_at, shares, &runs](unsigned const s) {
+        for_each_run<K, A>(n * s / shares, n * (s + 1) / shares, key_at, value_at, [&runs, s](K const& key, A const& a) {
+            runs[s].push_back(group<K, A> {key, a});
+        });
+    });
+
+    // Join groups split between shares.
+    group<K, A>* last = nullptr;
+    for (vector<group<K, A>>& run : runs) {
+        if (!run.empty() && last != nullptr && last->key == run.front().key) {
+            last->aggregate.merge(run.front().aggregate);
+            run.erase(run.begin());
+        }
+        last = run.empty() ? last : &run.back();
+    }
+    return runs;
+}
+
+template <typename K, typename A, typename KeyAt, typename ValueAt>
+pieces<K, A> group_dense(
+    size_t const n, KeyAt key_at, ValueAt value_at, unsigned const shares, K const min, size_t const range
+) {
+    vector<vector<A>> aggregates(shares, vector<A>(range));
+    vector<vector<uint8_t>> seen(shares, vector<uint8_t>(range, 0));
+    for_each_share(shares, [&](unsigned const s) {
+        A* const a = aggregates[s].data();
+        uint8_t* const present = seen[s].data();
+        for (size_t i = n * s / shares; i < n * (s + 1) / shares; ++i) {
+            size_t const k = static_cast<size_t>(key_at(i) - min);
+            if (present[k]) {
+                a[k].add(value_at(i));
+            } else {
+                a[k] = A::of(value_at(i));
+                present[k] = 1;
+            }
+        }
+    });
+
+    // Merge a slice of keys per thread, in share order.
+    pieces<K, A> slices(shares);
+    for_each_share(shares, [&](unsigned const t) {
+        for (size_t k = range * t / shares; k < range * (t + 1) / shares; ++k) {
+            bool found = false;
+            A a {};
+            for (unsigned s = 0; s < shares; ++s) {
+                if (seen[s][k]) {
+                    if (found) {
+                        a.merge(aggregates[s][k]);
+                    } else {
+                        a = aggregates[s][k];
+                        found = true;
+                    }
+                }
+            }
+            if (found) {
+                slices[t].push_back(group<K, A> {static_cast<K>(min + k), a});
+            }
+        }
+    });
+    return slices;
+}
+
+// Each share aggregates runs of equal keys into a small direct mapped table
+// that stays in the cache, and a group that collides with another is moved
+// out to its partition, by the top bits of its hash. Each partition's
+// groups are then merged into a table that fits the cache, as there are
+// enough partitions. The groups of a key move out in row order, so they
+// merge in row order.
+template <typename K, typename A, typename KeyAt, typename ValueAt>
+pieces<K, A> group_hashed(size_t const n, KeyAt key_at, ValueAt value_at, unsigned const shares) {
+    unsigned constexpr bits = 8;
+    size_t constexpr parts = size_t(1) << bits;
+    size_t constexpr cached = size_t(1) << 12;
+
+    vector<pieces<K, A>> spilled(shares, pieces<K, A>(parts));
+    for_each_share(shares, [&](unsigned const s) {
+        pieces<K, A>& out = spilled[s];
+        vector<group<K, A>> cache(cached);
+        vector<uint8_t> used(cached, 0);
+        auto const spill = [&out](group<K, A> const& g) {
+            out[hash_of(g.key) >> (64 - bits)].push_back(g);
+        };
+        for_each_run<K, A>(n * s / shares, n * (s + 1) / shares, key_at, value_at, [&](K const& key, A const& a) {
+            size_t const c = hash_of(key) & (cached - 1);
+            if (used[c]) {
+                if (cache[c].key == key) {
+                    cache[c].aggregate.merge(a);
+                    return;
+                }
+                spill(cache[c]);
+            }
+            cache[c] = group<K, A> {key, a};
+            used[c] = 1;
+        });
+        for (size_t c = 0; c < cached; ++c) {
+            if (used[c]) {
+                spill(cache[c]);
+            }
+        }
+    });
+
+    pieces<K, A> merged(parts);
+    atomic<size_t> next_part(0);
+    for_each_share(shares, [&](unsigned) {
+        for (size_t q = next_part++; q < parts; q = next_part++) {
+            size_t found = 0;
+            for (unsigned s = 0; s < shares; ++s) {
+                found += spilled[s][q].size();
+            }
+            group_table<K, A> all(found);
+            for (unsigned s = 0; s < shares; ++s) {
+                for (group<K, A> const& g : spilled[s][q]) {
+                    all.add(g.key, hash_of(g.key), g.aggregate);
+                }
+                vector<group<K, A>>().swap(spilled[s][q]);
+            }
+            merged[q] = move(all.contents());
+        }
+    });
+    return merged;
+}
+
+template <typename K, typename A, typename KeyAt, typename ValueAt, typename KeyOut, typename AggregateOut>
+size_t group_rows(
+    size_t const n, KeyAt key_at, ValueAt value_at,
+    KeyOut& key_out, AggregateOut& aggregate_out, group_options const& options
+) {
+    if (n == 0) {
+        return 0;
+    }
+    unsigned const shares = static_cast<unsigned>(min(static_cast<size_t>(max(options.threads, 1u)), n / 65536 + 1));
+
+    group_strategy strategy = options.strategy;
+    key_profile<K> p {false, K(), K()};
+    if (strategy != group_strategy::hash) {
+        p = profile<K>(n, key_at, shares);
+    }
+    size_t range = 0;
+    if constexpr (is_integral<K>::value) {
+        if (strategy == group_strategy::automatic || strategy == group_strategy::dense) {
+            // As unsigned, so the difference cannot overflow.
+            using U = typename make_unsigned<K>::type;
+            uint64_t const span = static_cast<U>(p.max) - static_cast<U>(p.min);
+            if (span < options.dense_limit && span < n) {
+                range = span + 1;
+            }
+        }
+    }
+    if (strategy == group_strategy::automatic) {
+        strategy = p.sorted ? group_strategy::sorted : (range > 0) ? group_strategy::dense : group_strategy::hash;
+    } else if (strategy == group_strategy::sorted && !p.sorted) {
+        throw runtime_error("Keys are not sorted for group_by.");
+    } else if (strategy == group_strategy::dense && range == 0) {
+        throw runtime_error("Keys are not dense for group_by.");
+    }
+
+    pieces<K, A> groups;
+    if (strategy == group_strategy::sorted) {
+        groups = group_sorted<K, A>(n, key_at, value_at, shares);
+    } else if (strategy == group_strategy::dense) {
+        groups = group_dense<K, A>(n, key_at, value_at, shares, p.min, range);
+    } else {
+        groups = group_hashed<K, A>(n, key_at, value_at, shares);
+    }
+    return write(groups, key_out, aggregate_out);
+}
+
+}
+
+//----------------------------------------------------------------------------
+// Group the rows of 'values' by the same rows of 'keys', writing each
+// group's key to 'key_out' and its aggregate to 'aggregate_out', returning
+// the number of groups. Keys need ==, < and std::hash. The aggregate is
+// group_aggregate<V> unless given, as in group_by<A>(...).
+
+template <typename A = void, typename K, typename RK, typename V, typename RV, typename KeyOut, typename AggregateOut>
+size_t group_by(
+    file_vector<K, RK> const& keys, file_vector<V, RV> const& values,
+    KeyOut& key_out, AggregateOut& aggregate_out, group_options const& options = group_options()
+) {
+    using aggregate = typename conditional<is_void<A>::value, group_aggregate<V>, A>::type;
+
+    if (keys.size() != values.size()) {
+        throw runtime_error("Key and value columns differ in size for group_by.");
+    }
+    K const* const k = keys.data();
+    V const* const v = values.data();
+    return group_by_detail::group_rows<K, aggregate>(keys.size(), [k](size_t const i) {
+        return k[i];
+    }, [v](size_t const i) {
+        return v[i];
+    }, key_out, aggregate_out, options);
+}
+
+// Group the rows of 'rows' by 'key(row)', aggregating 'value(row)', as
+// above, for keys made from several fields, such as a symbol and a minute.
+template <
+    typename A = void, typename T, typename R, typename Key, typename Value, typename KeyOut, typename AggregateOut,
+    typename = decltype(declval<Key>()(declval<T const&>()))
+>
+size_t group_by(
+    file_vector<T, R> const& rows, Key key, Value value,
+    KeyOut& key_out, AggregateOut& aggregate_out, group_options const& options = group_options()
+) {
+    using K = decltype(key(declval<T const&>()));
+    using V = decltype(value(declval<T const&>()));
+    using aggregate = typename conditional<is_void<A>::value, group_aggregate<V>, A>::type;
+
+    T const* const r = rows.data();
+    return group_by_detail::group_rows<K, aggregate>(rows.size(), [r, key](size_t const i) {
+        return key(r[i]);
+    }, [r, value](size_t const i) {
+        return value(r[i]);
+    }, key_out, aggregate_out, options);
+}
+
+#endif
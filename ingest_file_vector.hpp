@@ -0,0 +1,367 @@
+#ifndef INGEST_FILE_VECTOR_HPP
+#define INGEST_FILE_VECTOR_HPP
+
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include "file_vector.hpp"
+#include "io_ring.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// An append-only ingest path for the file of a file_vector. Appending
+// through the mapping dirties page-cache pages, which the kernel writes back
+// in bursts of its own choosing, competing with reads. ingest_file_vector
+// instead appends into page aligned buffers, and hands each full buffer to a
+// background thread that writes it to the file, with O_DIRECT where the
+// file-system supports it, while appending continues into the next buffer.
+// Appends only wait when every buffer is full and waiting to be written.
+//
+// The file holds the column the same way as a file_vector, and the rows
+// already written (the committed prefix) can be read through a read-only
+// mapping. flush writes the partly filled buffer as well, padded to a page,
+// and trims the file back to the rows, so the file can be opened as a
+// file_vector once the ingest_file_vector is closed. The file must not be
+// open as a file_vector while it is being appended to.
+//
+// If the file has a commit record, sync and close commit the rows written,
+// so after a crash the file reopens as a file_vector as of the last of
+// them.
+
+struct ingest_options {
+    size_t buffer_bytes = 1 << 20;
+    unsigned buffers = 2;
+    bool direct = true;
+};
+
+template <typename T>
+class ingest_file_vector {
+    static_assert(is_trivially_copyable<T>::value, "ingest_file_vector needs a trivially copyable type.");
+
+    using size_type = size_t;
+
+    struct write_request {
+        size_type buffer;
+        size_type offset;
+    };
+
+    string const name;
+    size_type const page_size;
+    size_type const buffer_bytes;
+    size_type head;
+    size_type rows;
+    int fd;
+    bool committing;
+
+    vector<aligned_buffer> buffers;
+    vector<size_type> free_buffers;
+    deque<write_request> requests;
+    size_type current;
+    size_type current_offset;
+    size_type fill;
+
+    thread writer;
+    mutex lock;
+    condition_variable changed;
+    bool stopping;
+    exception_ptr error;
+    atomic<size_type> written;
+
+    char const* view;
+    size_type view_size;
+
+    //------------------------------------------------------------------------
+    // The writer thread.
+
+    void write_all(char const* bytes, size_type const length, size_type const offset) {
+        size_type done = 0;
+        while (done < length) {
+            ssize_t const n = pwrite(fd, bytes + done, length - done, offset + done);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Unable to write file for ingest_file_vector.");
+            }
+            done += n;
+        }
+    }
+
+    void write_behind() {
+        unique_lock<mutex> guard(lock);
+        for (;;) {
+            changed.wait(guard, [this] {
+                return stopping || !requests.empty();
+            });
+            if (requests.empty()) {
+                return;
+            }
+            write_request const r = requests.front();
+            guard.unlock();
+
+            exception_ptr failed;
+            try {
+                write_all(buffers[r.buffer].data(), buffer_bytes, r.offset);
+            } catch (...) {
+                failed = current_exception();
+            }
+
+            guard.lock();
+            requests.pop_front();
+            free_buffers.push_back(r.buffer);
+            if (failed) {
+                error = failed;
+            } else {
+                written.store(r.offset + buffer_bytes, memory_order_release);
+            }
+            changed.notify_all();
+        }
+    }
+
+    void check() {
+        if (error) {
+            exception_ptr e = error;
+            error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+
+    // Queue the current buffer for writing, and continue in a free one.
+    void hand_off() {
+        unique_lock<mutex> guard(lock);
+        check();
+        requests.push_back(write_request {current, current_offset});
+        changed.notify_all();
+        changed.wait(guard, [this] {
+            return !free_buffers.empty();
+        });
+        current = free_buffers.back();
+        free_buffers.pop_back();
+        current_offset += buffer_bytes;
+        fill = 0;
+    }
+
+    void drain() {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] {
+            return requests.empty();
+        });
+        check();
+    }
+
+    // Replace the commit record with one for all the rows, which must be on
+    // the device. Without a record the file is taken at its length, which
+    // flush has trimmed to the rows, so a crash in between loses nothing.
+    void commit_rows() {
+        if (unlink((name + ".commit").c_str()) == -1 && errno != ENOENT) {
+            throw runtime_error("Unable to remove commit record for ingest_file_vector.");
+        }
+        file_vector<T>(name, file_vector<T>::commit_appends).close();
+    }
+
+    void open_file(bool const direct) {
+        fd = -1;
+        if (direct) {
+            fd = open(name.c_str(), O_RDWR | O_DIRECT);
+        }
+        if (fd == -1) {
+            fd = open(name.c_str(), O_RDWR);
+        }
+        if (fd == -1) {
+            throw runtime_error("Unable to open file for ingest_file_vector.");
+        }
+    }
+
+public:
+    static int constexpr create_file = file_vector<T>::create_file;
+
+    ingest_file_vector(string const& name, int mode = 0, ingest_options const& options = ingest_options())
+    : name(name), page_size(getpagesize())
+    , buffer_bytes(max(options.buffer_bytes / page_size, size_type(1)) * page_size)
+    , head(0), rows(0), fd(-1), committing(false), current(0), current_offset(0), fill(0)
+    , stopping(false), written(0), view(nullptr), view_size(0) {
+        {
+            // Create the file if needed, and find where the rows are.
+            file_vector<T> existing(name, mode);
+            head = existing.file_offset();
+            rows = existing.size();
+        }
+        committing = access((name + ".commit").c_str(), F_OK) == 0;
+        open_file(options.direct);
+
+        unsigned const n = max(options.buffers, 2u);
+        for (unsigned i = 0; i < n; ++i) {
+            buffers.emplace_back(buffer_bytes, page_size);
+            free_buffers.push_back(n - 1 - i);
+        }
+        current = free_buffers.back();
+        free_buffers.pop_back();
+
+        // Start at the page holding the end of the rows, so every write is
+        // page aligned.
+        size_type const end = head + rows * sizeof(T);
+        current_offset = end / page_size * page_size;
+        fill = end - current_offset;
+        if (fill > 0 && pread(fd, buffers[current].data(), page_size, current_offset) < static_cast<ssize_t>(fill)) {
+            ::close(fd);
+            throw runtime_error("Unable to read file for ingest_file_vector.");
+        }
+        written.store(end, memory_order_release);
+
+        writer = thread(&ingest_file_vector::write_behind, this);
+    }
+
+    ingest_file_vector(ingest_file_vector const&) = delete;
+    ingest_file_vector& operator= (ingest_file_vector const&) = delete;
+
+    ~ingest_file_vector() {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    // Write everything out, stop the writer and close the file.
+    void close() {
+        if (fd == -1) {
+            return;
+        }
+        exception_ptr failed;
+        try {
+            if (committing) {
+                sync();
+            } else {
+                flush();
+            }
+        } catch (...) {
+            failed = current_exception();
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+
+        if (view != nullptr) {
+            munmap(const_cast<char*>(view), view_size);
+            view = nullptr;
+            view_size = 0;
+        }
+        ::close(fd);
+        fd = -1;
+        if (failed) {
+            rethrow_exception(failed);
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    // Rows appended, written or not.
+    size_type size() const {
+        return rows;
+    }
+
+    bool empty() const {
+        return rows == 0;
+    }
+
+    // Rows written to the file, which can be read through data().
+    size_type committed() const {
+        size_type const end = written.load(memory_order_acquire);
+        return min((end - head) / sizeof(T), rows);
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    // The committed rows, through a read-only mapping of the file. The
+    // pointer is valid until the next call to data, or close.
+    T const* data() {
+        size_type const end = head + committed() * sizeof(T);
+        if (end > view_size) {
+            if (view != nullptr) {
+                munmap(const_cast<char*>(view), view_size);
+            }
+            size_type const size = max(end, view_size * 2);
+            void* const base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                view = nullptr;
+                view_size = 0;
+                throw runtime_error("Unable to mmap file for ingest_file_vector.");
+            }
+            view = static_cast<char const*>(base);
+            view_size = size;
+        }
+        return reinterpret_cast<T const*>(view + head);
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const& value) {
+        if (fill + sizeof(T) < buffer_bytes) {
+            memcpy(buffers[current].data() + fill, &value, sizeof(T));
+            fill += sizeof(T);
+            ++rows;
+            return;
+        }
+
+        char const* bytes = reinterpret_cast<char const*>(&value);
+        size_type left = sizeof(T);
+        while (left > 0) {
+            size_type const n = min(left, buffer_bytes - fill);
+            memcpy(buffers[current].data() + fill, bytes, n);
+            fill += n;
+            bytes += n;
+            left -= n;
+            if (fill == buffer_bytes) {
+                hand_off();
+            }
+        }
+        ++rows;
+    }
+
+    template <typename I, typename = typename I::iterator_category>
+    void append(I first, I last) {
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    // Write every appended row to the file. The partly filled buffer is
+    // written padded to a whole page, and the file trimmed back to the rows.
+    void flush() {
+        drain();
+        size_type const end = head + rows * sizeof(T);
+        if (fill > 0) {
+            size_type const padded = (fill + page_size - 1) / page_size * page_size;
+            memset(buffers[current].data() + fill, 0, padded - fill);
+            write_all(buffers[current].data(), padded, current_offset);
+        }
+        if (ftruncate(fd, end) == -1) {
+            throw runtime_error("Unable to truncate file for ingest_file_vector.");
+        }
+        written.store(end, memory_order_release);
+    }
+
+    // Flush, and wait for the data to reach the device, committing the rows
+    // if the file has a commit record.
+    void sync() {
+        flush();
+        if (fdatasync(fd) == -1) {
+            throw runtime_error("Unable to sync file for ingest_file_vector.");
+        }
+        if (committing) {
+            commit_rows();
+        }
+    }
+};
+
+#endif
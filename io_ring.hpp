@@ -0,0 +1,254 @@
+#ifndef IO_RING_HPP
+#define IO_RING_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+}
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A page aligned heap buffer, as needed for O_DIRECT transfers.
+
+class aligned_buffer {
+    char* bytes;
+    size_t length;
+
+public:
+    explicit aligned_buffer(size_t const length, size_t const alignment = getpagesize())
+    : bytes(nullptr), length(length) {
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, length) != 0) {
+            throw bad_alloc();
+        }
+        bytes = static_cast<char*>(p);
+    }
+
+    aligned_buffer(aligned_buffer&& that) noexcept : bytes(that.bytes), length(that.length) {
+        that.bytes = nullptr;
+        that.length = 0;
+    }
+
+    aligned_buffer(aligned_buffer const&) = delete;
+    aligned_buffer& operator= (aligned_buffer const&) = delete;
+
+    ~aligned_buffer() {
+        free(bytes);
+    }
+
+    char* data() {
+        return bytes;
+    }
+
+    char const* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+//----------------------------------------------------------------------------
+// A minimal io_uring, set up with the raw system calls so there is no
+// dependency on liburing. Requests are queued with read or write, passed to
+// the kernel with submit, and completions collected with wait, each tagged
+// with the caller's 'tag'. If the kernel does not provide io_uring (or it
+// is disabled) available() is false, and callers use plain system calls.
+
+class io_ring {
+    int ring_fd;
+    io_uring_params params;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    unsigned queued;
+
+    static unsigned* at(void* ring, unsigned const offset) {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+
+    int enter(unsigned const submit, unsigned const complete, unsigned const flags) {
+        for (;;) {
+            int const r = syscall(__NR_io_uring_enter, ring_fd, submit, complete, flags, nullptr, 0);
+            if (r >= 0 || errno != EINTR) {
+                return r;
+            }
+        }
+    }
+
+    void unmap() {
+        if (sqes != nullptr) {
+            munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        }
+        if (cq_ring != nullptr && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != nullptr) {
+            munmap(sq_ring, sq_ring_size);
+        }
+    }
+
+    io_uring_sqe* next_sqe() {
+        unsigned const tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == params.sq_entries) {
+            submit();
+        }
+        unsigned const index = tail & *sq_mask;
+        io_uring_sqe* const sqe = sqes + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        return sqe;
+    }
+
+    void queue() {
+        __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+        ++queued;
+    }
+
+public:
+    explicit io_ring(unsigned const entries)
+    : ring_fd(-1), sq_ring(nullptr), sq_ring_size(0), cq_ring(nullptr), cq_ring_size(0)
+    , sqes(nullptr), queued(0) {
+        memset(&params, 0, sizeof(params));
+        ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd == -1) {
+            return;
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool const single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+        }
+
+        void* p = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE
+            , MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING
+        );
+        sq_ring = (p == MAP_FAILED) ? nullptr : p;
+        if (sq_ring != nullptr && single) {
+            cq_ring = sq_ring;
+        } else if (sq_ring != nullptr) {
+            p = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE
+                , MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING
+            );
+            cq_ring = (p == MAP_FAILED) ? nullptr : p;
+        }
+        if (cq_ring != nullptr) {
+            p = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE
+                , MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES
+            );
+            sqes = (p == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe*>(p);
+        }
+        if (sqes == nullptr) {
+            unmap();
+            ::close(ring_fd);
+            ring_fd = -1;
+            return;
+        }
+
+        sq_head = at(sq_ring, params.sq_off.head);
+        sq_tail = at(sq_ring, params.sq_off.tail);
+        sq_mask = at(sq_ring, params.sq_off.ring_mask);
+        sq_array = at(sq_ring, params.sq_off.array);
+        cq_head = at(cq_ring, params.cq_off.head);
+        cq_tail = at(cq_ring, params.cq_off.tail);
+        cq_mask = at(cq_ring, params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring) + params.cq_off.cqes);
+    }
+
+    io_ring(io_ring const&) = delete;
+    io_ring& operator= (io_ring const&) = delete;
+
+    ~io_ring() {
+        if (ring_fd != -1) {
+            unmap();
+            ::close(ring_fd);
+        }
+    }
+
+    bool available() const {
+        return ring_fd != -1;
+    }
+
+    // Queue a read of 'length' bytes at 'offset' of 'fd' into 'buffer'.
+    void read(int const fd, void* const buffer, unsigned const length, uint64_t const offset, uint64_t const tag) {
+        io_uring_sqe* const sqe = next_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = length;
+        sqe->off = offset;
+        sqe->user_data = tag;
+        queue();
+    }
+
+    // Queue a write of 'length' bytes from 'buffer' at 'offset' of 'fd'.
+    void write(int const fd, void const* const buffer, unsigned const length, uint64_t const offset, uint64_t const tag) {
+        io_uring_sqe* const sqe = next_sqe();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = length;
+        sqe->off = offset;
+        sqe->user_data = tag;
+        queue();
+    }
+
+    // Pass the queued requests to the kernel.
+    void submit() {
+        while (queued > 0) {
+            int const n = enter(queued, 0, 0);
+            if (n < 0) {
+                throw runtime_error("Unable to submit to io_ring.");
+            }
+            queued -= n;
+        }
+    }
+
+    // Wait for a request to complete, returning its tag and result (bytes
+    // transferred, or -errno).
+    pair<uint64_t, int> wait() {
+        submit();
+        for (;;) {
+            unsigned const head = *cq_head;
+            if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe const& cqe = cqes[head & *cq_mask];
+                pair<uint64_t, int> const done(cqe.user_data, cqe.res);
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return done;
+            }
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+                throw runtime_error("Unable to wait for io_ring.");
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef JOIN_HPP
+#define JOIN_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <vector>
+#include <functional>
+#include <limits>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Joins between two columns, producing the matching rows as pairs of row
+// numbers, appended to two outputs (file_vector<uint64_t>, or anything with
+// cend() and a range insert) a buffer at a time.
+//
+// asof_join and merge_join need both columns sorted, and stream through
+// them once, sequentially. hash_join takes the columns in any order. It is
+// a radix join: the rows of both columns are first scattered, in parallel,
+// into partitions by the low bits of their hashes, with enough partitions
+// that each partition of the build side, with its hash table, fits in the
+// cache. Each row keeps its hash, so the tables do not hash again. The
+// partitions are then joined in parallel, each thread taking the next
+// partition, so the table lookups hit the cache instead of memory, and
+// writing its pairs to the outputs a buffer at a time as it finds them.
+// Both columns are partitioned in memory, 'build' should be the smaller.
+
+struct join_options {
+    unsigned threads = 4;
+    size_t cache_bytes = size_t(256) << 10;
+};
+
+namespace join_detail {
+
+// Collects pairs of rows, appending them to the outputs a buffer at a time,
+// holding 'lock', if given, while appending.
+template <typename LeftOut, typename RightOut>
+class pair_writer {
+    static size_t constexpr buffer_rows = 4096;
+
+    LeftOut& left;
+    RightOut& right;
+    mutex* const lock;
+    vector<uint64_t> left_rows;
+    vector<uint64_t> right_rows;
+    size_t written;
+
+public:
+    pair_writer(LeftOut& left, RightOut& right, mutex* const lock = nullptr)
+    : left(left), right(right), lock(lock), written(0) {
+        left_rows.reserve(buffer_rows);
+        right_rows.reserve(buffer_rows);
+    }
+
+    void push_back(uint64_t const l, uint64_t const r) {
+        left_rows.push_back(l);
+        right_rows.push_back(r);
+        if (left_rows.size() == buffer_rows) {
+            flush();
+        }
+    }
+
+    // Write the buffered pairs, returning the number written in all.
+    size_t flush() {
+        if (left_rows.empty()) {
+            return written;
+        }
+        unique_lock<mutex> guard;
+        if (lock != nullptr) {
+            guard = unique_lock<mutex>(*lock);
+        }
+        left.insert(left.cend(), left_rows.cbegin(), left_rows.cend());
+        right.insert(right.cend(), right_rows.cbegin(), right_rows.cend());
+        written += left_rows.size();
+        left_rows.clear();
+        right_rows.clear();
+        return written;
+    }
+};
+
+template <typename T, typename R>
+void advise_sequential(file_vector<T, R> const& col) {
+    if (!col.empty()) {
+        madvise(const_cast<T*>(col.data()), col.size() * sizeof(T), MADV_SEQUENTIAL);
+    }
+}
+
+// Call 'f(share)' for each share in [0, shares), each on its own thread.
+template <typename F>
+void for_each_share(unsigned const shares, F f) {
+    vector<thread> workers;
+    for (unsigned s = 1; s < shares; ++s) {
+        workers.emplace_back(f, s);
+    }
+    f(0);
+    for (thread& w : workers) {
+        w.join();
+    }
+}
+
+template <typename K, typename Hash>
+uint64_t hash_of(K const& key) {
+    uint64_t x = Hash()(key);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+template <typename K>
+struct keyed_row {
+    K key;
+    uint64_t row;
+    uint64_t hash;
+};
+
+// The rows of a column grouped by partition, partition p in [starts[p],
+// starts[p + 1]), in row order within each.
+template <typename K>
+struct partitions {
+    vector<size_t> starts;
+    unique_ptr<keyed_row<K>[]> rows;
+};
+
+// Scatter 'keys' into 2^bits partitions, each share of the rows counting
+// its rows per partition, and then writing them, with their hashes, to its
+// own offsets within each partition. The scatter hashes the keys again
+// rather than keeping the hashes from the count, which is faster than
+// writing and reading them back.
+template <typename K, typename Hash>
+partitions<K> partition(K const* const keys, size_t const n, unsigned const bits, unsigned const threads) {
+    size_t const parts = size_t(1) << bits;
+    size_t const mask = parts - 1;
+    unsigned const shares = static_cast<unsigned>(min(static_cast<size_t>(max(threads, 1u)), n / 65536 + 1));
+
+    vector<vector<size_t>> offsets(shares, vector<size_t>(parts, 0));
+    for_each_share(shares, [keys, n, shares, mask, &offsets](unsigned const s) {
+        vector<size_t>& count = offsets[s];
+        for (size_t i = n * s / shares; i < n * (s + 1) / shares; ++i) {
+            ++count[hash_of<K, Hash>(keys[i]) & mask];
+        }
+    });
+
+    partitions<K> out;
+    out.starts.resize(parts + 1);
+    size_t at = 0;
+    for (size_t p = 0; p < parts; ++p) {
+        out.starts[p] = at;
+        for (unsigned s = 0; s < shares; ++s) {
+            size_t const count = offsets[s][p];
+            offsets[s][p] = at;
+            at += count;
+        }
+    }
+    out.starts[parts] = at;
+
+    out.rows.reset(new keyed_row<K>[n]);
+    keyed_row<K>* const rows = out.rows.get();
+    for_each_share(shares, [keys, n, shares, mask, rows, &offsets](unsigned const s) {
+        vector<size_t>& offset = offsets[s];
+        for (size_t i = n * s / shares; i < n * (s + 1) / shares; ++i) {
+            uint64_t const h = hash_of<K, Hash>(keys[i]);
+            rows[offset[h & mask]++] = keyed_row<K> {keys[i], i, h};
+        }
+    });
+    return out;
+}
+
+}
+
+//----------------------------------------------------------------------------
+// As-of join: for each row of 'left', the last row of 'right' that is not
+// after it (the greatest right[j] with !comp(left[i], right[j]), the last
+// of any equal ones). Rows of 'left' before every row of 'right' have no
+// match. Both columns must be sorted by 'comp'. Returns the number of pairs.
+
+template <typename T, typename RL, typename RR, typename LeftOut, typename RightOut, typename Compare = less<T>>
+size_t asof_join(
+    file_vector<T, RL> const& left, file_vector<T, RR> const& right,
+    LeftOut& left_rows, RightOut& right_rows, Compare comp = Compare()
+) {
+    join_detail::advise_sequential(left);
+    join_detail::advise_sequential(right);
+
+    T const* const l = left.data();
+    T const* const r = right.data();
+    size_t const left_size = left.size();
+    size_t const right_size = right.size();
+    join_detail::pair_writer<LeftOut, RightOut> out(left_rows, right_rows);
+
+    // 'j' is the number of rows of 'right' not after l[i].
+    size_t j = 0;
+    for (size_t i = 0; i < left_size; ++i) {
+        while (j < right_size && !comp(l[i], r[j])) {
+            ++j;
+        }
+        if (j > 0) {
+            out.push_back(i, j - 1);
+        }
+    }
+    return out.flush();
+}
+
+// Equi-join of two columns sorted by 'comp', pairing every row of 'left'
+// with every equal row of 'right', in order. Returns the number of pairs.
+template <typename T, typename RL, typename RR, typename LeftOut, typename RightOut, typename Compare = less<T>>
+size_t merge_join(
+    file_vector<T, RL> const& left, file_vector<T, RR> const& right,
+    LeftOut& left_rows, RightOut& right_rows, Compare comp = Compare()
+) {
+    join_detail::advise_sequential(left);
+    join_detail::advise_sequential(right);
+
+    T const* const l = left.data();
+    T const* const r = right.data();
+    size_t const left_size = left.size();
+    size_t const right_size = right.size();
+    join_detail::pair_writer<LeftOut, RightOut> out(left_rows, right_rows);
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < left_size && j < right_size) {
+        if (comp(l[i], r[j])) {
+            ++i;
+        } else if (comp(r[j], l[i])) {
+            ++j;
+        } else {
+            size_t left_end = i + 1;
+            while (left_end < left_size && !comp(l[i], l[left_end])) {
+                ++left_end;
+            }
+            size_t right_end = j + 1;
+            while (right_end < right_size && !comp(r[j], r[right_end])) {
+                ++right_end;
+            }
+            for (; i < left_end; ++i) {
+                for (size_t k = j; k < right_end; ++k) {
+                    out.push_back(i, k);
+                }
+            }
+            j = right_end;
+        }
+    }
+    return out.flush();
+}
+
+// Equi-join of 'build' and 'probe' in any order, pairing every row of
+// 'probe' with every equal row of 'build'. Each thread's pairs come out by
+// partition, and within a partition by probe row, then build row, with the
+// buffers of different threads interleaved. Returns the number of pairs.
+template <typename K, typename RB, typename RP, typename BuildOut, typename ProbeOut, typename Hash = hash<K>>
+size_t hash_join(
+    file_vector<K, RB> const& build, file_vector<K, RP> const& probe,
+    BuildOut& build_rows, ProbeOut& probe_rows,
+    join_options const& options = join_options()
+) {
+    using namespace join_detail;
+    using row = keyed_row<K>;
+
+    // Enough partitions for each to fit the cache, with its table of two
+    // 32 bit words a row, and for every thread to have some.
+    unsigned const threads = max(options.threads, 1u);
+    size_t const bytes = build.size() * (sizeof(row) + 2 * sizeof(uint32_t));
+    size_t const wanted = max(bytes / max(options.cache_bytes, size_t(1)) + 1, static_cast<size_t>(threads));
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < wanted && bits < 12) {
+        ++bits;
+    }
+    size_t const parts = size_t(1) << bits;
+
+    partitions<K> const b = partition<K, Hash>(build.data(), build.size(), bits, threads);
+    partitions<K> const p = partition<K, Hash>(probe.data(), probe.size(), bits, threads);
+
+    for (size_t q = 0; q < parts; ++q) {
+        if (b.starts[q + 1] - b.starts[q] >= numeric_limits<uint32_t>::max()) {
+            throw runtime_error("Partition too large for hash_join.");
+        }
+    }
+
+    // Join each partition with a chained table, chains linked through
+    // 'next' by index + 1 within the partition. Rows are added in reverse,
+    // so each chain is in row order.
+    mutex out_lock;
+    atomic<size_t> pairs(0);
+    atomic<size_t> next_part(0);
+    exception_ptr error;
+    for_each_share(threads, [&](unsigned) {
+        try {
+            pair_writer<BuildOut, ProbeOut> out(build_rows, probe_rows, &out_lock);
+            vector<uint32_t> heads;
+            vector<uint32_t> next;
+            for (size_t q = next_part++; q < parts; q = next_part++) {
+                row const* const build_part = b.rows.get() + b.starts[q];
+                size_t const build_size = b.starts[q + 1] - b.starts[q];
+                row const* const probe_part = p.rows.get() + p.starts[q];
+                size_t const probe_size = p.starts[q + 1] - p.starts[q];
+                if (build_size == 0 || probe_size == 0) {
+                    continue;
+                }
+
+                size_t buckets = 1;
+                while (buckets < build_size) {
+                    buckets *= 2;
+                }
+                size_t const mask = buckets - 1;
+                heads.assign(buckets, 0);
+                next.resize(build_size);
+                for (size_t i = build_size; i-- > 0;) {
+                    uint32_t& head = heads[(build_part[i].hash >> bits) & mask];
+                    next[i] = head;
+                    head = static_cast<uint32_t>(i + 1);
+                }
+
+                for (size_t i = 0; i < probe_size; ++i) {
+                    row const& r = probe_part[i];
+                    for (uint32_t k = heads[(r.hash >> bits) & mask]; k != 0; k = next[k - 1]) {
+                        if (build_part[k - 1].hash == r.hash && build_part[k - 1].key == r.key) {
+                            out.push_back(build_part[k - 1].row, r.row);
+                        }
+                    }
+                }
+            }
+            pairs += out.flush();
+        } catch (...) {
+            lock_guard<mutex> guard(out_lock);
+            error = error ? error : current_exception();
+            next_part = parts;
+        }
+    });
+    if (error) {
+        rethrow_exception(error);
+    }
+    return pairs;
+}
+
+#endif
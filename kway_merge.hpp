@@ -0,0 +1,108 @@
+#ifndef KWAY_MERGE_HPP
+#define KWAY_MERGE_HPP
+
+#include <vector>
+#include <utility>
+#include <functional>
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A loser tree over 'k' sorted ranges. The winner (smallest head) is found
+// with log(k) comparisons on each pop, by replaying only the path from the
+// winner's leaf to the root. Equal values are taken from the lower numbered
+// source first, so the merge is stable.
+
+template <typename T, typename Compare = less<T>>
+class loser_tree {
+public:
+    using source = pair<T const*, T const*>;
+
+private:
+    vector<source> sources;
+    vector<size_t> tree;
+    size_t const k;
+    Compare comp;
+
+    bool before(size_t const a, size_t const b) const {
+        if (sources[a].first == sources[a].second) {
+            return false;
+        }
+        if (sources[b].first == sources[b].second) {
+            return true;
+        }
+        if (comp(*sources[a].first, *sources[b].first)) {
+            return true;
+        }
+        if (comp(*sources[b].first, *sources[a].first)) {
+            return false;
+        }
+        return a < b;
+    }
+
+public:
+    loser_tree(vector<source> const& sources, Compare comp = Compare())
+    : sources(sources), tree(sources.size() > 0 ? sources.size() : 1, 0)
+    , k(sources.size()), comp(comp) {
+        if (k <= 1) {
+            return;
+        }
+
+        vector<size_t> winners(2 * k);
+        for (size_t i = 0; i < k; ++i) {
+            winners[k + i] = i;
+        }
+        for (size_t n = k - 1; n > 0; --n) {
+            size_t const a = winners[2 * n];
+            size_t const b = winners[2 * n + 1];
+            if (before(b, a)) {
+                winners[n] = b;
+                tree[n] = a;
+            } else {
+                winners[n] = a;
+                tree[n] = b;
+            }
+        }
+        tree[0] = winners[1];
+    }
+
+    bool empty() const {
+        return k == 0 || sources[tree[0]].first == sources[tree[0]].second;
+    }
+
+    T const& top() const {
+        return *sources[tree[0]].first;
+    }
+
+    size_t top_source() const {
+        return tree[0];
+    }
+
+    void pop() {
+        size_t winner = tree[0];
+        ++sources[winner].first;
+        for (size_t n = (k + winner) / 2; n > 0; n /= 2) {
+            if (before(tree[n], winner)) {
+                swap(tree[n], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+};
+
+// Merge sorted ranges into 'out' with push_back, reading each source and
+// writing the output strictly sequentially.
+template <typename T, typename Out, typename Compare = less<T>>
+void kway_merge(
+    vector<typename loser_tree<T, Compare>::source> const& sources,
+    Out& out,
+    Compare comp = Compare()
+) {
+    loser_tree<T, Compare> tree(sources, comp);
+    while (!tree.empty()) {
+        out.push_back(tree.top());
+        tree.pop();
+    }
+}
+
+#endif
@@ -0,0 +1,486 @@
+#ifndef PERSISTENT_ARENA_HPP
+#define PERSISTENT_ARENA_HPP
+
+#include <cstddef>
+#include <limits>
+#include <iterator>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A fancy pointer that holds the distance from itself to what it points to,
+// rather than an address, so it stays valid in a file mapped at a different
+// address each time it is opened, as long as the pointer and what it points
+// to are in the same mapping. Copying one recomputes the distance.
+
+template <typename T>
+class offset_ptr {
+    template <typename U> friend class offset_ptr;
+
+    static ptrdiff_t constexpr null_offset = numeric_limits<ptrdiff_t>::min();
+
+    ptrdiff_t offset;
+
+    // The arithmetic is on integers, as the compiler may assume pointer
+    // arithmetic from 'this' stays within the offset_ptr.
+    void set(void const* const p) {
+        offset = (p == nullptr) ? null_offset
+            : static_cast<ptrdiff_t>(reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(this));
+    }
+
+public:
+    using element_type = T;
+    using value_type = typename remove_cv<T>::type;
+    using difference_type = ptrdiff_t;
+    using pointer = T*;
+    using reference = typename add_lvalue_reference<T>::type;
+    using iterator_category = random_access_iterator_tag;
+
+    template <typename U> using rebind = offset_ptr<U>;
+
+    offset_ptr() noexcept : offset(null_offset) {}
+
+    offset_ptr(nullptr_t) noexcept : offset(null_offset) {}
+
+    offset_ptr(T* const p) noexcept {
+        set(p);
+    }
+
+    offset_ptr(offset_ptr const& that) noexcept {
+        set(that.get());
+    }
+
+    template <typename U, typename = typename enable_if<is_convertible<U*, T*>::value>::type>
+    offset_ptr(offset_ptr<U> const& that) noexcept {
+        set(static_cast<T*>(that.get()));
+    }
+
+    // static_cast, as from the allocator's offset_ptr<void>.
+    template <typename U, typename = typename enable_if<!is_convertible<U*, T*>::value>::type, typename = void>
+    explicit offset_ptr(offset_ptr<U> const& that) noexcept {
+        set(static_cast<T*>(that.get()));
+    }
+
+    offset_ptr& operator= (offset_ptr const& that) noexcept {
+        set(that.get());
+        return *this;
+    }
+
+    offset_ptr& operator= (T* const p) noexcept {
+        set(p);
+        return *this;
+    }
+
+    T* get() const noexcept {
+        return (offset == null_offset) ? nullptr
+            : reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(this) + offset);
+    }
+
+    T* operator-> () const noexcept {
+        return get();
+    }
+
+    template <typename U = T>
+    typename enable_if<!is_void<U>::value, U&>::type operator* () const noexcept {
+        return *get();
+    }
+
+    template <typename U = T>
+    typename enable_if<!is_void<U>::value, U&>::type operator[] (ptrdiff_t const i) const noexcept {
+        return get()[i];
+    }
+
+    template <typename U = T>
+    static typename enable_if<!is_void<U>::value, offset_ptr>::type pointer_to(U& r) noexcept {
+        return offset_ptr(&r);
+    }
+
+    explicit operator bool() const noexcept {
+        return offset != null_offset;
+    }
+
+    //------------------------------------------------------------------------
+    // Arithmetic
+
+    offset_ptr& operator+= (ptrdiff_t const n) noexcept {
+        set(get() + n);
+        return *this;
+    }
+
+    offset_ptr& operator-= (ptrdiff_t const n) noexcept {
+        set(get() - n);
+        return *this;
+    }
+
+    offset_ptr& operator++ () noexcept {
+        return *this += 1;
+    }
+
+    offset_ptr& operator-- () noexcept {
+        return *this -= 1;
+    }
+
+    offset_ptr operator++ (int) noexcept {
+        offset_ptr const tmp(*this);
+        *this += 1;
+        return tmp;
+    }
+
+    offset_ptr operator-- (int) noexcept {
+        offset_ptr const tmp(*this);
+        *this -= 1;
+        return tmp;
+    }
+
+    friend offset_ptr operator+ (offset_ptr const& p, ptrdiff_t const n) noexcept {
+        return offset_ptr(p.get() + n);
+    }
+
+    friend offset_ptr operator+ (ptrdiff_t const n, offset_ptr const& p) noexcept {
+        return offset_ptr(p.get() + n);
+    }
+
+    friend offset_ptr operator- (offset_ptr const& p, ptrdiff_t const n) noexcept {
+        return offset_ptr(p.get() - n);
+    }
+
+    friend ptrdiff_t operator- (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() - b.get();
+    }
+
+    //------------------------------------------------------------------------
+    // Comparison
+
+    friend bool operator== (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() == b.get();
+    }
+
+    friend bool operator!= (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() != b.get();
+    }
+
+    friend bool operator< (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() < b.get();
+    }
+
+    friend bool operator<= (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() <= b.get();
+    }
+
+    friend bool operator> (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() > b.get();
+    }
+
+    friend bool operator>= (offset_ptr const& a, offset_ptr const& b) noexcept {
+        return a.get() >= b.get();
+    }
+
+    friend bool operator== (offset_ptr const& a, nullptr_t) noexcept {
+        return !a;
+    }
+
+    friend bool operator!= (offset_ptr const& a, nullptr_t) noexcept {
+        return bool(a);
+    }
+};
+
+//----------------------------------------------------------------------------
+// A persistent heap in a file, for node based structures. The file is a
+// file_vector of words mapped with 'fixed_address', so it grows in place
+// and objects in it can be used while it grows. Blocks are handed out in
+// power of two size classes, from 16 bytes up, from a free list for the
+// class, or else from the end of the used space, which grows the file.
+// Freed blocks go on their class's free list, with the offset of the next
+// free block in their first word. All of this is kept in a header at the
+// start of the file, so the arena can be closed and opened again.
+//
+// Pointers within the arena must be offset_ptrs. A root object, found again
+// on open, gives access to what is kept in the arena. Arenas are not
+// thread-safe.
+
+class persistent_arena {
+    using size_type = size_t;
+
+public:
+    static int constexpr create_file = file_vector<uint64_t>::create_file;
+    static size_type constexpr min_block = 16;
+    static size_type constexpr classes = 40;
+
+private:
+    static uint64_t constexpr magic = 0x6172656e61763031ull;
+
+    struct header {
+        uint64_t magic;
+        uint64_t top;
+        uint64_t root;
+        uint64_t free[classes];
+    };
+
+    file_vector<uint64_t> memory;
+
+    header& state() {
+        return *reinterpret_cast<header*>(memory.data());
+    }
+
+    header const& state() const {
+        return *reinterpret_cast<header const*>(memory.data());
+    }
+
+    static size_type size_class(size_type const bytes) {
+        size_type c = 0;
+        while ((min_block << c) < bytes) {
+            ++c;
+        }
+        if (c >= classes) {
+            throw bad_alloc();
+        }
+        return c;
+    }
+
+    // The open arenas, for allocators to find the arena they allocate from.
+    static vector<persistent_arena*>& open_arenas() {
+        static vector<persistent_arena*> arenas;
+        return arenas;
+    }
+
+    static mutex& open_arenas_lock() {
+        static mutex lock;
+        return lock;
+    }
+
+    // Bumped whenever an arena is closed, to invalidate cached lookups.
+    static atomic<uint64_t>& closed_arenas() {
+        static atomic<uint64_t> closed(0);
+        return closed;
+    }
+
+    void register_arena() {
+        lock_guard<mutex> guard(open_arenas_lock());
+        open_arenas().push_back(this);
+    }
+
+    void unregister_arena() {
+        lock_guard<mutex> guard(open_arenas_lock());
+        vector<persistent_arena*>& arenas = open_arenas();
+        arenas.erase(remove(arenas.begin(), arenas.end(), this), arenas.end());
+        closed_arenas().fetch_add(1, memory_order_release);
+    }
+
+public:
+    persistent_arena(string const& name, int mode = 0)
+    : memory(name, mode | file_vector<uint64_t>::fixed_address) {
+        if (memory.empty()) {
+            size_type const words = (sizeof(header) + min_block - 1) / min_block * min_block / 8;
+            memory.resize(words, 0);
+            state().magic = magic;
+            state().top = words * 8;
+        } else if (memory.size() * 8 < sizeof(header) || state().magic != magic) {
+            memory.close();
+            throw runtime_error("Not a persistent_arena file.");
+        }
+        register_arena();
+    }
+
+    persistent_arena(persistent_arena const&) = delete;
+    persistent_arena& operator= (persistent_arena const&) = delete;
+
+    ~persistent_arena() noexcept {
+        unregister_arena();
+    }
+
+    void close() {
+        unregister_arena();
+        memory.close();
+    }
+
+    // Write the arena to its file.
+    void flush() {
+        memory.flush();
+    }
+
+    // The open arena holding 'p'.
+    static persistent_arena& owner(void const* const p) {
+        char const* const c = static_cast<char const*>(p);
+        lock_guard<mutex> guard(open_arenas_lock());
+        for (persistent_arena* const arena : open_arenas()) {
+            if (arena->base() <= c && c < arena->base() + file_vector<uint64_t>::address_space) {
+                return *arena;
+            }
+        }
+        throw runtime_error("Pointer is not in an open persistent_arena.");
+    }
+
+    // The open arena based at 'base'. The last one found on each thread is
+    // kept until an arena is closed, so allocators usually skip owner().
+    static persistent_arena& at_base(char const* const base) {
+        struct lookup {
+            char const* base;
+            uint64_t closed;
+            persistent_arena* arena;
+        };
+        thread_local lookup last = {nullptr, 0, nullptr};
+        uint64_t const closed = closed_arenas().load(memory_order_acquire);
+        if (last.base != base || last.closed != closed) {
+            last = lookup {base, closed, &owner(base)};
+        }
+        return *last.arena;
+    }
+
+    char* base() {
+        return reinterpret_cast<char*>(memory.data());
+    }
+
+    char const* base() const {
+        return reinterpret_cast<char const*>(memory.data());
+    }
+
+    // Bytes handed out from the end of the used space, including the
+    // header and blocks now on free lists.
+    size_type used_bytes() const {
+        return state().top;
+    }
+
+    size_type capacity() const {
+        return memory.size() * 8;
+    }
+
+    //------------------------------------------------------------------------
+    // Allocation
+
+    // A block of at least 'bytes' bytes, aligned to 'alignment', or to its
+    // size, whichever is smaller.
+    void* allocate(size_type const bytes, size_type const alignment = min_block) {
+        size_type const c = size_class(max(bytes, alignment));
+        size_type const block = min_block << c;
+
+        header& h = state();
+        if (h.free[c] != 0) {
+            char* const p = base() + h.free[c];
+            memcpy(&h.free[c], p, sizeof(uint64_t));
+            return p;
+        }
+
+        size_type const align = min(block, size_type(getpagesize()));
+        size_type const offset = (h.top + align - 1) / align * align;
+        size_type const end = offset + block;
+        if (end > capacity()) {
+            memory.resize(max(end / 8, memory.size() * 3 / 2), 0);
+        }
+        // The file may have grown, but the base stays put.
+        state().top = end;
+        return base() + offset;
+    }
+
+    // Return a block of 'bytes' bytes from allocate.
+    void deallocate(void* const p, size_type const bytes, size_type const alignment = min_block) {
+        if (p == nullptr) {
+            return;
+        }
+        size_type const c = size_class(max(bytes, alignment));
+        header& h = state();
+        memcpy(p, &h.free[c], sizeof(uint64_t));
+        h.free[c] = static_cast<char*>(p) - base();
+    }
+
+    template <typename T, typename... Args>
+    T* construct(Args&&... args) {
+        void* const p = allocate(sizeof(T), alignof(T));
+        try {
+            return new (p) T(forward<Args>(args)...);
+        } catch (...) {
+            deallocate(p, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+
+    template <typename T>
+    void destroy(T* const p) {
+        if (p != nullptr) {
+            p->~T();
+            deallocate(p, sizeof(T), alignof(T));
+        }
+    }
+
+    // The root object, constructed from 'args' the first time, and found
+    // again when the arena is opened again. It must be the same type every
+    // time.
+    template <typename T, typename... Args>
+    T& root(Args&&... args) {
+        if (state().root == 0) {
+            T* const p = construct<T>(forward<Args>(args)...);
+            state().root = reinterpret_cast<char*>(p) - base();
+        }
+        return *reinterpret_cast<T*>(base() + state().root);
+    }
+};
+
+//----------------------------------------------------------------------------
+// An allocator from a persistent_arena, with offset_ptr pointers, so
+// standard containers can live in an arena. It keeps an offset_ptr to the
+// arena's base, and so can itself be kept in the arena, as part of a
+// container.
+//
+// Containers that keep their links as the allocator's pointers, such as
+// std::vector, can be found again when the arena is opened again. libstdc++
+// keeps the nodes of std::unordered_map (and std::map, std::list) linked
+// with plain pointers, so those only last while the arena stays open.
+
+template <typename T>
+class arena_allocator {
+    template <typename U> friend class arena_allocator;
+
+    offset_ptr<char> arena_base;
+
+public:
+    using value_type = T;
+    using pointer = offset_ptr<T>;
+    using const_pointer = offset_ptr<T const>;
+    using void_pointer = offset_ptr<void>;
+    using const_void_pointer = offset_ptr<void const>;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    template <typename U> struct rebind {
+        using other = arena_allocator<U>;
+    };
+
+    explicit arena_allocator(persistent_arena& arena) noexcept : arena_base(arena.base()) {}
+
+    arena_allocator(arena_allocator const& that) noexcept : arena_base(that.arena_base) {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const& that) noexcept : arena_base(that.arena_base) {}
+
+    arena_allocator& operator= (arena_allocator const& that) noexcept {
+        arena_base = that.arena_base;
+        return *this;
+    }
+
+    persistent_arena& arena() const {
+        return persistent_arena::at_base(arena_base.get());
+    }
+
+    pointer allocate(size_type const n) {
+        return pointer(static_cast<T*>(arena().allocate(n * sizeof(T), alignof(T))));
+    }
+
+    void deallocate(pointer const p, size_type const n) {
+        arena().deallocate(p.get(), n * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator== (arena_allocator<U> const& that) const noexcept {
+        return arena_base.get() == that.arena_base.get();
+    }
+
+    template <typename U>
+    bool operator!= (arena_allocator<U> const& that) const noexcept {
+        return !(*this == that);
+    }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef PERSISTENT_HASH_INDEX_HPP
+#define PERSISTENT_HASH_INDEX_HPP
+
+#include <memory>
+#include <optional>
+#include <functional>
+#include "file_vector.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A persistent hash index from keys to row numbers, for looking rows up by
+// key without rebuilding a map on every start: opening the index maps its
+// files.
+//
+// The table is open addressed in the manner of a Swiss table. Slots are in
+// groups of 16, each group with a tag byte per slot: 0 for empty, 1 for
+// deleted, and otherwise the top bit set with 7 bits of the key's hash. A
+// lookup starts at the group given by the rest of the hash and compares
+// the 16 tags of a group at once (with SSE2 where available), only
+// comparing keys where the tags match, moving on to the next group until
+// one with an empty slot. A freshly created table file is all zeros, which
+// is an empty table, so a new table costs nothing up front.
+//
+// Tables are files "<name>.<generation>", and "<name>" holds the index's
+// counts. Rehashing is incremental: when the table is 7/8 full a new one,
+// twice the size (or the same size, if it is mostly deleted slots), is
+// started, and every insert or erase after that moves the entries of a few
+// groups of the old table across, leaving deleted tags behind so lookups
+// through the old table still work. Lookups check the new table and then
+// the old one, so no operation waits for the whole table to be rehashed.
+//
+// Keys are compared with 'KeyEqual', which must agree with 'Hash'.
+//
+// The index can be kept up to date with a column of keys, indexing each
+// row by its row number. It is not thread-safe, and not crash-consistent.
+
+template <typename K, typename Hash = hash<K>, typename KeyEqual = equal_to<K>>
+class persistent_hash_index {
+    static_assert(is_trivially_copyable<K>::value, "persistent_hash_index needs a trivially copyable key.");
+
+    using size_type = size_t;
+
+public:
+    static int constexpr create_file = file_vector<uint64_t>::create_file;
+    static size_type constexpr group_size = 16;
+
+    struct slot {
+        K key;
+        uint64_t row;
+    };
+
+    struct group {
+        uint8_t tags[group_size];
+        slot slots[group_size];
+    };
+
+private:
+    static uint8_t constexpr empty_tag = 0;
+    static uint8_t constexpr deleted_tag = 1;
+    static uint64_t constexpr magic = 0x6861736869647831ull;
+    static size_type constexpr initial_groups = 16;
+    static size_type constexpr migrate_groups = 2;
+
+    enum meta_word {
+        magic_word, generation_word, size_word, occupied_word,
+        migrating_word, cursor_word, indexed_word, meta_words
+    };
+
+    string const name;
+    file_vector<uint64_t> meta;
+    unique_ptr<file_vector<group>> table;
+    unique_ptr<file_vector<group>> old_table;
+
+    string table_name(uint64_t const generation) const {
+        return name + "." + to_string(generation);
+    }
+
+    static uint64_t hash_of(K const& key) {
+        uint64_t x = Hash()(key);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    static uint8_t tag_of(uint64_t const h) {
+        return 0x80 | (h & 0x7f);
+    }
+
+    // Bit i set where tag i of 'g' is 't'.
+    static uint32_t match(group const& g, uint8_t const t) {
+#ifdef __SSE2__
+        __m128i const tags = _mm_loadu_si128(reinterpret_cast<__m128i const*>(g.tags));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(static_cast<char>(t))));
+#else
+        uint32_t bits = 0;
+        for (size_type i = 0; i < group_size; ++i) {
+            bits |= uint32_t(g.tags[i] == t) << i;
+        }
+        return bits;
+#endif
+    }
+
+    static bool key_equal(K const& a, K const& b) {
+        return KeyEqual()(a, b);
+    }
+
+    // The slot holding 'key' in 't', or null.
+    static slot* find_in(file_vector<group>& t, K const& key, uint64_t const h) {
+        size_type const mask = t.size() - 1;
+        uint8_t const tag = tag_of(h);
+        for (size_type i = 0, g = (h >> 7) & mask; i <= mask; ++i, g = (g + 1) & mask) {
+            group& grp = t.data()[g];
+            for (uint32_t bits = match(grp, tag); bits != 0; bits &= bits - 1) {
+                size_type const s = __builtin_ctz(bits);
+                if (key_equal(grp.slots[s].key, key)) {
+                    return &grp.slots[s];
+                }
+            }
+            if (match(grp, empty_tag) != 0) {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    // Put 'key' in the first free slot along its probe sequence in 't',
+    // where it is known not to be, returning whether the slot was empty
+    // rather than deleted.
+    static bool place(file_vector<group>& t, K const& key, uint64_t const row, uint64_t const h) {
+        size_type const mask = t.size() - 1;
+        for (size_type g = (h >> 7) & mask;; g = (g + 1) & mask) {
+            group& grp = t.data()[g];
+            uint32_t const free_slots = match(grp, empty_tag) | match(grp, deleted_tag);
+            if (free_slots != 0) {
+                size_type const s = __builtin_ctz(free_slots);
+                bool const was_empty = grp.tags[s] == empty_tag;
+                grp.tags[s] = tag_of(h);
+                grp.slots[s] = slot {key, row};
+                return was_empty;
+            }
+        }
+    }
+
+    static void erase_slot(file_vector<group>& t, slot* const s) {
+        size_type const offset = reinterpret_cast<char*>(s) - reinterpret_cast<char*>(t.data());
+        group& grp = t.data()[offset / sizeof(group)];
+        grp.tags[s - grp.slots] = deleted_tag;
+    }
+
+    unique_ptr<file_vector<group>> create_table(uint64_t const generation, size_type const groups) {
+        string const file = table_name(generation);
+        unlink(file.c_str());
+        unique_ptr<file_vector<group>> t(new file_vector<group>(file, create_file));
+        // The new file reads as zeros, an empty table, and the elements are
+        // trivial, so resize does not write them.
+        t->resize(groups);
+        return t;
+    }
+
+    size_type capacity_of(file_vector<group> const& t) const {
+        return t.size() * group_size;
+    }
+
+    // Move the entries of the next few groups of the old table across.
+    void migrate(size_type const groups) {
+        if (!meta[migrating_word]) {
+            return;
+        }
+        size_type cursor = meta[cursor_word];
+        size_type const last = min(cursor + groups, old_table->size());
+        for (; cursor < last; ++cursor) {
+            group& grp = old_table->data()[cursor];
+            for (size_type s = 0; s < group_size; ++s) {
+                if (grp.tags[s] & 0x80) {
+                    slot const& e = grp.slots[s];
+                    meta[occupied_word] += place(*table, e.key, e.row, hash_of(e.key));
+                    grp.tags[s] = deleted_tag;
+                }
+            }
+        }
+        meta[cursor_word] = cursor;
+
+        if (cursor == old_table->size()) {
+            string const file = old_table->file_name();
+            old_table->close();
+            old_table.reset();
+            unlink(file.c_str());
+            meta[migrating_word] = 0;
+            meta[cursor_word] = 0;
+        }
+    }
+
+    // Start a new table if the current one is too full to take another
+    // entry.
+    void make_room() {
+        if ((meta[occupied_word] + 1) * 8 <= capacity_of(*table) * 7) {
+            return;
+        }
+        if (meta[migrating_word]) {
+            migrate(old_table->size());
+        }
+
+        size_type const live = meta[size_word];
+        size_type groups = table->size();
+        if (live * 16 >= capacity_of(*table) * 7) {
+            groups *= 2;
+        }
+        uint64_t const generation = meta[generation_word] + 1;
+        old_table = move(table);
+        table = create_table(generation, groups);
+        meta[generation_word] = generation;
+        meta[occupied_word] = 0;
+        meta[migrating_word] = 1;
+        meta[cursor_word] = 0;
+    }
+
+public:
+    persistent_hash_index(string const& name, int mode = 0) : name(name), meta(name, mode) {
+        if (meta.empty()) {
+            meta.resize(meta_words, 0);
+            meta[magic_word] = magic;
+            table = create_table(0, initial_groups);
+        } else {
+            if (meta.size() != meta_words || meta[magic_word] != magic) {
+                meta.close();
+                throw runtime_error("Not a persistent_hash_index file.");
+            }
+            uint64_t const generation = meta[generation_word];
+            table.reset(new file_vector<group>(table_name(generation)));
+            if (meta[migrating_word]) {
+                old_table.reset(new file_vector<group>(table_name(generation - 1)));
+            }
+        }
+    }
+
+    void close() {
+        if (old_table) {
+            old_table->close();
+        }
+        if (table) {
+            table->close();
+        }
+        meta.close();
+    }
+
+    // Write the index to its files.
+    void flush() {
+        if (old_table) {
+            old_table->flush();
+        }
+        table->flush();
+        meta.flush();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return meta[size_word];
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Slots in the current table.
+    size_type capacity() const {
+        return capacity_of(*table);
+    }
+
+    // Whether entries are still being moved from an old table.
+    bool rehashing() const {
+        return meta[migrating_word] != 0;
+    }
+
+    //------------------------------------------------------------------------
+    // Lookup
+
+    optional<uint64_t> find(K const& key) const {
+        uint64_t const h = hash_of(key);
+        slot const* s = find_in(*table, key, h);
+        if (s == nullptr && old_table) {
+            s = find_in(*old_table, key, h);
+        }
+        return (s == nullptr) ? nullopt : optional<uint64_t>(s->row);
+    }
+
+    bool contains(K const& key) const {
+        return find(key).has_value();
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    // Index 'key' at 'row', replacing any row it had, returning whether it
+    // is new.
+    bool insert(K const& key, uint64_t const row) {
+        migrate(migrate_groups);
+        uint64_t const h = hash_of(key);
+        if (slot* const s = find_in(*table, key, h)) {
+            s->row = row;
+            return false;
+        }
+
+        // A key still in the old table is moved across.
+        bool found_old = false;
+        if (old_table) {
+            if (slot* const s = find_in(*old_table, key, h)) {
+                erase_slot(*old_table, s);
+                found_old = true;
+            }
+        }
+
+        make_room();
+        meta[occupied_word] += place(*table, key, row, h);
+        if (!found_old) {
+            ++meta[size_word];
+        }
+        return !found_old;
+    }
+
+    bool erase(K const& key) {
+        migrate(migrate_groups);
+        uint64_t const h = hash_of(key);
+        slot* s = find_in(*table, key, h);
+        file_vector<group>* t = table.get();
+        if (s == nullptr && old_table) {
+            s = find_in(*old_table, key, h);
+            t = old_table.get();
+        }
+        if (s == nullptr) {
+            return false;
+        }
+        erase_slot(*t, s);
+        --meta[size_word];
+        return true;
+    }
+
+    void clear() {
+        if (old_table) {
+            string const file = old_table->file_name();
+            old_table->close();
+            old_table.reset();
+            unlink(file.c_str());
+        }
+        string const file = table->file_name();
+        table->close();
+        unlink(file.c_str());
+        table = create_table(meta[generation_word], initial_groups);
+        meta[size_word] = 0;
+        meta[occupied_word] = 0;
+        meta[migrating_word] = 0;
+        meta[cursor_word] = 0;
+        meta[indexed_word] = 0;
+    }
+
+    //------------------------------------------------------------------------
+    // Columns
+
+    // Rows of the column indexed by update.
+    size_type indexed() const {
+        return meta[indexed_word];
+    }
+
+    // Index the rows appended to 'col' since the last update, each by its
+    // row number. If more rows are indexed than the column has, the index
+    // is stale and is rebuilt.
+    template <typename R>
+    void update(file_vector<K, R> const& col) {
+        size_type first = indexed();
+        if (first > col.size()) {
+            clear();
+            first = 0;
+        }
+        K const* const keys = col.data();
+        for (size_type i = first; i < col.size(); ++i) {
+            insert(keys[i], i);
+        }
+        meta[indexed_word] = col.size();
+    }
+};
+
+#endif
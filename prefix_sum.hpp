@@ -0,0 +1,272 @@
+#ifndef PREFIX_SUM_HPP
+#define PREFIX_SUM_HPP
+
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <type_traits>
+#include "file_vector.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Running sums of a column of arithmetic values, kept in a companion
+// file_vector, so the sum of any range of rows is two reads: element i is
+// the sum of rows [0, i]. Sums are int64_t for signed integers, uint64_t
+// for unsigned, and double for floating point, where the sum of a short
+// range far into a long column loses the precision of the large sums it is
+// the difference of.
+//
+// As the column can only be appended to (or cleared), a plain array of
+// sums is enough, rather than a Fenwick tree. As with zone_map, the sums
+// cover a prefix of the column and update continues from the last, or
+// rebuilds if they cover more rows than the column has, or the difference
+// of the last two sums is no longer the last covered row (to the rounding
+// of the sums for floating point). A column cleared and refilled past its
+// old length is so caught unless its new last covered row is the same;
+// other rewrites of covered rows need a rebuild. A
+// rebuild is computed in parallel: each thread sums its share of the rows,
+// and then writes the running sums of its share starting from the total of
+// the shares before it, with an AVX2 scan for double where available.
+// Floating point sums may so differ in the last bits between a rebuild and
+// rows added one at a time.
+
+template <typename T>
+class prefix_sum {
+    static_assert(is_arithmetic<T>::value, "prefix_sum needs an arithmetic type.");
+
+    using size_type = size_t;
+
+public:
+    using sum_type = typename conditional<is_floating_point<T>::value, double,
+        typename conditional<is_signed<T>::value, int64_t, uint64_t>::type>::type;
+
+private:
+    file_vector<sum_type> sums;
+
+    // Write the running sums of 'n' values, starting from 'carry', to 'out'.
+    static void scan(T const* const values, size_type const n, sum_type carry, sum_type* const out) {
+        size_type i = 0;
+#ifdef __AVX2__
+        if constexpr (is_same<T, double>::value) {
+            // Each group of four is scanned in the register with two shifted
+            // adds, then the carry is added and taken from the last lane.
+            __m256d const zero = _mm256_setzero_pd();
+            __m256d c = _mm256_set1_pd(carry);
+            for (; i + 4 <= n; i += 4) {
+                __m256d x = _mm256_loadu_pd(values + i);
+                x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+                x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+                x = _mm256_add_pd(x, c);
+                _mm256_storeu_pd(out + i, x);
+                c = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+            }
+            carry = _mm256_cvtsd_f64(c);
+        }
+#endif
+        for (; i < n; ++i) {
+            carry += values[i];
+            out[i] = carry;
+        }
+    }
+
+    // Whether the last covered row of 'col' is the difference of the last
+    // two sums. NaNs and infinities in the sums pass.
+    template <typename R>
+    bool fits_last(file_vector<T, R> const& col) const {
+        size_type const n = rows();
+        if (n == 0) {
+            return true;
+        }
+        sum_type const* const s = sums.data();
+        sum_type const before = (n > 1) ? s[n - 2] : sum_type(0);
+        sum_type const value = col.data()[n - 1];
+        if constexpr (is_floating_point<T>::value) {
+            sum_type const scale = max(fabs(before), fabs(s[n - 1]));
+            return !(fabs(s[n - 1] - before - value) > 4 * numeric_limits<sum_type>::epsilon() * scale);
+        } else {
+            return s[n - 1] - before == value;
+        }
+    }
+
+public:
+    prefix_sum(string const& name, int mode = 0) : sums(name, mode) {}
+
+    void close() {
+        sums.close();
+    }
+
+    // Number of column rows covered.
+    size_type rows() const {
+        return sums.size();
+    }
+
+    // The sum of rows [first, last).
+    sum_type sum(size_type const first, size_type const last) const {
+        assert(first <= last && last <= sums.size());
+
+        sum_type const* const s = sums.data();
+        return ((last > 0) ? s[last - 1] : sum_type(0)) - ((first > 0) ? s[first - 1] : sum_type(0));
+    }
+
+    // The sum of the first 'n' rows.
+    sum_type total(size_type const n) const {
+        return sum(0, n);
+    }
+
+    // Add the next row.
+    void add(T const value) {
+        sum_type const last = sums.empty() ? sum_type(0) : sums.back();
+        sums.push_back(last + value);
+    }
+
+    // Catch up with rows appended to 'col', with up to 'threads' threads, or
+    // rebuild if stale.
+    template <typename R>
+    void update(file_vector<T, R> const& col, unsigned const threads = 4) {
+        size_type first = rows();
+        if (first > col.size() || !fits_last(col)) {
+            sums.clear();
+            first = 0;
+        }
+        size_type const n = col.size() - first;
+        if (n == 0) {
+            return;
+        }
+
+        sum_type const carry = sums.empty() ? sum_type(0) : sums.back();
+        // The new sums are trivial, so resize does not write them.
+        sums.resize(col.size());
+        T const* const values = col.data() + first;
+        sum_type* const out = sums.data() + first;
+
+        size_type const shares = min(static_cast<size_type>(max(threads, 1u)), n / 65536 + 1);
+        if (shares == 1) {
+            scan(values, n, carry, out);
+            return;
+        }
+
+        vector<sum_type> totals(shares, 0);
+        auto const run = [&](auto f) {
+            vector<thread> workers;
+            for (size_type s = 1; s < shares; ++s) {
+                workers.emplace_back(f, s);
+            }
+            f(0);
+            for (thread& w : workers) {
+                w.join();
+            }
+        };
+        run([values, n, shares, &totals](size_type const s) {
+            sum_type total = 0;
+            for (size_type i = n * s / shares; i < n * (s + 1) / shares; ++i) {
+                total += values[i];
+            }
+            totals[s] = total;
+        });
+        run([values, n, shares, carry, out, &totals](size_type const s) {
+            sum_type start = carry;
+            for (size_type t = 0; t < s; ++t) {
+                start += totals[t];
+            }
+            size_type const from = n * s / shares;
+            scan(values + from, n * (s + 1) / shares - from, start, out + from);
+        });
+    }
+
+    template <typename R>
+    void rebuild(file_vector<T, R> const& col, unsigned const threads = 4) {
+        sums.clear();
+        update(col, threads);
+    }
+
+    void clear() {
+        sums.clear();
+    }
+};
+
+//----------------------------------------------------------------------------
+// A file_vector of arithmetic values with running sums, "<name>.sums", kept
+// up to date as rows are appended. Rows can only be appended or cleared.
+
+template <typename T>
+class summed_file_vector {
+    using size_type = size_t;
+
+    file_vector<T> values;
+    prefix_sum<T> sums;
+
+public:
+    using sum_type = typename prefix_sum<T>::sum_type;
+
+    static int constexpr create_file = file_vector<T>::create_file;
+
+    summed_file_vector(string const& name, int mode = 0)
+    : values(name, mode), sums(name + ".sums", mode) {
+        sums.update(values);
+    }
+
+    void close() {
+        values.close();
+        sums.close();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity and Element Access
+
+    size_type size() const {
+        return values.size();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    T const& operator[] (size_type const i) const {
+        assert(i < size());
+
+        return values.data()[i];
+    }
+
+    T const* data() const {
+        return values.data();
+    }
+
+    file_vector<T> const& column() const {
+        return values;
+    }
+
+    // The sum of rows [first, last), from two reads of the running sums.
+    sum_type sum(size_type const first, size_type const last) const {
+        if (first > last || last > size()) {
+            throw out_of_range("summed_file_vector::sum(size_t, size_t)");
+        }
+        return sums.sum(first, last);
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const value) {
+        values.push_back(value);
+        sums.add(value);
+    }
+
+    template <typename I, typename = typename I::iterator_category>
+    void append(I first, I last) {
+        values.insert(values.cend(), first, last);
+        sums.update(values);
+    }
+
+    void clear() {
+        values.clear();
+        sums.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef ROLLUP_HPP
+#define ROLLUP_HPP
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "file_vector.hpp"
+#include "group_by.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Time bucketed aggregates of a column of values by a sorted column of
+// integer timestamps, one per 'width' of time, such as OHLC bars a minute
+// or an hour wide, kept in a companion file_vector. Reading the bars of a
+// period is then a read of its buckets, not a scan of its rows.
+//
+// As with zone_map, the buckets only ever cover a prefix of the columns,
+// and update continues from the last bucket, so rows appended are added
+// incrementally. Large updates, and rebuild, split the rows between
+// threads, aggregating runs of rows in the same bucket as group_by does for
+// sorted keys. If the buckets cover more rows than the columns have, or the
+// last row they cover is no longer in the last bucket, they are stale and
+// are rebuilt. Columns cleared and refilled past their old length are so
+// caught unless the new last covered row falls in the same bucket; other
+// rewrites of covered rows need a rebuild. Timestamps must not go back a
+// bucket, and update and add throw if they do.
+//
+// The aggregate is as for group_by, ohlc by default. For several value
+// columns, such as price and size, use a struct of values with an
+// aggregate of them.
+
+template <typename V>
+struct ohlc {
+    V open;
+    V high;
+    V low;
+    V close;
+    uint64_t count;
+
+    static ohlc of(V const& value) {
+        return ohlc {value, value, value, value, 1};
+    }
+
+    void add(V const& value) {
+        high = (high < value) ? value : high;
+        low = (value < low) ? value : low;
+        close = value;
+        ++count;
+    }
+
+    void merge(ohlc const& that) {
+        high = (high < that.high) ? that.high : high;
+        low = (that.low < low) ? that.low : low;
+        close = that.close;
+        count += that.count;
+    }
+};
+
+template <typename T, typename V, typename A = ohlc<V>>
+class rollup {
+    static_assert(is_integral<T>::value, "rollup needs integer timestamps.");
+
+    using size_type = size_t;
+
+public:
+    // The bucket starting at 'start', covering rows up to 'end'.
+    struct bucket {
+        T start;
+        uint64_t end;
+        A aggregate;
+    };
+
+private:
+    // An aggregate that also counts rows, for the ends of buckets.
+    struct counted {
+        uint64_t rows;
+        A aggregate;
+
+        static counted of(V const& value) {
+            return counted {1, A::of(value)};
+        }
+
+        void add(V const& value) {
+            ++rows;
+            aggregate.add(value);
+        }
+
+        void merge(counted const& that) {
+            rows += that.rows;
+            aggregate.merge(that.aggregate);
+        }
+    };
+
+    T const bucket_width;
+    file_vector<bucket> buckets;
+
+    // Append the aggregate 'a' of rows up to 'end' in the bucket 'start'.
+    void extend(T const start, uint64_t const end, A const& a) {
+        if (!buckets.empty() && buckets.back().start == start) {
+            bucket& b = buckets.back();
+            b.aggregate.merge(a);
+            b.end = end;
+        } else if (buckets.empty() || buckets.back().start < start) {
+            buckets.push_back(bucket {start, end, a});
+        } else {
+            throw runtime_error("Timestamps out of order for rollup.");
+        }
+    }
+
+    // Whether the last covered row of 'times' is in the last bucket.
+    template <typename R>
+    bool fits_last(file_vector<T, R> const& times) const {
+        size_type const n = rows();
+        return n == 0 || bucket_of(times.data()[n - 1]) == buckets.back().start;
+    }
+
+public:
+    rollup(string const& name, T const width, int mode = 0)
+    : bucket_width(width), buckets(name, mode) {
+        if (width <= 0) {
+            buckets.close();
+            throw runtime_error("Width of rollup must be positive.");
+        }
+    }
+
+    void close() {
+        buckets.close();
+    }
+
+    T width() const {
+        return bucket_width;
+    }
+
+    // The start of the bucket holding time 't'.
+    T bucket_of(T const t) const {
+        T const r = t % bucket_width;
+        return (r < 0) ? t - r - bucket_width : t - r;
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity and Element Access
+
+    // Number of column rows covered.
+    size_type rows() const {
+        return buckets.empty() ? 0 : buckets.back().end;
+    }
+
+    size_type size() const {
+        return buckets.size();
+    }
+
+    bool empty() const {
+        return buckets.empty();
+    }
+
+    bucket const& operator[] (size_type const b) const {
+        assert(b < buckets.size());
+
+        return buckets.data()[b];
+    }
+
+    bucket const* begin() const {
+        return buckets.data();
+    }
+
+    bucket const* end() const {
+        return buckets.data() + buckets.size();
+    }
+
+    // The buckets starting in [from, to), as a range of bucket numbers.
+    pair<size_type, size_type> between(T const from, T const to) const {
+        auto const starts_before = [](bucket const& b, T const t) {
+            return b.start < t;
+        };
+        bucket const* const first = lower_bound(begin(), end(), from, starts_before);
+        bucket const* const last = lower_bound(first, end(), to, starts_before);
+        return make_pair(first - begin(), last - begin());
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    // Add the next row.
+    void add(T const time, V const& value) {
+        extend(bucket_of(time), rows() + 1, A::of(value));
+    }
+
+    // Catch up with rows appended to the columns, with up to 'threads'
+    // threads, or rebuild if stale.
+    template <typename RT, typename RV>
+    void update(file_vector<T, RT> const& times, file_vector<V, RV> const& values, unsigned const threads = 4) {
+        if (times.size() != values.size()) {
+            throw runtime_error("Time and value columns differ in size for rollup.");
+        }
+        size_type first = rows();
+        if (first > times.size() || !fits_last(times)) {
+            buckets.clear();
+            first = 0;
+        }
+        size_type const n = times.size() - first;
+        if (n == 0) {
+            return;
+        }
+
+        T const* const t = times.data() + first;
+        V const* const v = values.data() + first;
+        unsigned const shares = static_cast<unsigned>(min(static_cast<size_type>(max(threads, 1u)), n / 65536 + 1));
+        auto const groups = group_by_detail::group_sorted<T, counted>(n, [this, t](size_type const i) {
+            return bucket_of(t[i]);
+        }, [v](size_type const i) {
+            return v[i];
+        }, shares);
+
+        uint64_t end = first;
+        for (auto const& piece : groups) {
+            for (auto const& g : piece) {
+                end += g.aggregate.rows;
+                extend(g.key, end, g.aggregate.aggregate);
+            }
+        }
+    }
+
+    template <typename RT, typename RV>
+    void rebuild(file_vector<T, RT> const& times, file_vector<V, RV> const& values, unsigned const threads = 4) {
+        buckets.clear();
+        update(times, values, threads);
+    }
+
+    void clear() {
+        buckets.clear();
+    }
+};
+
+//----------------------------------------------------------------------------
+// A column of timestamps, "<name>", and values, "<name>.values", with
+// rollups of several widths, "<name>.rollup.<width>", kept up to date as
+// rows are appended. Rows can only be appended in time order, or cleared.
+
+template <typename T, typename V, typename A = ohlc<V>>
+class rollup_file_vector {
+    using size_type = size_t;
+
+    file_vector<T> times;
+    file_vector<V> values;
+    vector<unique_ptr<rollup<T, V, A>>> rollups;
+
+    void check_order(T const time) const {
+        if (!times.empty() && time < times.back()) {
+            throw runtime_error("Timestamps out of order for rollup_file_vector.");
+        }
+    }
+
+public:
+    static int constexpr create_file = file_vector<T>::create_file;
+
+    rollup_file_vector(string const& name, vector<T> const& widths, int mode = 0)
+    : times(name, mode), values(name + ".values", mode) {
+        for (T const width : widths) {
+            rollups.emplace_back(new rollup<T, V, A>(name + ".rollup." + to_string(width), width, mode));
+            rollups.back()->update(times, values);
+        }
+    }
+
+    void close() {
+        times.close();
+        values.close();
+        for (auto& r : rollups) {
+            r->close();
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity and Element Access
+
+    size_type size() const {
+        return times.size();
+    }
+
+    bool empty() const {
+        return times.empty();
+    }
+
+    file_vector<T> const& time_column() const {
+        return times;
+    }
+
+    file_vector<V> const& value_column() const {
+        return values;
+    }
+
+    // The rollup of width 'width'.
+    rollup<T, V, A> const& bars(T const width) const {
+        for (auto const& r : rollups) {
+            if (r->width() == width) {
+                return *r;
+            }
+        }
+        throw out_of_range("rollup_file_vector::bars(T)");
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const time, V const& value) {
+        check_order(time);
+        times.push_back(time);
+        values.push_back(value);
+        for (auto& r : rollups) {
+            r->add(time, value);
+        }
+    }
+
+    // Append the rows with times [first, last) and values from 'value'.
+    template <typename I, typename J, typename = typename I::iterator_category>
+    void append(I first, I last, J value) {
+        if (first != last) {
+            check_order(*first);
+            if (!is_sorted(first, last)) {
+                throw runtime_error("Timestamps out of order for rollup_file_vector.");
+            }
+        }
+        size_type const n = last - first;
+        times.insert(times.cend(), first, last);
+        values.insert(values.cend(), value, value + n);
+        for (auto& r : rollups) {
+            r->update(times, values);
+        }
+    }
+
+    void clear() {
+        times.clear();
+        values.clear();
+        for (auto& r : rollups) {
+            r->clear();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,548 @@
+#ifndef SORTED_FILE_VECTOR_HPP
+#define SORTED_FILE_VECTOR_HPP
+
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include "file_vector.hpp"
+#include "kway_merge.hpp"
+
+extern "C" {
+    #include <dirent.h>
+}
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A sorted column for data that mostly arrives in order. Values that are not
+// less than anything already stored are appended to the base file_vector.
+// Late values are inserted into a small sorted delta file_vector instead,
+// "<name>.delta", which is merged into the base lazily once it grows past
+// 'max_delta' elements. The merge runs backwards from the end of the base,
+// so it only rewrites the tail after the first late value, and all elements
+// are read through a merged view of the base and delta.
+//
+// With the default 'max_delta' of about sqrt(size) the cost of a late insert
+// is amortised to O(sqrt(size)) elements moved, instead of the O(size) of
+// file_vector::insert.
+//
+// Batches of late values are sorted into their own run files,
+// "<name>.run.<id>", and read through the same merged view. Once there are
+// 'max_runs' runs, the base and runs are compacted by a background thread
+// with a k-way merge into "<name>.compact", reading the sources and writing
+// the output sequentially. The base and runs being compacted are not
+// modified while this happens, so reads and inserts carry on without
+// waiting, with inserts going into the delta. The new base is installed by
+// the next modifier after the merge finishes, or by wait(). Installing is
+// made crash safe by the record "<name>.compacted", which holds the last
+// run id that was merged, and is resolved when the vector is next opened.
+//
+// All iterators are invalidated by modifiers and by wait().
+
+template <typename T, typename Compare = less<T>>
+class sorted_file_vector {
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using column = file_vector<T>;
+    using source = typename loser_tree<T, Compare>::source;
+
+    static size_type constexpr min_delta = 1024;
+
+    struct run {
+        uint64_t id;
+        unique_ptr<column> values;
+    };
+
+    string const name;
+    unique_ptr<column> base;
+    vector<run> runs;
+    unique_ptr<column> delta;
+    Compare comp;
+    size_type const max_delta;
+    size_type const max_runs;
+    uint64_t next_run;
+
+    // Background compaction of the base and the first 'compacting' runs.
+    thread compactor;
+    atomic<bool> compacted;
+    exception_ptr compact_error;
+    size_type compacting;
+
+    size_type delta_limit() const {
+        if (max_delta > 0) {
+            return max_delta;
+        }
+        size_type const limit = sqrt(static_cast<double>(base->size()));
+        return (limit < min_delta) ? min_delta : limit;
+    }
+
+    string run_name(uint64_t const id) const {
+        return name + ".run." + to_string(id);
+    }
+
+    //------------------------------------------------------------------------
+    // Open and recovery
+
+    static bool exists(string const& path) {
+        return access(path.c_str(), F_OK) == 0;
+    }
+
+    static void sync_file(string const& path) {
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1 || fsync(fd) == -1) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+            throw runtime_error("Unable to sync file for sorted_file_vector.");
+        }
+        ::close(fd);
+    }
+
+    void recover_compaction() {
+        string const record_name = name + ".compacted";
+        string const compact_name = name + ".compact";
+
+        int const fd = open(record_name.c_str(), O_RDONLY);
+        if (fd == -1) {
+            // A compaction that did not finish, the sources are intact.
+            if (exists(compact_name) && unlink(compact_name.c_str()) == -1) {
+                throw runtime_error("Unable to remove partial compaction for sorted_file_vector.");
+            }
+            return;
+        }
+
+        uint64_t last = 0;
+        ssize_t const n = pread(fd, &last, sizeof(last), 0);
+        ::close(fd);
+        if (n != sizeof(last)) {
+            throw runtime_error("Unable to read compaction record for sorted_file_vector.");
+        }
+
+        // The compaction finished, complete the install.
+        if (exists(compact_name) && rename(compact_name.c_str(), name.c_str()) == -1) {
+            throw runtime_error("Unable to install compaction for sorted_file_vector.");
+        }
+        for (uint64_t const id : find_runs()) {
+            if (id <= last) {
+                unlink(run_name(id).c_str());
+            }
+        }
+        unlink(record_name.c_str());
+    }
+
+    vector<uint64_t> find_runs() const {
+        size_type const slash = name.rfind('/');
+        string const dir = (slash == string::npos) ? "." : name.substr(0, slash + 1);
+        string const prefix = ((slash == string::npos) ? name : name.substr(slash + 1)) + ".run.";
+
+        DIR* const d = opendir(dir.c_str());
+        if (d == nullptr) {
+            throw runtime_error("Unable to list runs for sorted_file_vector.");
+        }
+
+        vector<uint64_t> ids;
+        while (dirent const* const entry = readdir(d)) {
+            string const file = entry->d_name;
+            if (file.compare(0, prefix.size(), prefix) == 0 && file.size() > prefix.size()) {
+                ids.push_back(strtoull(file.c_str() + prefix.size(), nullptr, 10));
+            }
+        }
+        closedir(d);
+
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    //------------------------------------------------------------------------
+    // Runs and compaction
+
+    // The largest value stored, if 'value' is not less than it, then 'value'
+    // can be appended to the base.
+    bool in_order(T const& value) const {
+        if (!base->empty() && comp(value, base->back())) {
+            return false;
+        }
+        for (run const& r : runs) {
+            if (!r.values->empty() && comp(value, r.values->back())) {
+                return false;
+            }
+        }
+        return delta->empty() || !comp(value, delta->back());
+    }
+
+    void seal_delta() {
+        if (delta->empty()) {
+            return;
+        }
+
+        uint64_t const id = next_run++;
+        delta->close();
+        if (rename((name + ".delta").c_str(), run_name(id).c_str()) == -1) {
+            throw runtime_error("Unable to seal delta for sorted_file_vector.");
+        }
+        runs.push_back(run {id, unique_ptr<column>(new column(run_name(id)))});
+        delta.reset(new column(name + ".delta", create_file));
+    }
+
+    vector<source> sources(size_type const n_runs, bool const with_delta) const {
+        vector<source> s;
+        s.push_back(source(base->data(), base->data() + base->size()));
+        for (size_type i = 0; i < n_runs; ++i) {
+            column const& r = *runs[i].values;
+            s.push_back(source(r.data(), r.data() + r.size()));
+        }
+        if (with_delta) {
+            s.push_back(source(delta->data(), delta->data() + delta->size()));
+        }
+        return s;
+    }
+
+    void start_compaction() {
+        if (compactor.joinable() || runs.empty()) {
+            return;
+        }
+
+        compacting = runs.size();
+        compacted = false;
+        compact_error = nullptr;
+
+        size_type total = base->size();
+        for (run const& r : runs) {
+            total += r.values->size();
+        }
+
+        vector<source> const from = sources(compacting, false);
+        string const to = name + ".compact";
+        Compare const c = comp;
+
+        compactor = thread([this, from, to, total, c] {
+            try {
+                column out(to, create_file);
+                out.clear();
+                out.reserve(total);
+                kway_merge<T>(from, out, c);
+                out.close();
+                sync_file(to);
+            } catch (...) {
+                compact_error = current_exception();
+            }
+            compacted = true;
+        });
+    }
+
+    void finish_compaction() {
+        compactor.join();
+
+        if (compact_error != nullptr) {
+            exception_ptr const error = compact_error;
+            compact_error = nullptr;
+            unlink((name + ".compact").c_str());
+            rethrow_exception(error);
+        }
+
+        string const record_name = name + ".compacted";
+        uint64_t const last = runs[compacting - 1].id;
+        int const fd = open(record_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd == -1
+            || pwrite(fd, &last, sizeof(last), 0) != sizeof(last)
+            || fsync(fd) == -1
+        ) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+            throw runtime_error("Unable to write compaction record for sorted_file_vector.");
+        }
+        ::close(fd);
+
+        base->close();
+        if (rename((name + ".compact").c_str(), name.c_str()) == -1) {
+            throw runtime_error("Unable to install compaction for sorted_file_vector.");
+        }
+        for (size_type i = 0; i < compacting; ++i) {
+            runs[i].values->close();
+            unlink(run_name(runs[i].id).c_str());
+        }
+        runs.erase(runs.begin(), runs.begin() + compacting);
+        unlink(record_name.c_str());
+
+        base.reset(new column(name));
+        compacting = 0;
+    }
+
+    // Install a finished compaction without waiting for a running one.
+    void poll() {
+        if (compactor.joinable() && compacted) {
+            finish_compaction();
+        }
+    }
+
+public:
+    static int constexpr create_file = column::create_file;
+
+    sorted_file_vector(
+        string const& name, int mode = 0, size_type max_delta = 0,
+        size_type max_runs = 8, Compare comp = Compare()
+    ) : name(name), comp(comp), max_delta(max_delta), max_runs(max_runs)
+    , next_run(0), compacted(false), compacting(0) {
+        recover_compaction();
+        base.reset(new column(name, mode));
+        for (uint64_t const id : find_runs()) {
+            runs.push_back(run {id, unique_ptr<column>(new column(run_name(id)))});
+            next_run = id + 1;
+        }
+        delta.reset(new column(name + ".delta", mode));
+    }
+
+    virtual ~sorted_file_vector() noexcept {
+        if (compactor.joinable()) {
+            try {
+                finish_compaction();
+            } catch (...) {
+                // ignore, the compaction is recovered or discarded on open.
+            }
+        }
+    }
+
+    // Wait for any background compaction to finish and install it.
+    void wait() {
+        if (compactor.joinable()) {
+            finish_compaction();
+        }
+    }
+
+    void close() {
+        wait();
+        base->close();
+        for (run& r : runs) {
+            r.values->close();
+        }
+        delta->close();
+    }
+
+    //------------------------------------------------------------------------
+    // Merged view
+
+    class const_iterator {
+    public:
+        using difference_type = sorted_file_vector::difference_type;
+        using value_type = T;
+        using reference = T const&;
+        using pointer = T const*;
+        using iterator_category = forward_iterator_tag;
+
+    private:
+        friend sorted_file_vector;
+        vector<source> from;
+        size_type current;
+        Compare comp;
+
+        // Equal values come from older sources first.
+        void find_current() {
+            current = from.size();
+            for (size_type i = 0; i < from.size(); ++i) {
+                if (from[i].first != from[i].second && (current == from.size()
+                    || comp(*from[i].first, *from[current].first))
+                ) {
+                    current = i;
+                }
+            }
+        }
+
+        const_iterator(vector<source> const& from, Compare comp)
+        : from(from), comp(comp) {
+            find_current();
+        }
+
+    public:
+        const_iterator& operator++ () {
+            ++from[current].first;
+            find_current();
+            return *this;
+        }
+        const_iterator operator++ (int)
+            {const_iterator i {*this}; ++(*this); return i;}
+
+        bool operator== (const_iterator const &that) const
+            {return from == that.from;}
+        bool operator!= (const_iterator const &that) const
+            {return from != that.from;}
+        T const* operator-> () const
+            {return from[current].first;}
+        T const& operator* () const
+            {return *from[current].first;}
+    };
+
+    const_iterator begin() const {
+        return const_iterator(sources(runs.size(), true), comp);
+    }
+
+    const_iterator end() const {
+        vector<source> s = sources(runs.size(), true);
+        for (source& i : s) {
+            i.first = i.second;
+        }
+        return const_iterator(s, comp);
+    }
+
+    const_iterator lower_bound(T const& value) const {
+        vector<source> s = sources(runs.size(), true);
+        for (source& i : s) {
+            i.first = std::lower_bound(i.first, i.second, value, comp);
+        }
+        return const_iterator(s, comp);
+    }
+
+    const_iterator upper_bound(T const& value) const {
+        vector<source> s = sources(runs.size(), true);
+        for (source& i : s) {
+            i.first = std::upper_bound(i.first, i.second, value, comp);
+        }
+        return const_iterator(s, comp);
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        size_type n = base->size() + delta->size();
+        for (run const& r : runs) {
+            n += r.values->size();
+        }
+        return n;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Number of values waiting in the delta to be merged.
+    size_type pending() const {
+        return delta->size();
+    }
+
+    // Number of sorted runs waiting to be compacted.
+    size_type run_count() const {
+        return runs.size();
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void clear() {
+        wait();
+        base->clear();
+        for (run& r : runs) {
+            r.values->close();
+            unlink(run_name(r.id).c_str());
+        }
+        runs.clear();
+        delta->clear();
+    }
+
+    void insert(T const& value) {
+        poll();
+
+        if (!compactor.joinable() && in_order(value)) {
+            base->push_back(value);
+            return;
+        }
+
+        T const* const d = delta->data();
+        delta->insert(
+            delta->cbegin() + (std::upper_bound(d, d + delta->size(), value, comp) - d),
+            value
+        );
+
+        if (delta->size() > delta_limit()) {
+            if (compactor.joinable()) {
+                seal_delta();
+            } else {
+                merge();
+            }
+        }
+    }
+
+    // Insert a batch of values in any order. The batch is sorted in its own
+    // run file, unless it all follows the existing values, when it is
+    // appended to the base.
+    template <typename I, typename = typename I::iterator_category>
+    void insert(I first, I last) {
+        poll();
+
+        if (first == last) {
+            return;
+        }
+
+        uint64_t const id = next_run++;
+        unique_ptr<column> r(new column(run_name(id), create_file));
+        r->assign(first, last);
+        sort(r->data(), r->data() + r->size(), comp);
+
+        if (!compactor.joinable() && in_order(r->front())) {
+            base->insert(base->cend(), r->cbegin(), r->cend());
+            r->close();
+            unlink(run_name(id).c_str());
+            return;
+        }
+
+        runs.push_back(run {id, move(r)});
+        if (runs.size() >= max_runs) {
+            start_compaction();
+        }
+    }
+
+    // Merge the delta into the base from the back, so only the elements
+    // after the first delta value are moved. While a compaction is running
+    // the base cannot change, so the delta is sealed as a run instead.
+    void merge() {
+        if (compactor.joinable()) {
+            seal_delta();
+            return;
+        }
+
+        size_type const m = delta->size();
+        if (m == 0) {
+            return;
+        }
+
+        size_type const n = base->size();
+        size_type const first = std::upper_bound(
+            base->data(), base->data() + n, delta->front(), comp
+        ) - base->data();
+
+        base->resize(n + m);
+
+        T* const b = base->data();
+        T const* const d = delta->data();
+        size_type i = n;
+        size_type j = m;
+        size_type k = n + m;
+        while (j > 0) {
+            if (i > first && comp(d[j - 1], b[i - 1])) {
+                b[--k] = b[--i];
+            } else {
+                b[--k] = d[--j];
+            }
+        }
+
+        delta->clear();
+    }
+
+    // Start compacting the base and all runs into a new base in the
+    // background. The delta is sealed first so it is included. Does nothing
+    // if a compaction is already running.
+    void compact() {
+        poll();
+        if (!compactor.joinable()) {
+            seal_delta();
+            start_compaction();
+        }
+    }
+};
+
+#endif
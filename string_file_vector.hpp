@@ -0,0 +1,224 @@
+#ifndef STRING_FILE_VECTOR_HPP
+#define STRING_FILE_VECTOR_HPP
+
+#include <cstring>
+#include <string_view>
+#include "file_vector.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// A column of variable length values, strings or blobs. The bytes of all
+// values are appended to a heap file_vector<char>, "<name>", and the end
+// offset of each value in the heap to "<name>.offsets", so value i is the
+// bytes from the end of value i - 1 to the end of value i. Both files grow
+// with the usual file_vector reservation, and values are read in place as
+// string_views into the heap mapping, so scans do not copy.
+//
+// Both files are opened with commit_appends, so after a crash each is
+// recovered to its last commit rather than to its reserved length. The heap
+// is committed before the offsets, so any heap bytes past the last offset
+// are unused and are trimmed on open.
+//
+// Views are invalidated by anything that may grow the heap.
+
+class string_file_vector {
+    using size_type = size_t;
+
+    // Declared before the heap, so the heap is destroyed, and committed,
+    // first.
+    file_vector<uint64_t> offsets;
+    file_vector<char> heap;
+
+    size_type start(size_type const i) const {
+        return (i == 0) ? 0 : offsets.data()[i - 1];
+    }
+
+    void append_bytes(char const* bytes, size_type const n) {
+        size_type const end = heap.size();
+        // Growing the heap may remap it, so a value from the heap itself is
+        // found again by its offset.
+        bool const inside = end > 0 && bytes >= heap.data() && bytes < heap.data() + end;
+        size_type const from = inside ? bytes - heap.data() : 0;
+        heap.resize(end + n);
+        if (n > 0) {
+            memcpy(heap.data() + end, inside ? heap.data() + from : bytes, n);
+        }
+        offsets.push_back(end + n);
+    }
+
+public:
+    static int constexpr create_file = file_vector<char>::create_file;
+
+    string_file_vector(string const& name, int mode = 0)
+    : offsets(name + ".offsets", mode | file_vector<uint64_t>::commit_appends)
+    , heap(name, mode | file_vector<char>::commit_appends) {
+        size_type const end = offsets.empty() ? 0 : offsets.back();
+        if (heap.size() < end) {
+            throw runtime_error("Heap is shorter than the offsets for string_file_vector.");
+        }
+        heap.resize(end);
+    }
+
+    // Make the values appended so far durable, the heap first.
+    void commit() {
+        heap.commit();
+        offsets.commit();
+    }
+
+    void close() {
+        heap.close();
+        offsets.close();
+    }
+
+    //------------------------------------------------------------------------
+    // Iterator
+
+    class const_iterator {
+    public:
+        using difference_type = ptrdiff_t;
+        using value_type = string_view;
+        using reference = string_view;
+        using pointer = void;
+        using iterator_category = random_access_iterator_tag;
+
+    private:
+        friend string_file_vector;
+        string_file_vector const* from;
+        size_type i;
+
+        const_iterator(string_file_vector const* from, size_type i) : from(from), i(i)
+            {}
+
+    public:
+        const_iterator& operator++ ()
+            {++i; return *this;}
+        const_iterator operator++ (int)
+            {const_iterator j {*this}; ++i; return j;}
+        const_iterator& operator-- ()
+            {--i; return *this;}
+        const_iterator operator-- (int)
+            {const_iterator j {*this}; --i; return j;}
+
+        bool operator== (const_iterator const &that) const
+            {return i == that.i;}
+        bool operator!= (const_iterator const &that) const
+            {return i != that.i;}
+        bool operator< (const_iterator const &that) const
+            {return i < that.i;}
+        bool operator<= (const_iterator const &that) const
+            {return i <= that.i;}
+        bool operator> (const_iterator const &that) const
+            {return i > that.i;}
+        bool operator>= (const_iterator const &that) const
+            {return i >= that.i;}
+
+        difference_type operator- (const_iterator const &that) const
+            {return i - that.i;}
+        const_iterator operator+ (difference_type const n) const
+            {return const_iterator(from, i + n);}
+        const_iterator operator- (difference_type const n) const
+            {return const_iterator(from, i - n);}
+        const_iterator& operator+= (difference_type const n)
+            {i += n; return *this;}
+        const_iterator& operator-= (difference_type const n)
+            {i -= n; return *this;}
+
+        string_view operator* () const
+            {return (*from)[i];}
+        string_view operator[] (difference_type const n) const
+            {return (*from)[i + n];}
+    };
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, size());
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity
+
+    size_type size() const {
+        return offsets.size();
+    }
+
+    bool empty() const {
+        return offsets.empty();
+    }
+
+    // Total bytes of all values.
+    size_type bytes() const {
+        return heap.size();
+    }
+
+    // Reserve space for 'n' more values totalling 'bytes' more bytes.
+    void reserve(size_type const n, size_type const bytes) {
+        offsets.reserve(n);
+        heap.reserve(bytes);
+    }
+
+    //------------------------------------------------------------------------
+    // Element Access
+
+    string_view operator[] (size_type const i) const {
+        assert(i < size());
+
+        size_type const first = start(i);
+        return string_view(heap.data() + first, offsets.data()[i] - first);
+    }
+
+    string_view at(size_type const i) const {
+        if (i >= size()) {
+            throw out_of_range("string_file_vector::at(size_type)");
+        }
+        return (*this)[i];
+    }
+
+    string_view front() const {
+        return (*this)[0];
+    }
+
+    string_view back() const {
+        return (*this)[size() - 1];
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(string_view const value) {
+        append_bytes(value.data(), value.size());
+    }
+
+    // Append a range of values convertible to string_view, reserving space
+    // for all of them first.
+    template <typename I>
+    void append(I first, I last) {
+        size_type n = 0;
+        size_type total = 0;
+        for (I i = first; i != last; ++i) {
+            ++n;
+            total += string_view(*i).size();
+        }
+        reserve(n, total);
+        for (; first != last; ++first) {
+            push_back(string_view(*first));
+        }
+    }
+
+    void pop_back() {
+        assert(!empty());
+
+        offsets.pop_back();
+        heap.resize(empty() ? 0 : offsets.back());
+    }
+
+    void clear() {
+        heap.clear();
+        offsets.clear();
+    }
+};
+
+#endif
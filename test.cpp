@@ -1,17 +1,72 @@
 #include <iostream>
 #include <cassert>
+#include <functional>
+#include <unordered_map>
+#include <random>
+#include <numeric>
+
 #include "file_vector.hpp"
+#include "sorted_file_vector.hpp"
+#include "compressed_file_vector.hpp"
+#include "dictionary_file_vector.hpp"
+#include "string_file_vector.hpp"
+#include "filter.hpp"
+#include "zone_map.hpp"
+#include "file_bitset.hpp"
+#include "async_scan.hpp"
+#include "ingest_file_vector.hpp"
+#include "coroutine_scan.hpp"
+#include "checksummed_file_vector.hpp"
+#include "persistent_arena.hpp"
+#include "persistent_hash_index.hpp"
+#include "external_sort.hpp"
+#include "join.hpp"
+#include "group_by.hpp"
+#include "rollup.hpp"
+#include "prefix_sum.hpp"
 
 extern "C" {
     #include <unistd.h>
+    #include <sys/wait.h>
+    #include <sys/stat.h>
 }
 
 using namespace std;
 using fv_int = file_vector<int>;
 
-void test_out_of_range(fv_int& fv, int const i) {
+struct triple {
+    int a;
+    int b;
+    int c;
+};
+
+task<int64_t> sum_chunks(file_vector<int> const& col, size_t const chunk_rows) {
+    int64_t sum = 0;
+    auto chunks = scan_chunks(col, chunk_rows, 2);
+    while (auto const c = co_await chunks.next()) {
+        for (size_t i = 0; i < c->size; ++i) {
+            sum += c->values[i];
+        }
+    }
+    co_return sum;
+}
+
+task<void> check_sums(file_vector<int> const& col, int64_t const expected, int& finished) {
+    co_await prefetch(col, col.size() / 2, col.size());
+    assert(col.data()[col.size() - 1] == static_cast<int>(col.size()) - 1);
+    assert(co_await sum_chunks(col, 1000) == expected);
+    assert(co_await sum_chunks(col, 1 << 20) == expected);
+    ++finished;
+}
+
+task<void> fail_after(file_vector<int> const& col) {
+    co_await prefetch(col, 0, 1);
+    throw runtime_error("task failed");
+}
+
+template <typename V> void test_out_of_range(V& fv, int const i) {
     try { 
-        int const tmp = fv.at(i);
+        auto const tmp = fv.at(i);
     } catch (out_of_range const& e) {
         return;
     } catch (exception const& e) {
@@ -212,4 +267,1431 @@ int main() {
         7, 8, 9
     }));
     assert(a == vector<int>({9,8,7,6,5,4,3,2,1,0}));
+
+    fv_int c("test9", fv_int::create_file);
+    c.clear();
+
+    for (int i = 0; i < 4 * page_size; ++i) {
+        c.push_back(i);
+    }
+
+    c.drop_front(page_size + 3);
+    assert(c.size() == 3 * page_size - 3);
+    assert(c.front() == page_size + 3);
+    assert(c.back() == 4 * page_size - 1);
+
+    c.drop_front(2 * page_size);
+    assert(c.size() == page_size - 3);
+    assert(c.front() == 3 * page_size + 3);
+    c.close();
+
+    fv_int d("test9");
+    assert(d.size() == page_size - 3);
+    assert(d.front() == 3 * page_size + 3);
+    d.push_back(-1);
+    assert(d.back() == -1);
+    assert(d[page_size - 4] == 4 * page_size - 1);
+
+    // Clearing moves the head back to the start of the file.
+    d.clear();
+    d.push_back(7);
+    assert(d.file_offset() == 0);
+    d.close();
+    struct stat file_stat;
+    assert(stat("test9", &file_stat) == 0 && file_stat.st_size == sizeof(int));
+    fv_int d2("test9");
+    assert(d2.size() == 1 && d2.front() == 7);
+    d2.clear();
+    d2.close();
+
+    sorted_file_vector<int> e("test10", fv_int::create_file, 16);
+    e.clear();
+
+    for (int i = 0; i < 1000; ++i) {
+        e.insert(2 * i);
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        e.insert(2 * i + 1);
+        assert(e.pending() <= 16);
+    }
+
+    assert(e.size() == 1334);
+    assert(is_sorted(e.begin(), e.end()));
+    assert(*e.lower_bound(7) == 7);
+    assert(*e.upper_bound(7) == 8);
+
+    e.merge();
+    assert(e.pending() == 0);
+    assert(e.size() == 1334);
+    assert(is_sorted(e.begin(), e.end()));
+
+    for (int i = 0; i < 10; ++i) {
+        vector<int> batch;
+        for (int j = 0; j < 100; ++j) {
+            batch.push_back((j * 37 + i * 11) % 2000);
+        }
+        e.insert(batch.begin(), batch.end());
+    }
+    e.insert(-1);
+    assert(e.size() == 2335);
+    assert(is_sorted(e.begin(), e.end()));
+    assert(*e.begin() == -1);
+
+    e.wait();
+    e.compact();
+    e.insert(5);
+    e.wait();
+    assert(e.run_count() == 0);
+    assert(e.size() == 2336);
+    assert(is_sorted(e.begin(), e.end()));
+    e.close();
+
+    sorted_file_vector<int> f("test10");
+    assert(f.size() == 2336);
+    assert(is_sorted(f.begin(), f.end()));
+    f.clear();
+    f.close();
+
+    compressed_file_vector<int64_t> g("test11", fv_int::create_file);
+    g.clear();
+
+    vector<int64_t> times;
+    for (int64_t i = 0; i < 3000; ++i) {
+        times.push_back(1000000 + 100 * i + ((i % 7 == 0) ? -3 : 0));
+    }
+    g.append(times.begin(), times.begin() + 1500);
+    for (int i = 1500; i < 3000; ++i) {
+        g.push_back(times[i]);
+    }
+    assert(g.size() == 3000);
+    assert(g.block_count() == 3);
+    assert(g.compressed_bytes() < 3000 * sizeof(int64_t) / 2);
+    for (int i = 0; i < 3000; ++i) {
+        assert(g[i] == times[i]);
+    }
+    g.close();
+
+    compressed_file_vector<int64_t> h("test11");
+    size_t scanned = 0;
+    h.scan([&scanned, &times](int64_t const* values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            assert(values[i] == times[scanned + i]);
+        }
+        scanned += n;
+    });
+    assert(scanned == 3000);
+    h.clear();
+    h.close();
+
+    compressed_file_vector<double> k("test12", fv_int::create_file);
+    k.clear();
+
+    vector<double> prices;
+    for (int i = 0; i < 2500; ++i) {
+        prices.push_back(100.0 + 0.25 * ((i * 7919) % 13) - ((i % 5 == 0) ? 1e-9 : 0.0));
+    }
+    prices[17] = -0.0;
+    prices[18] = numeric_limits<double>::infinity();
+    k.append(prices.begin(), prices.end());
+    for (int i = 0; i < 2500; ++i) {
+        double const x = k.at(i);
+        assert(memcmp(&x, &prices[i], sizeof(double)) == 0);
+    }
+    test_out_of_range(k, 2500);
+    k.clear();
+    k.close();
+
+    unlink("test13.dict");
+    unlink("test13.codes8");
+    unlink("test13.codes16");
+    dictionary_file_vector<int> m("test13", fv_int::create_file);
+
+    for (int i = 0; i < 1000; ++i) {
+        m.push_back(i % 10);
+    }
+    assert(m.code_width() == 1);
+    assert(m.dictionary_size() == 10);
+
+    selection const threes = m.equal(3);
+    assert(threes.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        assert(threes.test(i) == (i % 10 == 3));
+    }
+
+    for (int i = 0; i < 300; ++i) {
+        m.push_back(1000 + i);
+    }
+    assert(m.code_width() == 2);
+    assert(m.size() == 1300);
+    m.close();
+
+    dictionary_file_vector<int> n("test13");
+    assert(n.code_width() == 2);
+    assert(n.size() == 1300);
+    for (int i = 0; i < 1000; ++i) {
+        assert(n[i] == i % 10);
+    }
+    assert(n.at(1299) == 1299);
+    test_out_of_range(n, 1300);
+
+    selection const some = n.in({3, 7, 1005, 12345});
+    assert(some.count() == 201);
+    assert(some.test(1005));
+    n.close();
+
+    string_file_vector p("test14", fv_int::create_file);
+    p.clear();
+
+    vector<string> venues {"XNAS", "", "XLON", "a much longer venue name than the others"};
+    p.append(venues.begin(), venues.end());
+    p.push_back("{\"json\": true}");
+    assert(p.size() == 5);
+    assert(p[0] == "XNAS");
+    assert(p[1].empty());
+    assert(p.at(3) == venues[3]);
+    assert(p.back() == "{\"json\": true}");
+    test_out_of_range(p, 5);
+
+    p.pop_back();
+    assert(p.size() == 4);
+    assert(p.bytes() == 4 + 4 + venues[3].size());
+    p.close();
+
+    string_file_vector q("test14");
+    assert(q.size() == 4);
+    assert(equal(q.begin(), q.end(), venues.begin()));
+
+    // Values from the heap itself survive the heap growing under them.
+    for (int i = 0; i < 12; ++i) {
+        q.push_back(q[3]);
+    }
+    assert(q.size() == 16 && q.back() == venues[3]);
+    q.clear();
+    for (int i = 0; i < 10; ++i) {
+        q.push_back(to_string(i * 7));
+    }
+    q.close();
+
+    // Reopening after a crash recovers both files to their last commit.
+    auto const crash_strings_after = [](function<void(string_file_vector&)> const& f) {
+        pid_t const child = fork();
+        if (child == 0) {
+            string_file_vector v("test14");
+            f(v);
+            _exit(0);
+        }
+        int status = 0;
+        assert(child > 0 && waitpid(child, &status, 0) == child && status == 0);
+    };
+    crash_strings_after([](string_file_vector& v) {
+        v.push_back("lost");
+    });
+    {
+        string_file_vector recovered("test14");
+        assert(recovered.size() == 10 && recovered.bytes() == 18 && recovered.back() == "63");
+    }
+    crash_strings_after([](string_file_vector& v) {
+        v.push_back("kept");
+        v.commit();
+        v.push_back("lost");
+    });
+    string_file_vector recovered("test14");
+    assert(recovered.size() == 11 && recovered.back() == "kept" && recovered[9] == "63");
+    recovered.clear();
+    recovered.close();
+
+    file_vector<double> price("test15", fv_int::create_file);
+    fv_int qty("test16", fv_int::create_file);
+    price.clear();
+    qty.clear();
+    for (int i = 0; i < 1000; ++i) {
+        price.push_back(100.0 + (i % 50));
+        qty.push_back(i);
+    }
+
+    selection const cheap = select_between(price, 100.0, 104.0);
+    assert(cheap.size() == 1000);
+    assert(cheap.count() == 100);
+    selection const small = select_if(qty, [](int const x) {return x < 500;});
+    selection const odd = select_in(qty, {1, 3, 5, 7, 999, 2000});
+    assert(odd.count() == 5);
+    assert(select_equal(qty, 999).test(999));
+
+    selection both = cheap & small;
+    assert(both.count() == 50);
+    both |= odd;
+    assert(both.count() == 53);
+    both.and_not(small);
+    assert(both.count() == 1 && both.test(999));
+
+    vector<int> picked;
+    gather(qty, cheap & small, picked);
+    assert(picked.size() == 50);
+    assert(picked.front() == 0 && picked[5] == 50 && picked.back() == 454);
+    vector<double> gathered;
+    gather(price, (cheap & small).indices(), gathered);
+    assert(gathered.size() == 50 && gathered[5] == 100.0);
+
+    price.clear();
+    price.close();
+    qty.clear();
+    qty.close();
+
+    zoned_file_vector<double> zoned("test17", fv_int::create_file);
+    zoned.clear();
+    for (int i = 0; i < 3 * 4096 + 100; ++i) {
+        zoned.push_back(i);
+    }
+    vector<double> more {1e6, numeric_limits<double>::quiet_NaN(), -5.0};
+    zoned.append(more.begin(), more.end());
+    assert(zoned.zone_stats().size() == 4);
+    assert(zoned.zone_stats()[3].nulls == 1);
+    assert(zoned.zone_stats()[3].max == 1e6);
+
+    // Block 3 ends with 1e6 and -5, so its range covers everything.
+    vector<size_t> scanned_blocks;
+    size_t const blocks = zoned.scan_between(5000.0, 6000.0,
+        [&scanned_blocks](double const* values, size_t n, size_t first) {
+            assert(values[0] == first);
+            assert(n == (first == 3 * 4096 ? 103 : 4096));
+            scanned_blocks.push_back(first);
+        }
+    );
+    assert(blocks == 2);
+    assert(scanned_blocks == vector<size_t>({4096, 3 * 4096}));
+    assert(zoned.select_between(4096.0, 8191.0).count() == 4096);
+    assert(zoned.select_between(-10.0, 10.0).count() == 12);
+    assert(zoned.select_between(0.0, 2e6).count() == zoned.size() - 2);
+    zoned.close();
+
+    // Statistics are caught up with rows appended without them.
+    {
+        file_vector<double> raw("test17");
+        raw.push_back(7.0);
+    }
+    zoned_file_vector<double> rezoned("test17");
+    assert(rezoned.zone_stats().rows() == rezoned.size());
+    assert(rezoned.select_between(7.0, 7.0).count() == 2);
+    rezoned.clear();
+    rezoned.close();
+
+    // A column cleared and refilled past the rows covered is caught.
+    {
+        file_vector<double> raw("test17.raw", fv_int::create_file);
+        zone_map<double> raw_zones("test17.raw.zones", fv_int::create_file);
+        raw.clear();
+        raw_zones.clear();
+        for (int i = 0; i < 5000; ++i) {
+            raw.push_back(i);
+        }
+        raw_zones.update(raw);
+        raw.clear();
+        for (int i = 0; i < 6000; ++i) {
+            raw.push_back(-i);
+        }
+        raw_zones.update(raw);
+        assert(raw_zones.rows() == 6000 && raw_zones[0].min == -4095.0 && raw_zones[1].max == -4096.0);
+        raw.clear();
+    }
+
+    file_bitset flags("test18", fv_int::create_file);
+    flags.clear();
+    for (int i = 0; i < 1000; ++i) {
+        flags.push_back(i % 3 == 0);
+    }
+    flags.push_back_word(0xff, 8);
+    flags.push_back_word(~uint64_t(0));
+    assert(flags.size() == 1072);
+    assert(flags.count() == 334 + 8 + 64);
+    assert(flags[999] && !flags[998] && flags[1000] && flags[1071]);
+    test_out_of_range(flags, 1072);
+
+    assert(flags.rank(0) == 0);
+    assert(flags.rank(4) == 2);
+    assert(flags.rank(1000) == 334);
+    assert(flags.rank(1072) == 406);
+    assert(flags.select(0) == 0);
+    assert(flags.select(333) == 999);
+    assert(flags.select(334) == 1000);
+    assert(flags.select(405) == 1071);
+    assert(flags.select(406) == 1072);
+
+    flags.set(1, true);
+    assert(flags.rank(4) == 3);
+    assert(flags.select(1) == 1);
+    flags.close();
+
+    file_bitset other("test19", fv_int::create_file);
+    other.clear();
+    for (int i = 0; i < 1072; ++i) {
+        other.push_back(i % 2 == 0);
+    }
+    file_bitset reopened("test18");
+    assert(reopened.size() == 1072 && reopened[1]);
+    reopened &= other;
+    assert(reopened.count() == 167 + 4 + 32);
+    reopened |= other;
+    assert(reopened.count() == 536 && reopened.rank(1072) == 536);
+    reopened.set(1);
+    reopened.and_not(other);
+    assert(reopened.count() == 1 && reopened[1]);
+
+    selection sel = reopened.selected();
+    assert(sel.count() == 1 && sel.test(1));
+    sel.set(7);
+    other.assign(sel);
+    assert(other.size() == 1072 && other.count() == 2 && other.select(1) == 7);
+
+    reopened.resize(5);
+    assert(reopened.size() == 5 && reopened.count() == 1);
+    reopened.clear();
+
+    // Appends after a rank or select extend the directory's last block.
+    reopened.push_back_word(~uint64_t(0));
+    assert(reopened.select(10) == 10);
+    for (int i = 0; i < 8; ++i) {
+        reopened.push_back_word(~uint64_t(0));
+    }
+    assert(reopened.rank(544) == 544 && reopened.select(100) == 100);
+    reopened.push_back(false);
+    reopened.push_back(true);
+    assert(reopened.rank(578) == 577 && reopened.select(576) == 577);
+    reopened.clear();
+    reopened.close();
+    other.clear();
+    other.close();
+
+    file_vector<triple> triples("test20", file_vector<triple>::create_file);
+    triples.clear();
+    for (int i = 0; i < 100000; ++i) {
+        triples.push_back(triple {i, 2 * i, 3 * i});
+    }
+    triples.drop_front(1000);
+    triples.close();
+
+    file_vector<triple> cold("test20");
+    for (bool const direct : {false, true}) {
+        scan_options options;
+        options.chunk_bytes = 4096;
+        options.depth = 3;
+        options.direct = direct;
+
+        size_t next = 0;
+        size_t const scanned = async_scan(cold, [&next](triple const* t, size_t n, size_t first_row) {
+            assert(first_row == next);
+            for (size_t i = 0; i < n; ++i) {
+                int const v = static_cast<int>(first_row + i) + 1000;
+                assert(t[i].a == v && t[i].b == 2 * v && t[i].c == 3 * v);
+            }
+            next += n;
+        }, options);
+        assert(scanned == 99000 && next == 99000);
+    }
+
+    size_t total = 0;
+    async_scan(cold, [&total](triple const*, size_t n, size_t) {
+        total += n;
+    });
+    assert(total == cold.size());
+    cold.clear();
+    cold.close();
+
+    {
+        file_vector<triple> seed("test21", file_vector<triple>::create_file);
+        seed.clear();
+        for (int i = 0; i < 10; ++i) {
+            seed.push_back(triple {i, 2 * i, 3 * i});
+        }
+        seed.drop_front(3);
+    }
+
+    ingest_options small_buffers;
+    small_buffers.buffer_bytes = 4096;
+    {
+        ingest_file_vector<triple> ingest("test21", 0, small_buffers);
+        assert(ingest.size() == 7 && ingest.committed() == 7);
+        for (int i = 10; i < 50000; ++i) {
+            ingest.push_back(triple {i, 2 * i, 3 * i});
+        }
+        size_t const committed = ingest.committed();
+        assert(committed > 7 && committed < 49997);
+        triple const* const prefix = ingest.data();
+        for (size_t i = 0; i < committed; ++i) {
+            assert(prefix[i].a == static_cast<int>(i) + 3 && prefix[i].c == 3 * prefix[i].a);
+        }
+        ingest.flush();
+        assert(ingest.committed() == 49997);
+        assert(ingest.data()[49996].a == 49999);
+        ingest.push_back(triple {50000, 100000, 150000});
+    }
+    {
+        ingest_file_vector<triple> ingest("test21", 0, small_buffers);
+        assert(ingest.size() == 49998);
+        vector<triple> more;
+        for (int i = 50001; i < 60000; ++i) {
+            more.push_back(triple {i, 2 * i, 3 * i});
+        }
+        ingest.append(more.cbegin(), more.cend());
+        ingest.close();
+    }
+
+    file_vector<triple> ingested("test21");
+    assert(ingested.size() == 59997);
+    for (size_t i = 0; i < ingested.size(); ++i) {
+        triple const& t = ingested.data()[i];
+        assert(t.a == static_cast<int>(i) + 3 && t.b == 2 * t.a && t.c == 3 * t.a);
+    }
+    ingested.clear();
+    ingested.close();
+
+    // Rows ingested into a file with a commit record are committed on close.
+    {
+        file_vector<triple> seed("test21", file_vector<triple>::commit_appends);
+        seed.push_back(triple {0, 0, 0});
+    }
+    {
+        ingest_file_vector<triple> ingest("test21", 0, small_buffers);
+        for (int i = 1; i < 10000; ++i) {
+            ingest.push_back(triple {i, 2 * i, 3 * i});
+        }
+    }
+    {
+        file_vector<triple> committed("test21");
+        assert(committed.size() == 10000 && committed.back().c == 3 * 9999);
+        committed.clear();
+    }
+    unlink("test21.commit");
+
+    {
+        fv_int seq("test22", fv_int::create_file);
+        seq.clear();
+        for (int i = 0; i < 300000; ++i) {
+            seq.push_back(i);
+        }
+        seq.close();
+
+        int const fd = open("test22", O_RDONLY);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    fv_int paged("test22");
+    int64_t const expected_sum = int64_t(299999) * 300000 / 2;
+    int finished = 0;
+    page_scheduler scheduler;
+    scheduler.spawn(check_sums(paged, expected_sum, finished));
+    scheduler.spawn(check_sums(paged, expected_sum, finished));
+    scheduler.run();
+    assert(finished == 2);
+
+    scheduler.spawn(fail_after(paged));
+    bool failed = false;
+    try {
+        scheduler.run();
+    } catch (runtime_error const& e) {
+        failed = true;
+    }
+    assert(failed);
+
+    paged.clear();
+    paged.close();
+
+    {
+        fv_int seq("test23", fv_int::create_file);
+        seq.clear();
+        seq.resize(1 << 18, 7);
+        seq.close();
+
+        int const fd = open("test23", O_RDONLY);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    fv_int resident("test23");
+    size_t const half = resident.size() / 2;
+    // The page-cache may keep the pages whatever the advice, so only a
+    // drop that took effect is checked.
+    double const after_advice = resident.resident_ratio();
+    assert(after_advice >= 0.0 && after_advice <= 1.0);
+    double const half_after_advice = resident.resident_ratio(0, half);
+    size_t const warmed = resident.warm(0, half, 3);
+    assert(half_after_advice == 1.0 || warmed > 0);
+    assert(resident.resident_ratio(0, half) == 1.0);
+    auto const warm_ranges = resident.resident_ranges(0, resident.size());
+    assert(!warm_ranges.empty() && warm_ranges.front().first == 0 && warm_ranges.front().second >= half);
+    assert(resident.resident_ranges(10, 20).size() == 1);
+    assert(resident.resident_ranges(10, 20).front() == make_pair(size_t(10), size_t(20)));
+
+    resident.warm();
+    assert(resident.resident_ratio() == 1.0);
+    assert(resident.warm() == 0);
+    assert(resident.resident_ranges(0, resident.size()).size() == 1);
+    assert(resident.resident_ranges(0, resident.size()).front().second == resident.size());
+
+    resident.drop_front(1001);
+    auto const after_drop = resident.resident_ranges(0, resident.size());
+    assert(after_drop.size() == 1 && after_drop.front() == make_pair(size_t(0), resident.size()));
+    resident.clear();
+    assert(resident.resident_ratio() == 1.0 && resident.resident_ranges(0, 0).empty());
+    resident.close();
+
+    counted_file_vector<int> counted("test24", fv_int::create_file);
+    counted.clear();
+    counted.reset_stats();
+    for (int i = 0; i < 1 << 20; ++i) {
+        counted.push_back(i);
+    }
+    counted.flush();
+    file_vector_stats const counts = counted.stats();
+    assert(counts.remaps > 0 && counts.bytes_grown >= (size_t(1) << 20) * sizeof(int));
+    assert(counts.calls[file_vector_stats::ftruncate_op] == counts.remaps);
+    assert(counts.calls[file_vector_stats::mmap_op] == counts.remaps);
+    assert(counts.calls[file_vector_stats::flush_op] == 1);
+    assert(counts.ns[file_vector_stats::flush_op] >= counts.max_ns[file_vector_stats::flush_op]);
+    assert(counts.used_bytes == (size_t(1) << 20) * sizeof(int) && counts.reserved_bytes >= counts.used_bytes);
+    string const json = counts.json();
+    assert(json.find("\"remaps\": " + to_string(counts.remaps)) != string::npos);
+    assert(json.find("\"flush\": {\"calls\": 1,") != string::npos);
+
+    counted.reset_stats();
+    assert(counted.stats().remaps == 0 && counted.stats().used_bytes == counts.used_bytes);
+
+    // The column helpers take counted columns too.
+    {
+        assert(select_between(counted, 10, 19).count() == 10);
+        zone_map<int> zones("test24.zones", fv_int::create_file);
+        zones.update(counted);
+        assert(zones.rows() == counted.size() && zones[0].min == 0);
+        prefix_sum<int> sums("test24.sums", fv_int::create_file);
+        sums.update(counted);
+        assert(sums.sum(10, 20) == 145);
+        fv_int evens("test24.evens", fv_int::create_file);
+        evens.clear();
+        for (int i = 0; i < 100; i += 2) {
+            evens.push_back(i);
+        }
+        vector<uint64_t> left_rows;
+        vector<uint64_t> right_rows;
+        assert(merge_join(evens, counted, left_rows, right_rows) == 50 && right_rows[1] == 2);
+        zones.clear();
+        sums.clear();
+        evens.clear();
+    }
+    counted.clear();
+    counted.close();
+
+    // Without the counting recorder only the sizes are filled in.
+    static_assert(sizeof(fv_int) < sizeof(counted_file_vector<int>));
+    fv_int uncounted("test24");
+    uncounted.push_back(1);
+    assert(uncounted.stats().remaps == 0 && uncounted.stats().used_bytes == sizeof(int));
+    uncounted.clear();
+    uncounted.close();
+
+    unlink("test25");
+    unlink("test25.head");
+    unlink("test25.commit");
+    // Append in a child that exits without closing, as if it crashed.
+    auto const crash_after = [](function<void(fv_int&)> const& f) {
+        pid_t const child = fork();
+        if (child == 0) {
+            fv_int v("test25", fv_int::create_file | fv_int::commit_appends);
+            f(v);
+            _exit(0);
+        }
+        int status = 0;
+        assert(child > 0 && waitpid(child, &status, 0) == child && status == 0);
+    };
+    crash_after([](fv_int& v) {
+        for (int i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        v.commit();
+        for (int i = 1000; i < 1500; ++i) {
+            v.push_back(i);
+        }
+    });
+    {
+        fv_int recovered("test25");
+        assert(recovered.size() == 1000 && recovered.back() == 999);
+    }
+    crash_after([](fv_int& v) {
+        assert(v.size() == 1000);
+        for (int i = 1000; i < 1100; ++i) {
+            v.push_back(i);
+        }
+        v.commit();
+        for (int i = 1100; i < 1300; ++i) {
+            v.push_back(i);
+        }
+        v.commit();
+    });
+
+    // A torn newest commit falls back to the one before.
+    {
+        FILE* const f = fopen("test25.commit", "r+b");
+        uint64_t slots[2][3];
+        assert(f != nullptr && fread(slots, sizeof(slots), 1, f) == 1);
+        int const newest = (slots[0][0] > slots[1][0]) ? 0 : 1;
+        assert(slots[newest][1] == 1300 * sizeof(int) && slots[1 - newest][1] == 1100 * sizeof(int));
+        slots[newest][2] ^= 1;
+        assert(fseek(f, 0, SEEK_SET) == 0 && fwrite(slots, sizeof(slots), 1, f) == 1 && fclose(f) == 0);
+    }
+    {
+        fv_int recovered("test25");
+        assert(recovered.size() == 1100 && recovered.back() == 1099);
+        recovered.drop_front(100);
+        assert(recovered.file_offset() == 100 * sizeof(int));
+    }
+    {
+        fv_int recovered("test25");
+        assert(recovered.size() == 1000 && recovered.front() == 100 && recovered.back() == 1099);
+        recovered.clear();
+        assert(recovered.file_offset() == 0);
+    }
+    {
+        fv_int recovered("test25");
+        assert(recovered.empty() && recovered.file_offset() == 0);
+    }
+    unlink("test25.commit");
+
+    fv_int live("test26", fv_int::create_file);
+    live.clear();
+    for (int i = 0; i < 100000; ++i) {
+        live.push_back(i);
+    }
+    live.drop_front(10);
+    file_vector_snapshot<int> frozen = live.snapshot();
+    assert(frozen.size() == 99990 && frozen.front() == 10 && frozen.back() == 99999);
+
+    // Overwrite, append, and drop from the front, past the snapshot.
+    live[0] = -1;
+    live.back() = -1;
+    for (int i = 0; i < 100000; ++i) {
+        live.push_back(-i);
+    }
+    live.drop_front(50000);
+    assert(frozen.size() == 99990 && frozen[0] == 10 && frozen.at(99989) == 99999);
+    assert(accumulate(frozen.begin(), frozen.end(), int64_t(0)) == int64_t(99999) * 100000 / 2 - 45);
+    test_out_of_range(frozen, 99990);
+
+    file_vector_snapshot<int> moved(move(frozen));
+    assert(frozen.empty() && moved.size() == 99990 && moved[5] == 15);
+    live.clear();
+    assert(live.snapshot().empty());
+    live.close();
+
+    assert(crc32c(0, "123456789", 9) == 0xe3069283u);
+    assert(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xe3069283u);
+
+    using checked_int = checksummed_file_vector<int>;
+    size_t constexpr block_ints = checked_int::block_bytes / sizeof(int);
+    size_t const checked_rows = 3 * block_ints + 100;
+    size_t checked_offset = 0;
+    {
+        checked_int checked("test27", checked_int::create_file);
+        checked.clear();
+        vector<int> rows(checked_rows);
+        iota(rows.begin(), rows.end(), 0);
+        checked.append(rows.begin(), rows.end());
+        assert(checked.blocks() == 4 && checked.at(checked_rows - 1) == int(checked_rows) - 1);
+        assert(checked.scrub().empty());
+
+        int64_t total = 0;
+        size_t runs = 0;
+        checked.scan([&total, &runs](int const* v, size_t const n, size_t) {
+            total += accumulate(v, v + n, int64_t(0));
+            ++runs;
+        });
+        assert(runs == 4 && total == int64_t(checked_rows) * (checked_rows - 1) / 2);
+
+        // Not covered until the next update, which here is on open.
+        checked.push_back(-1);
+        checked_offset = checked.column().file_offset();
+    }
+
+    // Corrupt a value in the third block behind the vector's back.
+    {
+        int const fd = open("test27", O_WRONLY);
+        int const bad = 7;
+        assert(fd != -1);
+        assert(pwrite(fd, &bad, sizeof(bad), checked_offset + (2 * block_ints + 5) * sizeof(int)) == sizeof(bad));
+        assert(close(fd) == 0);
+    }
+    {
+        checked_int checked("test27");
+        assert(checked.size() == checked_rows + 1 && checked.at(checked_rows) == -1);
+        assert(checked.at(10) == 10 && checked.at(3 * block_ints) == int(3 * block_ints));
+        try {
+            checked.at(2 * block_ints + 5);
+            assert(false);
+        } catch (checksum_error const& e) {
+            assert(e.block == 2);
+        }
+        assert(checked[2 * block_ints + 5] == 7);
+        assert(checked.scrub(3) == vector<size_t>({2}));
+
+        checked.clear();
+        assert(checked.blocks() == 0 && checked.scrub().empty());
+        vector<int> rows(checked_rows);
+        iota(rows.begin(), rows.end(), 0);
+        checked.append(rows.begin(), rows.end());
+        checked_offset = checked.column().file_offset();
+        checked.close();
+    }
+
+    // A truncated file is reported, not checksummed again, until rebuilt.
+    assert(truncate("test27", checked_offset + (2 * block_ints + 50) * sizeof(int)) == 0);
+    {
+        checked_int checked("test27");
+        assert(checked.size() == 2 * block_ints + 50 && checked.blocks() == 4);
+        assert(checked.at(10) == 10);
+        try {
+            checked.at(2 * block_ints + 5);
+            assert(false);
+        } catch (checksum_error const& e) {
+            assert(e.block == 2);
+        }
+        assert(checked.scrub(2) == vector<size_t>({2, 3}));
+        vector<int> more {1, 2, 3};
+        try {
+            checked.append(more.begin(), more.end());
+            assert(false);
+        } catch (checksum_error const& e) {
+            assert(e.block == 2);
+        }
+        checked.close();
+    }
+    {
+        checked_int checked("test27");
+        assert(checked.size() == 2 * block_ints + 53 && checked.scrub() == vector<size_t>({2, 3}));
+        checked.rebuild();
+        assert(checked.blocks() == 3 && checked.scrub().empty() && checked.at(2 * block_ints + 52) == 3);
+        checked.close();
+    }
+    {
+        // Readers verify blocks from several threads at once.
+        checked_int checked("test27");
+        thread reader([&checked] {
+            checked.scan([](int const*, size_t, size_t) {});
+        });
+        assert(checked.scrub(2).empty() && checked.at(block_ints) == int(block_ints));
+        reader.join();
+        checked.clear();
+        checked.close();
+    }
+
+    unlink("test28");
+    using arena_ints = vector<int, arena_allocator<int>>;
+    struct arena_list {
+        int value;
+        offset_ptr<arena_list> next;
+    };
+    struct arena_root {
+        arena_ints ints;
+        offset_ptr<arena_list> list;
+
+        explicit arena_root(persistent_arena& arena) : ints(arena_allocator<int>(arena)), list(nullptr) {}
+    };
+    {
+        persistent_arena arena("test28", persistent_arena::create_file);
+        arena_root& r = arena.root<arena_root>(arena);
+        char const* const base = arena.base();
+
+        // Grows the file many times while the vector in it is being changed.
+        for (int i = 0; i < 1000000; ++i) {
+            r.ints.push_back(i);
+        }
+        for (int i = 0; i < 100; ++i) {
+            r.list = arena.construct<arena_list>(arena_list {i, r.list});
+        }
+        assert(arena.base() == base && arena.capacity() >= 4000000);
+
+        // Freed blocks are reused by their size class.
+        void* const block = arena.allocate(100);
+        arena.deallocate(block, 100);
+        assert(arena.allocate(120) == block);
+        assert(arena.allocate(100) != block);
+
+        {
+            unordered_map<int, int, hash<int>, equal_to<int>, arena_allocator<pair<int const, int>>> squares {
+                arena_allocator<pair<int const, int>>(arena)
+            };
+            for (int i = 0; i < 10000; ++i) {
+                squares[i] = i * i;
+            }
+            assert(squares.size() == 10000 && squares.at(99) == 9801 && squares.find(10000) == squares.end());
+            assert(persistent_arena::owner(&*squares.find(5)).base() == base);
+            assert(&persistent_arena::at_base(base) == &arena && &squares.get_allocator().arena() == &arena);
+        }
+        arena.close();
+    }
+    {
+        persistent_arena arena("test28");
+        arena_root& r = arena.root<arena_root>(arena);
+        assert(r.ints.size() == 1000000 && r.ints[123456] == 123456 && r.ints.back() == 999999);
+        int n = 0;
+        for (offset_ptr<arena_list> p = r.list; p; p = p->next) {
+            assert(p->value == 99 - n);
+            ++n;
+        }
+        assert(n == 100);
+
+        offset_ptr<int> p = r.ints.data() + 10;
+        offset_ptr<int> const q = p + 5;
+        assert(q - p == 5 && *q == 15 && p[2] == 12 && p < q && (++p) == r.ints.data() + 11);
+        assert(offset_ptr<int>() == nullptr && !offset_ptr<int>(nullptr));
+
+        r.ints.clear();
+        r.ints.shrink_to_fit();
+        assert(r.ints.capacity() == 0);
+    }
+    unlink("test28");
+    fv_int("test28", {1, 2, 3, 4, 5, 6, 7, 8}, fv_int::create_file).close();
+    try {
+        persistent_arena not_arena("test28");
+        assert(false);
+    } catch (runtime_error const&) {
+    }
+
+    using order_index = persistent_hash_index<int64_t>;
+    auto const order_id = [](int64_t const i) {
+        return i * 7919 + 1000000007;
+    };
+    bool seen_rehashing = false;
+    {
+        order_index index("test29", order_index::create_file);
+        index.clear();
+        for (int64_t i = 0; i < 100000; ++i) {
+            assert(index.insert(order_id(i), i));
+            seen_rehashing = seen_rehashing || index.rehashing();
+            // Lookups work while the table is being rehashed.
+            if (i % 997 == 0) {
+                assert(index.find(order_id(i / 2)) == i / 2);
+            }
+        }
+        assert(seen_rehashing && index.size() == 100000 && index.capacity() >= 100000);
+        assert(!index.insert(order_id(5), 55) && index.find(order_id(5)) == 55);
+        for (int64_t i = 0; i < 100000; i += 2) {
+            assert(index.erase(order_id(i)));
+        }
+        assert(!index.erase(order_id(0)) && index.size() == 50000);
+        index.close();
+    }
+    {
+        order_index index("test29");
+        assert(index.size() == 50000);
+        for (int64_t i = 0; i < 100000; ++i) {
+            optional<uint64_t> const row = index.find(order_id(i));
+            assert(row.has_value() == (i % 2 == 1));
+            assert(!row || *row == uint64_t(i == 5 ? 55 : i));
+        }
+        assert(!index.contains(order_id(100000)) && !index.contains(-1));
+    }
+    {
+        file_vector<int64_t> orders("test29.orders", fv_int::create_file);
+        orders.clear();
+        for (int64_t i = 0; i < 20000; ++i) {
+            orders.push_back(order_id(i));
+        }
+        order_index index("test29");
+        index.clear();
+        index.update(orders);
+        orders.push_back(order_id(-1));
+        index.update(orders);
+        assert(index.indexed() == 20001 && index.size() == 20001);
+        assert(index.find(order_id(-1)) == 20000 && index.find(order_id(1234)) == 1234);
+
+        // A shorter column means the index is stale.
+        orders.resize(10);
+        index.update(orders);
+        assert(index.size() == 10 && !index.contains(order_id(10)) && index.find(order_id(9)) == 9);
+        orders.clear();
+        index.clear();
+    }
+    {
+        // Keys equal under KeyEqual but not bitwise.
+        persistent_hash_index<double> prices("test29.prices", persistent_hash_index<double>::create_file);
+        prices.clear();
+        assert(prices.insert(0.0, 1) && !prices.insert(-0.0, 2));
+        assert(prices.find(-0.0) == 2 && prices.size() == 1);
+        assert(prices.erase(-0.0) && !prices.contains(0.0));
+        prices.clear();
+    }
+
+    {
+        file_vector<int64_t> unsorted("test30", fv_int::create_file);
+        unsorted.clear();
+        mt19937_64 gen(30);
+        for (int i = 0; i < 300000; ++i) {
+            unsorted.push_back(gen() % 100000);
+        }
+        sort_options small_budget;
+        small_budget.memory_bytes = 64 * 1024;
+        small_budget.threads = 3;
+        small_budget.write_bytes = 4096;
+        size_t const runs = external_sort(unsorted, "test30.sorted", less<int64_t>(), small_budget);
+        assert(runs == (300000 + 2730) / 2731);
+
+        vector<int64_t> expected(unsorted.cbegin(), unsorted.cend());
+        sort(expected.begin(), expected.end());
+        file_vector<int64_t> sorted("test30.sorted");
+        assert(sorted == expected);
+        sorted.close();
+
+        // A head or commit record left with an old output is removed.
+        {
+            file_vector<int64_t> committed("test30.sorted", file_vector<int64_t>::commit_appends);
+            committed.resize(10);
+        }
+        assert(external_sort(unsorted, "test30.sorted", greater<int64_t>()) > 0);
+        file_vector<int64_t> descending("test30.sorted");
+        assert(descending.size() == 300000 && is_sorted(descending.cbegin(), descending.cend(), greater<int64_t>()));
+        descending.clear();
+
+        unsorted.clear();
+        assert(external_sort(unsorted, "test30.sorted") == 0);
+        assert(file_vector<int64_t>("test30.sorted").empty());
+    }
+    {
+        struct order {
+            int32_t price;
+            char payload[60];
+        };
+        file_vector<order> orders("test30.orders", fv_int::create_file);
+        orders.clear();
+        for (int i = 0; i < 50000; ++i) {
+            orders.push_back(order {(i * 7) % 1000, {}});
+        }
+        sort_options small_budget;
+        small_budget.memory_bytes = 32 * 1024;
+        size_t const runs = external_sort_index(orders, [](order const& o) {
+            return o.price;
+        }, "test30.order_rows", small_budget);
+        assert(runs > 1);
+
+        file_vector<uint64_t> rows("test30.order_rows");
+        assert(rows.size() == 50000);
+        for (size_t i = 1; i < rows.size(); ++i) {
+            int32_t const a = orders[rows[i - 1]].price;
+            int32_t const b = orders[rows[i]].price;
+            assert(a < b || (a == b && rows[i - 1] < rows[i]));
+        }
+        rows.clear();
+        orders.clear();
+    }
+    assert(access("test30.sorted.run0", F_OK) == -1);
+    {
+        file_vector<int64_t> trades("test31", fv_int::create_file);
+        file_vector<int64_t> quotes("test31.quotes", fv_int::create_file);
+        trades.clear();
+        quotes.clear();
+        for (int64_t t : {3, 5, 5, 10, 11, 40}) {
+            trades.push_back(t);
+        }
+        for (int64_t t : {4, 5, 5, 9, 12, 30}) {
+            quotes.push_back(t);
+        }
+
+        file_vector<uint64_t> trade_rows("test31.left", fv_int::create_file);
+        file_vector<uint64_t> quote_rows("test31.right", fv_int::create_file);
+        trade_rows.clear();
+        quote_rows.clear();
+        assert(asof_join(trades, quotes, trade_rows, quote_rows) == 5);
+        assert((vector<uint64_t>(trade_rows.cbegin(), trade_rows.cend()) == vector<uint64_t> {1, 2, 3, 4, 5}));
+        assert((vector<uint64_t>(quote_rows.cbegin(), quote_rows.cend()) == vector<uint64_t> {2, 2, 3, 3, 5}));
+
+        trade_rows.clear();
+        quote_rows.clear();
+        assert(merge_join(trades, quotes, trade_rows, quote_rows) == 4);
+        assert((vector<uint64_t>(trade_rows.cbegin(), trade_rows.cend()) == vector<uint64_t> {1, 1, 2, 2}));
+        assert((vector<uint64_t>(quote_rows.cbegin(), quote_rows.cend()) == vector<uint64_t> {1, 2, 1, 2}));
+
+        // Hash joins against a nested loop, with duplicate keys on both
+        // sides, and enough rows for many partitions.
+        mt19937_64 gen(31);
+        file_vector<int64_t> ids("test31.ids", fv_int::create_file);
+        file_vector<int64_t> refs("test31.refs", fv_int::create_file);
+        ids.clear();
+        refs.clear();
+        for (int i = 0; i < 20000; ++i) {
+            ids.push_back(gen() % 15000);
+        }
+        for (int i = 0; i < 5000; ++i) {
+            refs.push_back(gen() % 20000);
+        }
+        vector<pair<uint64_t, uint64_t>> expected_pairs;
+        unordered_multimap<int64_t, uint64_t> rows_of_id;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            rows_of_id.emplace(ids[i], i);
+        }
+        for (size_t j = 0; j < refs.size(); ++j) {
+            auto const range = rows_of_id.equal_range(refs[j]);
+            for (auto k = range.first; k != range.second; ++k) {
+                expected_pairs.emplace_back(k->second, j);
+            }
+        }
+        sort(expected_pairs.begin(), expected_pairs.end());
+
+        join_options small_cache;
+        small_cache.cache_bytes = 4096;
+        for (unsigned const threads : {1u, 3u}) {
+            small_cache.threads = threads;
+            trade_rows.clear();
+            quote_rows.clear();
+            size_t const pairs = hash_join(ids, refs, trade_rows, quote_rows, small_cache);
+            assert(pairs == expected_pairs.size() && trade_rows.size() == pairs && quote_rows.size() == pairs);
+            vector<pair<uint64_t, uint64_t>> joined;
+            for (size_t i = 0; i < pairs; ++i) {
+                joined.emplace_back(trade_rows[i], quote_rows[i]);
+            }
+            sort(joined.begin(), joined.end());
+            assert(joined == expected_pairs);
+        }
+
+        vector<uint64_t> build_out;
+        vector<uint64_t> probe_out;
+        ids.clear();
+        assert(hash_join(ids, refs, build_out, probe_out) == 0 && build_out.empty());
+
+        trade_rows.clear();
+        quote_rows.clear();
+        trades.clear();
+        quotes.clear();
+        refs.clear();
+    }
+    {
+        struct trade {
+            int32_t symbol;
+            int64_t time;
+            double price;
+        };
+        file_vector<trade> trades("test32", fv_int::create_file);
+        trades.clear();
+        mt19937_64 gen(32);
+        for (int i = 0; i < 200000; ++i) {
+            trades.push_back(trade {static_cast<int32_t>(gen() % 50), i * 250, static_cast<double>(gen() % 1000)});
+        }
+
+        // Expected count, sum, min and max by symbol and minute.
+        auto const symbol_minute = [](trade const& t) {
+            return (static_cast<uint64_t>(t.symbol) << 32) | static_cast<uint64_t>(t.time / 60000);
+        };
+        auto const price = [](trade const& t) {
+            return t.price;
+        };
+        unordered_map<uint64_t, group_aggregate<double>> expected_groups;
+        for (trade const& t : trades) {
+            auto const g = expected_groups.find(symbol_minute(t));
+            if (g == expected_groups.end()) {
+                expected_groups.emplace(symbol_minute(t), group_aggregate<double>::of(t.price));
+            } else {
+                g->second.add(t.price);
+            }
+        }
+
+        file_vector<uint64_t> group_keys("test32.keys", fv_int::create_file);
+        file_vector<group_aggregate<double>> groups("test32.groups", fv_int::create_file);
+        auto const check_groups = [&expected_groups, &group_keys, &groups](size_t const count) {
+            assert(count == expected_groups.size() && group_keys.size() == count && groups.size() == count);
+            for (size_t i = 0; i < count; ++i) {
+                group_aggregate<double> const& e = expected_groups.at(group_keys[i]);
+                assert(e.count == groups[i].count && e.sum == groups[i].sum);
+                assert(e.min == groups[i].min && e.max == groups[i].max);
+            }
+        };
+        group_options options;
+        for (unsigned const threads : {1u, 3u}) {
+            options.threads = threads;
+            group_keys.clear();
+            groups.clear();
+            check_groups(group_by(trades, symbol_minute, price, group_keys, groups, options));
+        }
+
+        // Sorted and dense keys, with threads, in key order.
+        file_vector<int64_t> minutes("test32.minutes", fv_int::create_file);
+        file_vector<double> prices("test32.prices", fv_int::create_file);
+        minutes.clear();
+        prices.clear();
+        for (trade const& t : trades) {
+            minutes.push_back(t.time / 60000);
+            prices.push_back(t.price);
+        }
+        file_vector<int64_t> minute_keys("test32.minute_keys", fv_int::create_file);
+        vector<group_aggregate<double>> minute_groups;
+        auto const check_minutes = [&minutes, &prices, &minute_keys, &minute_groups](size_t const count) {
+            assert(count == 834 && minute_keys.size() == count && minute_groups.size() == count);
+            for (size_t i = 0; i < count; ++i) {
+                assert(minute_keys[i] == static_cast<int64_t>(i));
+                size_t const first = i * 240;
+                size_t const last = min(first + 240, minutes.size());
+                assert(minute_groups[i].count == last - first);
+                assert(minute_groups[i].sum == accumulate(prices.cbegin() + first, prices.cbegin() + last, 0.0));
+            }
+        };
+        for (group_strategy const strategy : {group_strategy::automatic, group_strategy::dense, group_strategy::hash}) {
+            options.strategy = strategy;
+            minute_keys.clear();
+            minute_groups.clear();
+            size_t const count = group_by(minutes, prices, minute_keys, minute_groups, options);
+            if (strategy == group_strategy::hash) {
+                vector<pair<int64_t, group_aggregate<double>>> by_key;
+                for (size_t i = 0; i < count; ++i) {
+                    by_key.emplace_back(minute_keys[i], minute_groups[i]);
+                }
+                sort(by_key.begin(), by_key.end(), [](auto const& a, auto const& b) {
+                    return a.first < b.first;
+                });
+                minute_keys.clear();
+                minute_groups.clear();
+                for (auto const& g : by_key) {
+                    minute_keys.push_back(g.first);
+                    minute_groups.push_back(g.second);
+                }
+            }
+            check_minutes(count);
+        }
+
+        // A custom aggregate: the first and last value of each group.
+        struct first_last {
+            double first;
+            double last;
+            static first_last of(double const v) {
+                return first_last {v, v};
+            }
+            void add(double const v) {
+                last = v;
+            }
+            void merge(first_last const& that) {
+                last = that.last;
+            }
+        };
+        options.strategy = group_strategy::automatic;
+        minute_keys.clear();
+        vector<first_last> ends;
+        assert(group_by<first_last>(minutes, prices, minute_keys, ends, options) == 834);
+        assert(ends[1].first == prices[240] && ends[1].last == prices[479]);
+
+        options.strategy = group_strategy::sorted;
+        bool thrown = false;
+        try {
+            group_by(trades, symbol_minute, price, group_keys, groups, options);
+        } catch (runtime_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        trades.clear();
+        group_keys.clear();
+        groups.clear();
+        minutes.clear();
+        prices.clear();
+        minute_keys.clear();
+    }
+    {
+        using ticks = rollup_file_vector<int64_t, double>;
+        for (char const* stale : {"test33.rollup.60", "test33.rollup.3600", "test33.rollup.86400"}) {
+            unlink(stale);
+        }
+        {
+            ticks t("test33", {60, 3600}, ticks::create_file);
+            t.clear();
+            // Ticks every 7 seconds, from before time zero.
+            for (int64_t s = -700; s < 10000; s += 7) {
+                t.push_back(s, static_cast<double>((s * 37) % 101));
+            }
+            bool thrown = false;
+            try {
+                t.push_back(0, 1.0);
+            } catch (runtime_error const&) {
+                thrown = true;
+            }
+            assert(thrown && t.size() == 1529);
+
+            vector<int64_t> more_times;
+            vector<double> more_values;
+            for (int64_t s = 10003; s < 400000; s += 7) {
+                more_times.push_back(s);
+                more_values.push_back(static_cast<double>((s * 37) % 101));
+            }
+            t.append(more_times.cbegin(), more_times.cend(), more_values.cbegin());
+            t.close();
+        }
+
+        // Reopened, the bars match a scan of the ticks.
+        ticks t("test33", {60, 3600, 86400}, ticks::create_file);
+        file_vector<int64_t> const& times = t.time_column();
+        file_vector<double> const& prices = t.value_column();
+        for (int64_t const width : {60, 3600, 86400}) {
+            auto const& bars = t.bars(width);
+            assert(bars.rows() == t.size());
+            size_t b = 0;
+            for (size_t i = 0; i < t.size(); ++b) {
+                int64_t const start = bars.bucket_of(times[i]);
+                auto const& bar = bars[b];
+                assert(bar.start == start && start <= times[i] && times[i] < start + width);
+                assert(bar.aggregate.open == prices[i]);
+                double high = prices[i];
+                double low = prices[i];
+                size_t j = i;
+                for (; j < t.size() && times[j] < start + width; ++j) {
+                    high = max(high, prices[j]);
+                    low = min(low, prices[j]);
+                }
+                assert(bar.end == j && bar.aggregate.count == j - i);
+                assert(bar.aggregate.high == high && bar.aggregate.low == low);
+                assert(bar.aggregate.close == prices[j - 1]);
+                i = j;
+            }
+            assert(b == bars.size());
+        }
+        assert(t.bars(60)[0].start == -720);
+        assert(t.bars(3600).between(0, 7200) == make_pair(size_t(1), size_t(3)));
+        {
+            bool thrown = false;
+            try {
+                t.bars(300);
+            } catch (out_of_range const&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+
+        // A parallel rebuild gives the same buckets.
+        rollup<int64_t, double> hourly("test33.hourly", 3600, fv_int::create_file);
+        hourly.rebuild(times, prices, 3);
+        auto const& expected_hourly = t.bars(3600);
+        assert(hourly.size() == expected_hourly.size());
+        for (size_t i = 0; i < hourly.size(); ++i) {
+            assert(hourly[i].start == expected_hourly[i].start && hourly[i].end == expected_hourly[i].end);
+            assert(hourly[i].aggregate.count == expected_hourly[i].aggregate.count);
+            assert(hourly[i].aggregate.open == expected_hourly[i].aggregate.open);
+            assert(hourly[i].aggregate.close == expected_hourly[i].aggregate.close);
+        }
+        hourly.clear();
+        hourly.close();
+
+        // Columns cleared and refilled past the rows covered are caught.
+        {
+            file_vector<int64_t> raw_times("test33.raw", fv_int::create_file);
+            file_vector<double> raw_prices("test33.raw.values", fv_int::create_file);
+            rollup<int64_t, double> minutes("test33.raw.rollup", 60, fv_int::create_file);
+            raw_times.clear();
+            raw_prices.clear();
+            minutes.clear();
+            for (int i = 0; i < 100; ++i) {
+                raw_times.push_back(i * 10);
+                raw_prices.push_back(i);
+            }
+            minutes.update(raw_times, raw_prices);
+            raw_times.clear();
+            raw_prices.clear();
+            for (int i = 0; i < 150; ++i) {
+                raw_times.push_back(100000 + i * 10);
+                raw_prices.push_back(-i);
+            }
+            minutes.update(raw_times, raw_prices);
+            assert(minutes.rows() == 150 && minutes[0].start == 99960 && minutes[0].aggregate.open == 0.0);
+            raw_times.clear();
+            raw_prices.clear();
+        }
+
+        t.clear();
+        assert(t.bars(60).empty());
+        t.close();
+    }
+    {
+        unlink("test34.sums");
+        {
+            summed_file_vector<int32_t> sizes("test34", summed_file_vector<int32_t>::create_file);
+            sizes.clear();
+            for (int i = 0; i < 1000; ++i) {
+                sizes.push_back(i % 7 - 3);
+            }
+            vector<int32_t> more(300000);
+            for (size_t i = 0; i < more.size(); ++i) {
+                more[i] = static_cast<int32_t>((i * 2654435761u) % 2001) - 1000;
+            }
+            sizes.append(more.cbegin(), more.cend());
+            sizes.close();
+        }
+
+        summed_file_vector<int32_t> sizes("test34");
+        assert(sizes.size() == 301000);
+        vector<int64_t> expected_sums(sizes.size() + 1, 0);
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            expected_sums[i + 1] = expected_sums[i] + sizes[i];
+        }
+        for (size_t const first : {size_t(0), size_t(1), size_t(999), size_t(150000)}) {
+            for (size_t const last : {first, first + 1, size_t(1000), size_t(200001), sizes.size()}) {
+                if (first <= last) {
+                    assert(sizes.sum(first, last) == expected_sums[last] - expected_sums[first]);
+                }
+            }
+        }
+        {
+            bool thrown = false;
+            try {
+                sizes.sum(5, sizes.size() + 1);
+            } catch (out_of_range const&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+
+        // Doubles, with a parallel rebuild, against the incremental sums.
+        file_vector<double> prices("test34.prices", fv_int::create_file);
+        prices.clear();
+        for (int i = 0; i < 250003; ++i) {
+            prices.push_back(static_cast<double>(i % 1000) / 4);
+        }
+        prefix_sum<double> added("test34.prices.added", fv_int::create_file);
+        added.clear();
+        for (double const p : prices) {
+            added.add(p);
+        }
+        prefix_sum<double> rebuilt("test34.prices.sums", fv_int::create_file);
+        rebuilt.rebuild(prices, 3);
+        assert(rebuilt.rows() == prices.size() && added.rows() == prices.size());
+        // Quarters sum exactly in a double.
+        for (size_t const last : {size_t(1), size_t(3), size_t(4), size_t(5), size_t(83335), size_t(250003)}) {
+            assert(rebuilt.total(last) == added.total(last));
+            assert(rebuilt.sum(min(size_t(2), last), last) == added.sum(min(size_t(2), last), last));
+        }
+
+        // Stale sums are rebuilt.
+        prices.resize(10);
+        rebuilt.update(prices);
+        assert(rebuilt.rows() == 10 && rebuilt.total(10) == added.total(10));
+        prices.clear();
+        for (int i = 0; i < 20; ++i) {
+            prices.push_back(-i);
+        }
+        rebuilt.update(prices);
+        assert(rebuilt.rows() == 20 && rebuilt.total(20) == -190.0);
+        sizes.clear();
+        for (int i = 0; i < 5; ++i) {
+            sizes.push_back(i);
+        }
+        sizes.close();
+        {
+            file_vector<int32_t> raw_sizes("test34");
+            raw_sizes.clear();
+            for (int i = 0; i < 8; ++i) {
+                raw_sizes.push_back(100);
+            }
+        }
+        summed_file_vector<int32_t> refilled("test34");
+        assert(refilled.sum(0, 8) == 800);
+        refilled.clear();
+        refilled.close();
+
+        added.clear();
+        added.close();
+        rebuilt.clear();
+        rebuilt.close();
+        prices.clear();
+    }
 }
@@ -0,0 +1,252 @@
+#ifndef ZONE_MAP_HPP
+#define ZONE_MAP_HPP
+
+#include <cmath>
+#include <limits>
+#include "file_vector.hpp"
+#include "filter.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// Per block statistics for a column of arithmetic values: the minimum,
+// maximum, row count and null count of every 'block_size' rows, kept in a
+// companion file_vector. For floating point columns NaN is the null value,
+// and is left out of the minimum and maximum; integer columns have no
+// nulls.
+//
+// The statistics only ever cover a prefix of the column, so appending rows
+// is caught up by update, which continues from the last block. If they
+// cover more rows than the column has, or the last row they cover is
+// outside its block's statistics, they are stale and are rebuilt. A column
+// cleared and refilled past its old length is so caught unless its new
+// last covered row happens to fit; other rewrites of covered rows need a
+// rebuild.
+
+template <typename T>
+class zone_map {
+    static_assert(is_arithmetic<T>::value, "zone_map needs an arithmetic type.");
+
+    using size_type = size_t;
+
+public:
+    static size_type constexpr block_size = 4096;
+    static_assert(block_size % 64 == 0, "zone_map blocks must start on a selection word.");
+
+    struct zone {
+        T min;
+        T max;
+        uint64_t count;
+        uint64_t nulls;
+    };
+
+private:
+    file_vector<zone> zones;
+
+    static bool is_null(T const value) {
+        return value != value;
+    }
+
+    // Whether the last covered row of 'col' fits the statistics of its block.
+    template <typename R>
+    bool fits_last(file_vector<T, R> const& col) const {
+        size_type const n = rows();
+        if (n == 0) {
+            return true;
+        }
+        zone const& z = zones.back();
+        T const value = col.data()[n - 1];
+        return is_null(value) ? z.nulls > 0 : (z.min <= value && value <= z.max);
+    }
+
+public:
+    zone_map(string const& name, int mode = 0) : zones(name, mode) {}
+
+    void close() {
+        zones.close();
+    }
+
+    // Number of column rows covered.
+    size_type rows() const {
+        return zones.empty() ? 0 : (zones.size() - 1) * block_size + zones.back().count;
+    }
+
+    size_type size() const {
+        return zones.size();
+    }
+
+    zone const& operator[] (size_type const b) const {
+        assert(b < zones.size());
+
+        return zones.data()[b];
+    }
+
+    // Add the statistics of the next row.
+    void add(T const value) {
+        if (zones.empty() || zones.back().count == block_size) {
+            zones.push_back(zone {
+                numeric_limits<T>::max(), numeric_limits<T>::lowest(), 0, 0
+            });
+        }
+
+        zone& z = zones.back();
+        ++z.count;
+        if (is_null(value)) {
+            ++z.nulls;
+        } else {
+            z.min = (value < z.min) ? value : z.min;
+            z.max = (value > z.max) ? value : z.max;
+        }
+    }
+
+    // Catch up with rows appended to 'col', or rebuild if stale.
+    template <typename R>
+    void update(file_vector<T, R> const& col) {
+        size_type first = rows();
+        if (first > col.size() || !fits_last(col)) {
+            zones.clear();
+            first = 0;
+        }
+
+        T const* const values = col.data();
+        for (size_type i = first; i < col.size(); ++i) {
+            add(values[i]);
+        }
+    }
+
+    void clear() {
+        zones.clear();
+    }
+
+    // Whether block 'b' may hold values in [lo, hi], and whether all of its
+    // values certainly are.
+    bool overlaps(size_type const b, T const lo, T const hi) const {
+        zone const& z = (*this)[b];
+        return z.count > z.nulls && z.min <= hi && z.max >= lo;
+    }
+
+    bool within(size_type const b, T const lo, T const hi) const {
+        zone const& z = (*this)[b];
+        return z.nulls == 0 && z.min >= lo && z.max <= hi;
+    }
+};
+
+//----------------------------------------------------------------------------
+// A file_vector of arithmetic values with a zone map, "<name>.zones", kept
+// up to date as rows are appended. Rows can only be appended or cleared, so
+// the statistics always describe the data. Range queries skip the blocks
+// whose statistics rule them out, and select whole blocks that are known to
+// match, without reading (or faulting in) their rows.
+
+template <typename T>
+class zoned_file_vector {
+    using size_type = size_t;
+
+    file_vector<T> values;
+    zone_map<T> zones;
+
+public:
+    static int constexpr create_file = file_vector<T>::create_file;
+    static size_type constexpr block_size = zone_map<T>::block_size;
+
+    zoned_file_vector(string const& name, int mode = 0)
+    : values(name, mode), zones(name + ".zones", mode) {
+        zones.update(values);
+    }
+
+    void close() {
+        values.close();
+        zones.close();
+    }
+
+    //------------------------------------------------------------------------
+    // Capacity and Element Access
+
+    size_type size() const {
+        return values.size();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    T const& operator[] (size_type const i) const {
+        assert(i < size());
+
+        return values.data()[i];
+    }
+
+    T const* data() const {
+        return values.data();
+    }
+
+    file_vector<T> const& column() const {
+        return values;
+    }
+
+    zone_map<T> const& zone_stats() const {
+        return zones;
+    }
+
+    //------------------------------------------------------------------------
+    // Modifiers
+
+    void push_back(T const value) {
+        values.push_back(value);
+        zones.add(value);
+    }
+
+    template <typename I, typename = typename I::iterator_category>
+    void append(I first, I last) {
+        values.insert(values.cend(), first, last);
+        zones.update(values);
+    }
+
+    void clear() {
+        values.clear();
+        zones.clear();
+    }
+
+    //------------------------------------------------------------------------
+    // Range queries
+
+    // Rows with lo <= value <= hi.
+    selection select_between(T const lo, T const hi) const {
+        selection s(size());
+        uint64_t* const out = s.data();
+
+        for (size_type b = 0; b < zones.size(); ++b) {
+            size_type const first = b * block_size;
+            size_type const n = zones[b].count;
+            if (zones.within(b, lo, hi)) {
+                // Blocks start on a word, as block_size is a multiple of 64.
+                fill(out + first / 64, out + (first + n) / 64, ~uint64_t(0));
+                if (n % 64 != 0) {
+                    out[(first + n) / 64] = (uint64_t(1) << (n % 64)) - 1;
+                }
+            } else if (zones.overlaps(b, lo, hi)) {
+                selection const block = ::select_between(values.data() + first, n, lo, hi);
+                copy(block.data(), block.data() + block.word_count(), out + first / 64);
+            }
+        }
+        return s;
+    }
+
+    // Call 'f(T const* values, size_type n, size_type first_row)' for each
+    // block that may hold values in [lo, hi], returning the number of
+    // blocks scanned.
+    template <typename F>
+    size_type scan_between(T const lo, T const hi, F f) const {
+        size_type scanned = 0;
+        for (size_type b = 0; b < zones.size(); ++b) {
+            if (zones.overlaps(b, lo, hi)) {
+                size_type const first = b * block_size;
+                f(values.data() + first, static_cast<size_type>(zones[b].count), first);
+                ++scanned;
+            }
+        }
+        return scanned;
+    }
+};
+
+#endif